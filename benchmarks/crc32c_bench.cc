@@ -0,0 +1,84 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Compares crc32c::Extend(), which uses the SSE4.2/PCLMULQDQ kernels when
+// the CPU supports them, with the portable slicing-by-4 implementation.
+//
+// Usage: crc32c_bench [--bytes=N]
+//   --bytes=N   total number of bytes checksummed per measurement
+//               (default 1 GB)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "../port/crc32c_sse42.h"
+#include "../util/crc32c.h"
+
+namespace {
+
+// Block sizes to measure; 4 KB is the default table block size.
+const size_t kSizes[] = {64, 256, 1024, 4096, 16384, 65536, 1 << 20};
+
+typedef uint32_t (*ExtendFunction)(uint32_t, const char*, size_t);
+
+// Returns throughput in MB/s of checksumming "data[0,size-1]" until
+// "total_bytes" bytes have been processed.
+double Measure(ExtendFunction extend, const std::string& data, size_t size,
+               uint64_t total_bytes, uint32_t* result) {
+  const uint64_t iterations = total_bytes / size + 1;
+  uint32_t crc = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < iterations; i++) {
+    crc = extend(crc, data.data(), size);
+  }
+  auto end = std::chrono::steady_clock::now();
+  *result = crc;
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return (iterations * size) / 1048576.0 / seconds;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t total_bytes = 1ull << 30;
+  for (int i = 1; i < argc; i++) {
+    unsigned long long n;
+    char junk;
+    if (sscanf(argv[i], "--bytes=%llu%c", &n, &junk) == 1) {
+      total_bytes = n;
+    } else {
+      std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      std::exit(1);
+    }
+  }
+
+  std::string data(kSizes[sizeof(kSizes) / sizeof(kSizes[0]) - 1], '\0');
+  std::mt19937 rnd(301);
+  for (char& c : data) {
+    c = static_cast<char>(rnd());
+  }
+
+  std::fprintf(stdout, "SSE4.2+PCLMULQDQ: %s\n",
+               leveldb::port::CanAccelerateCRC32CWithSSE42() ? "yes" : "no");
+  std::fprintf(stdout, "%10s %16s %16s %8s\n", "bytes", "portable MB/s",
+               "Extend MB/s", "speedup");
+  for (size_t size : kSizes) {
+    uint32_t portable_crc, crc;
+    double portable = Measure(&leveldb::crc32c::ExtendPortable, data, size,
+                              total_bytes, &portable_crc);
+    double accelerated =
+        Measure(&leveldb::crc32c::Extend, data, size, total_bytes, &crc);
+    if (crc != portable_crc) {
+      std::fprintf(stderr, "crc mismatch for %zu byte buffers\n", size);
+      return 1;
+    }
+    std::fprintf(stdout, "%10zu %16.1f %16.1f %7.2fx\n", size, portable,
+                 accelerated, accelerated / portable);
+  }
+  return 0;
+}
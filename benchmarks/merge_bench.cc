@@ -0,0 +1,241 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Compares NewMergingIterator(), which keeps its inputs in a loser tree,
+// with a merge over a binary heap of the inputs.  For each input count the
+// same keys are spread randomly over the inputs and merged in full; the
+// benchmark reports the time and the key comparisons per merged key.
+//
+// Usage: merge_bench [--keys=N] [--key_size=N]
+//   --keys=N       total number of keys merged per measurement
+//                  (default 2000000)
+//   --key_size=N   bytes per key (default 16)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/comparator.h"
+#include "../include/iterator.h"
+#include "../src/iterator_wrapper.h"
+#include "../src/merger.h"
+
+namespace {
+
+// Input counts to measure.
+const int kInputs[] = {2, 4, 8, 16, 32, 64, 128, 256};
+
+// Bytewise order, counting the calls to Compare().
+class CountingComparator : public leveldb::Comparator {
+ public:
+  CountingComparator() : count_(0) {}
+
+  int Compare(const leveldb::Slice& a, const leveldb::Slice& b) const override {
+    count_++;
+    return a.compare(b);
+  }
+
+  const char* Name() const override { return "merge_bench.Counting"; }
+
+  void FindShortestSeparator(std::string* /*start*/,
+                             const leveldb::Slice& /*limit*/) const override {}
+
+  void FindShortSuccessor(std::string* /*key*/) const override {}
+
+  uint64_t count() const { return count_; }
+  void Reset() { count_ = 0; }
+
+ private:
+  mutable uint64_t count_;
+};
+
+// Iterates over a sorted vector of keys that it does not own.
+class VectorIterator : public leveldb::Iterator {
+ public:
+  explicit VectorIterator(const std::vector<std::string>* keys)
+      : keys_(keys), pos_(keys->size()) {}
+
+  bool Valid() const override { return pos_ < keys_->size(); }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override {
+    pos_ = keys_->empty() ? keys_->size() : keys_->size() - 1;
+  }
+  void Seek(const leveldb::Slice& target) override {
+    pos_ = std::lower_bound(keys_->begin(), keys_->end(), target.ToString()) -
+           keys_->begin();
+  }
+  void Next() override { pos_++; }
+  void Prev() override { pos_ = (pos_ == 0) ? keys_->size() : pos_ - 1; }
+  leveldb::Slice key() const override { return (*keys_)[pos_]; }
+  leveldb::Slice value() const override { return leveldb::Slice(); }
+  leveldb::Status status() const override { return leveldb::Status::OK(); }
+
+ private:
+  const std::vector<std::string>* const keys_;
+  size_t pos_;
+};
+
+// Forward-only merge that keeps the valid inputs in a binary min-heap.
+// Each step sifts the advanced input down from the root, which costs up
+// to two comparisons per level.
+class HeapMerger {
+ public:
+  HeapMerger(const leveldb::Comparator* comparator,
+             std::vector<leveldb::Iterator*> children)
+      : comparator_(comparator), children_(children.size()) {
+    for (size_t i = 0; i < children.size(); i++) {
+      children_[i].Set(children[i]);
+    }
+  }
+
+  void SeekToFirst() {
+    heap_.clear();
+    for (size_t i = 0; i < children_.size(); i++) {
+      children_[i].SeekToFirst();
+      if (children_[i].Valid()) {
+        heap_.push_back(static_cast<int>(i));
+      }
+    }
+    for (size_t i = heap_.size() / 2; i-- > 0;) {
+      SiftDown(i);
+    }
+  }
+
+  bool Valid() const { return !heap_.empty(); }
+  leveldb::Slice key() const { return children_[heap_[0]].key(); }
+
+  void Next() {
+    children_[heap_[0]].Next();
+    if (!children_[heap_[0]].Valid()) {
+      heap_[0] = heap_.back();
+      heap_.pop_back();
+    }
+    if (!heap_.empty()) {
+      SiftDown(0);
+    }
+  }
+
+ private:
+  bool Less(int a, int b) const {
+    int r = comparator_->Compare(children_[a].key(), children_[b].key());
+    return r < 0 || (r == 0 && a < b);
+  }
+
+  void SiftDown(size_t i) {
+    const size_t n = heap_.size();
+    while (true) {
+      size_t smallest = i;
+      const size_t left = 2 * i + 1;
+      const size_t right = left + 1;
+      if (left < n && Less(heap_[left], heap_[smallest])) smallest = left;
+      if (right < n && Less(heap_[right], heap_[smallest])) smallest = right;
+      if (smallest == i) {
+        return;
+      }
+      std::swap(heap_[i], heap_[smallest]);
+      i = smallest;
+    }
+  }
+
+  const leveldb::Comparator* const comparator_;
+  std::vector<leveldb::IteratorWrapper> children_;
+  std::vector<int> heap_;
+};
+
+std::vector<leveldb::Iterator*> NewInputs(
+    const std::vector<std::vector<std::string>>& inputs) {
+  std::vector<leveldb::Iterator*> result;
+  for (const std::vector<std::string>& keys : inputs) {
+    result.push_back(new VectorIterator(&keys));
+  }
+  return result;
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t num_keys = 2000000;
+  int key_size = 16;
+  for (int i = 1; i < argc; i++) {
+    unsigned long long n;
+    char junk;
+    if (sscanf(argv[i], "--keys=%llu%c", &n, &junk) == 1 && n > 0) {
+      num_keys = n;
+    } else if (sscanf(argv[i], "--key_size=%llu%c", &n, &junk) == 1 &&
+               n > 0) {
+      key_size = static_cast<int>(n);
+    } else {
+      std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      std::exit(1);
+    }
+  }
+
+  std::mt19937_64 rnd(301);
+  std::vector<std::string> keys(num_keys);
+  for (std::string& key : keys) {
+    key.resize(key_size);
+    for (char& c : key) {
+      c = static_cast<char>('a' + rnd() % 26);
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+
+  CountingComparator comparator;
+  std::fprintf(stdout, "%6s %14s %14s %12s %12s %8s\n", "inputs",
+               "heap ns/key", "tree ns/key", "heap cmp/key", "tree cmp/key",
+               "speedup");
+  for (int n : kInputs) {
+    std::vector<std::vector<std::string>> inputs(n);
+    for (const std::string& key : keys) {
+      inputs[rnd() % n].push_back(key);
+    }
+
+    comparator.Reset();
+    HeapMerger heap(&comparator, NewInputs(inputs));
+    auto start = std::chrono::steady_clock::now();
+    uint64_t heap_keys = 0;
+    for (heap.SeekToFirst(); heap.Valid(); heap.Next()) {
+      heap_keys++;
+    }
+    const double heap_seconds = Seconds(start);
+    const uint64_t heap_compares = comparator.count();
+
+    comparator.Reset();
+    std::vector<leveldb::Iterator*> children = NewInputs(inputs);
+    leveldb::Iterator* tree =
+        leveldb::NewMergingIterator(&comparator, children.data(), n);
+    start = std::chrono::steady_clock::now();
+    uint64_t tree_keys = 0;
+    for (tree->SeekToFirst(); tree->Valid(); tree->Next()) {
+      tree_keys++;
+    }
+    const double tree_seconds = Seconds(start);
+    const uint64_t tree_compares = comparator.count();
+    delete tree;
+
+    if (heap_keys != num_keys || tree_keys != num_keys) {
+      std::fprintf(stderr, "merged %llu and %llu of %llu keys\n",
+                   static_cast<unsigned long long>(heap_keys),
+                   static_cast<unsigned long long>(tree_keys),
+                   static_cast<unsigned long long>(num_keys));
+      return 1;
+    }
+    std::fprintf(stdout, "%6d %14.1f %14.1f %12.2f %12.2f %7.2fx\n", n,
+                 heap_seconds * 1e9 / num_keys, tree_seconds * 1e9 / num_keys,
+                 static_cast<double>(heap_compares) / num_keys,
+                 static_cast<double>(tree_compares) / num_keys,
+                 heap_seconds / tree_seconds);
+  }
+  return 0;
+}
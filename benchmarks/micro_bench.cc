@@ -0,0 +1,266 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Google Benchmark suite for the kernels on the table read and write
+// paths: varint coding, crc32c, BlockBuilder and Block::Iter.  Block
+// benchmarks are parameterised by key length, shared prefix length,
+// restart interval and block size.
+//
+// Usage: micro_bench [--benchmark_filter=REGEX] [other Google Benchmark
+// flags]
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/comparator.h"
+#include "../include/iterator.h"
+#include "../include/options.h"
+#include "../src/block.h"
+#include "../src/block_builder.h"
+#include "../src/format.h"
+#include "../util/coding.h"
+#include "../util/crc32c.h"
+
+namespace leveldb {
+
+namespace {
+
+const int kValueSize = 32;
+
+// Values whose varint encoding takes exactly "bytes" bytes.
+std::vector<uint32_t> VarintValues(int bytes, size_t n) {
+  const uint32_t lo = bytes == 1 ? 0 : (1u << (7 * (bytes - 1)));
+  const uint32_t hi = bytes == 5 ? 0xffffffffu : (1u << (7 * bytes)) - 1;
+  std::mt19937 rnd(301);
+  std::uniform_int_distribution<uint32_t> dist(lo, hi);
+  std::vector<uint32_t> values(n);
+  for (uint32_t& v : values) {
+    v = dist(rnd);
+  }
+  return values;
+}
+
+void BM_PutVarint32(benchmark::State& state) {
+  const std::vector<uint32_t> values =
+      VarintValues(static_cast<int>(state.range(0)), 4096);
+  std::string dst;
+  dst.reserve(values.size() * 5);
+  for (auto _ : state) {
+    dst.clear();
+    for (uint32_t v : values) {
+      PutVarint32(&dst, v);
+    }
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK(BM_PutVarint32)->ArgName("bytes")->DenseRange(1, 5);
+
+void BM_GetVarint32Ptr(benchmark::State& state) {
+  const std::vector<uint32_t> values =
+      VarintValues(static_cast<int>(state.range(0)), 4096);
+  std::string encoded;
+  for (uint32_t v : values) {
+    PutVarint32(&encoded, v);
+  }
+  const char* limit = encoded.data() + encoded.size();
+  for (auto _ : state) {
+    const char* p = encoded.data();
+    uint32_t sum = 0;
+    while (p < limit) {
+      uint32_t v;
+      p = GetVarint32Ptr(p, limit, &v);
+      sum += v;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK(BM_GetVarint32Ptr)->ArgName("bytes")->DenseRange(1, 5);
+
+void BM_Crc32cExtend(benchmark::State& state) {
+  std::string data(static_cast<size_t>(state.range(0)), '\0');
+  std::mt19937 rnd(301);
+  for (char& c : data) {
+    c = static_cast<char>(rnd());
+  }
+  uint32_t crc = 0;
+  for (auto _ : state) {
+    crc = crc32c::Extend(crc, data.data(), data.size());
+    benchmark::DoNotOptimize(crc);
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Crc32cExtend)
+    ->ArgName("bytes")
+    ->RangeMultiplier(4)
+    ->Range(64, 1 << 20);
+
+// Block benchmarks take (key_len, shared_prefix, restart_interval,
+// block_size).  Keys are shared_prefix bytes of 'k' followed by random
+// bytes, so neighbouring keys share shared_prefix bytes and rarely more.
+struct BlockParams {
+  explicit BlockParams(const benchmark::State& state)
+      : key_len(static_cast<int>(state.range(0))),
+        shared_prefix(static_cast<int>(state.range(1))),
+        restart_interval(static_cast<int>(state.range(2))),
+        block_size(static_cast<size_t>(state.range(3))) {}
+
+  int key_len;
+  int shared_prefix;
+  int restart_interval;
+  size_t block_size;
+};
+
+// Sorted, distinct keys, enough to fill one block of the requested size
+// even if every key shares all but its last byte with the previous one.
+std::vector<std::string> BlockKeys(const BlockParams& p) {
+  const size_t n = p.block_size / (kValueSize + 4) + 1;
+  std::mt19937 rnd(301);
+  std::vector<std::string> keys(n);
+  for (std::string& key : keys) {
+    key.assign(static_cast<size_t>(p.shared_prefix), 'k');
+    while (key.size() < static_cast<size_t>(p.key_len)) {
+      key.push_back(static_cast<char>('a' + rnd() % 26));
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  return keys;
+}
+
+// A finished block and the keys in it.
+class BenchBlock {
+ public:
+  explicit BenchBlock(const BlockParams& p) : value_(kValueSize, 'v') {
+    options_.block_restart_interval = p.restart_interval;
+    BlockBuilder builder(&options_);
+    for (const std::string& key : BlockKeys(p)) {
+      if (builder.CurrentSizeEstimate() >= p.block_size) {
+        break;
+      }
+      builder.Add(key, value_);
+      keys_.push_back(key);
+    }
+    data_ = builder.Finish().ToString();
+    BlockContents contents;
+    contents.data = data_;
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    contents.compression_type = kNoCompression;
+    block_.reset(new Block(contents));
+  }
+
+  Iterator* NewIterator() const {
+    return block_->NewIterator(BytewiseComparator());
+  }
+
+  const std::vector<std::string>& keys() const { return keys_; }
+
+ private:
+  Options options_;
+  const std::string value_;
+  std::vector<std::string> keys_;
+  std::string data_;
+  std::unique_ptr<Block> block_;
+};
+
+// Every combination in which keys keep at least 8 random bytes.
+void BlockArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"key_len", "shared", "restart", "block_size"});
+  for (int key_len : {16, 64}) {
+    for (int shared : {0, 8, 48}) {
+      if (key_len - shared < 8) {
+        continue;
+      }
+      for (int restart : {1, 16, 64}) {
+        for (int block_size : {4096, 65536}) {
+          b->Args({key_len, shared, restart, block_size});
+        }
+      }
+    }
+  }
+}
+
+void BM_BlockBuilderAdd(benchmark::State& state) {
+  const BlockParams p(state);
+  const std::vector<std::string> keys = BlockKeys(p);
+  const std::string value(kValueSize, 'v');
+  Options options;
+  options.block_restart_interval = p.restart_interval;
+  BlockBuilder builder(&options);
+  size_t added = 0;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    builder.Reset();
+    for (const std::string& key : keys) {
+      if (builder.CurrentSizeEstimate() >= p.block_size) {
+        break;
+      }
+      builder.Add(key, value);
+      added++;
+    }
+    Slice block = builder.Finish();
+    bytes += block.size();
+    benchmark::DoNotOptimize(block.data());
+  }
+  state.SetItemsProcessed(added);
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_BlockBuilderAdd)->Apply(BlockArgs);
+
+void BM_BlockSeek(benchmark::State& state) {
+  const BlockParams p(state);
+  const BenchBlock block(p);
+  std::unique_ptr<Iterator> iter(block.NewIterator());
+  std::vector<size_t> order(1024);
+  std::mt19937 rnd(301);
+  for (size_t& i : order) {
+    i = rnd() % block.keys().size();
+  }
+  size_t n = 0;
+  for (auto _ : state) {
+    iter->Seek(block.keys()[order[n++ % order.size()]]);
+    benchmark::DoNotOptimize(iter->Valid());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BlockSeek)->Apply(BlockArgs);
+
+void BM_BlockNext(benchmark::State& state) {
+  const BlockParams p(state);
+  const BenchBlock block(p);
+  std::unique_ptr<Iterator> iter(block.NewIterator());
+  for (auto _ : state) {
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      benchmark::DoNotOptimize(iter->key().data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * block.keys().size());
+}
+BENCHMARK(BM_BlockNext)->Apply(BlockArgs);
+
+void BM_BlockPrev(benchmark::State& state) {
+  const BlockParams p(state);
+  const BenchBlock block(p);
+  std::unique_ptr<Iterator> iter(block.NewIterator());
+  for (auto _ : state) {
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      benchmark::DoNotOptimize(iter->key().data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * block.keys().size());
+}
+BENCHMARK(BM_BlockPrev)->Apply(BlockArgs);
+
+}  // namespace
+
+}  // namespace leveldb
+
+BENCHMARK_MAIN();
@@ -0,0 +1,798 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Builds one table and runs read workloads against it, in the style of
+// db_bench.  Every benchmark reports micros/op, ops/s, MB/s and (with
+// --histogram=1) a latency histogram.
+//
+// Usage: table_bench [--flag=value ...]
+//   --benchmarks=a,b,...  comma-separated list, run in order.  Fills
+//                         (re)build the table; reads use the last one.
+//      fillseq       build the table from --num keys in order
+//      fillrandom    build the table from --num randomly chosen keys;
+//                    they are sorted (untimed) before the build, since
+//                    TableBuilder needs increasing keys
+//      readrandom    --reads point lookups of keys from --distribution
+//      readmissing   like readrandom but every key is absent
+//      readseq       scan the table forward
+//      readreverse   scan the table backward
+//      seekrandom    --reads iterator seeks to keys from --distribution
+//      readscaling   readrandom with 1, 2, 4, ... --max_threads threads
+//                    sharing the table, and the speedup over one thread
+//      bulkload      feed --num keys in random order to BulkLoader, which
+//                    sorts them into tables of --bulk_file_size bytes
+//                    next to --file; the tables are deleted afterwards
+//                    and reads keep using the last fill
+//   --num=N               keys in the table (default 1000000)
+//   --reads=N             operations per thread for reads (default --num)
+//   --threads=N           reader threads (default 1); fills use one thread
+//   --max_threads=N       largest thread count of readscaling (default 64)
+//   --key_size=N          bytes per key (default 16)
+//   --value_size=N        bytes per value (default 100)
+//   --compression_ratio=F values compress to about this fraction
+//                         (default 0.5)
+//   --distribution=D      uniform, zipfian or latest (default uniform)
+//   --zipf_theta=F        skew of zipfian and latest (default 0.99)
+//   --block_size=N        Options::block_size (default 4096)
+//   --block_restart_interval=N  (default 16)
+//   --compression=C       none, snappy, lz4 or zstd (default snappy)
+//   --cache_size=N        block cache bytes, 0 for none (default 8 MB)
+//   --bloom_bits=N        bloom filter bits per key, 0 for none (default 0)
+//   --direct_io=0|1       read and write through NewDirectIOEnv()
+//   --histogram=0|1       print latency histograms (default 0)
+//   --statistics=0|1      print Options::statistics after each benchmark
+//   --bulk_memory=N       BulkLoadOptions::memory_budget (default 64 MB)
+//   --bulk_threads=N      sort and merge threads of bulkload (default 4)
+//   --bulk_file_size=N    bulkload output table size, 0 for a single
+//                         table (default 64 MB)
+//   --seed=N              random seed (default 301)
+//   --file=PATH           table file (default /tmp/table_bench.sst)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/cache.h"
+#include "../include/env.h"
+#include "../include/filter_policy.h"
+#include "../include/iterator.h"
+#include "../include/options.h"
+#include "../include/statistics.h"
+#include "../src/bulk_loader.h"
+#include "../src/table.h"
+#include "../src/table_builder.h"
+#include "../util/histogram.h"
+
+namespace {
+
+const char* FLAGS_benchmarks =
+    "fillseq,readrandom,readmissing,readseq,readreverse,seekrandom";
+uint64_t FLAGS_num = 1000000;
+int64_t FLAGS_reads = -1;
+int FLAGS_threads = 1;
+int FLAGS_max_threads = 64;
+int FLAGS_key_size = 16;
+int FLAGS_value_size = 100;
+double FLAGS_compression_ratio = 0.5;
+const char* FLAGS_distribution = "uniform";
+double FLAGS_zipf_theta = 0.99;
+int FLAGS_block_size = 4096;
+int FLAGS_block_restart_interval = 16;
+const char* FLAGS_compression = "snappy";
+int64_t FLAGS_cache_size = 8 << 20;
+int FLAGS_bloom_bits = 0;
+bool FLAGS_direct_io = false;
+bool FLAGS_histogram = false;
+bool FLAGS_statistics = false;
+int64_t FLAGS_bulk_memory = 64 << 20;
+int FLAGS_bulk_threads = 4;
+int64_t FLAGS_bulk_file_size = 64 << 20;
+uint64_t FLAGS_seed = 301;
+std::string FLAGS_file = "/tmp/table_bench.sst";
+
+uint64_t NowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Values are cut from a 1 MB buffer of 100 byte pieces, each made of a
+// random prefix of compression_ratio * 100 bytes repeated to fill it.
+class ValueGenerator {
+ public:
+  explicit ValueGenerator(uint64_t seed) : pos_(0) {
+    std::mt19937_64 rnd(seed);
+    const size_t kPiece = 100;
+    size_t raw = static_cast<size_t>(kPiece * FLAGS_compression_ratio);
+    raw = std::max<size_t>(raw, 1);
+    while (data_.size() < std::max<size_t>(1 << 20, FLAGS_value_size)) {
+      std::string piece;
+      for (size_t i = 0; i < raw; i++) {
+        piece.push_back(static_cast<char>(' ' + rnd() % 95));
+      }
+      while (piece.size() < kPiece) {
+        piece.append(piece, 0, std::min(raw, kPiece - piece.size()));
+      }
+      data_.append(piece);
+    }
+  }
+
+  leveldb::Slice Generate(size_t len) {
+    if (pos_ + len > data_.size()) {
+      pos_ = 0;
+    }
+    pos_ += len;
+    return leveldb::Slice(data_.data() + pos_ - len, len);
+  }
+
+ private:
+  std::string data_;
+  size_t pos_;
+};
+
+// Zipfian ranks in [0, n) following Gray et al., "Quickly Generating
+// Billion-Record Synthetic Databases" (as in YCSB).  Rank 0 is the most
+// popular.  The constants cost O(n) to compute and are shared by threads.
+class ZipfianDistribution {
+ public:
+  ZipfianDistribution(uint64_t n, double theta) : n_(n), theta_(theta) {
+    double zeta2 = 0;
+    zetan_ = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+      zetan_ += 1.0 / std::pow(static_cast<double>(i), theta);
+      if (i == 2) {
+        zeta2 = zetan_;
+      }
+    }
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+  }
+
+  uint64_t Next(double u) const {
+    const double uz = u * zetan_;
+    if (uz < 1.0) {
+      return 0;
+    }
+    if (uz < 1.0 + std::pow(0.5, theta_)) {
+      return 1;
+    }
+    uint64_t rank =
+        static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+    return std::min(rank, n_ - 1);
+  }
+
+ private:
+  const uint64_t n_;
+  const double theta_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+};
+
+enum Distribution { kUniform, kZipfian, kLatest };
+
+Distribution ParseDistribution(const char* name) {
+  if (std::strcmp(name, "uniform") == 0) return kUniform;
+  if (std::strcmp(name, "zipfian") == 0) return kZipfian;
+  if (std::strcmp(name, "latest") == 0) return kLatest;
+  std::fprintf(stderr, "Unknown distribution '%s'\n", name);
+  std::exit(1);
+}
+
+// Spreads zipfian ranks over the key space so the hot keys do not all sit
+// in the first few blocks.
+uint64_t Scramble(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+// Key numbers for one thread.
+class KeyGenerator {
+ public:
+  KeyGenerator(Distribution distribution, const ZipfianDistribution* zipf,
+               uint64_t seed)
+      : distribution_(distribution), zipf_(zipf), rnd_(seed) {}
+
+  uint64_t Next() {
+    switch (distribution_) {
+      case kZipfian:
+        return Scramble(zipf_->Next(Uniform01())) % FLAGS_num;
+      case kLatest:
+        return FLAGS_num - 1 - zipf_->Next(Uniform01());
+      case kUniform:
+      default:
+        return rnd_() % FLAGS_num;
+    }
+  }
+
+ private:
+  double Uniform01() {
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rnd_);
+  }
+
+  const Distribution distribution_;
+  const ZipfianDistribution* const zipf_;
+  std::mt19937_64 rnd_;
+};
+
+// Formats key number k as a zero-padded decimal of --key_size bytes.
+// Missing keys get a trailing '.', which sorts them between real keys.
+void MakeKey(uint64_t k, bool missing, std::string* key) {
+  char buf[32];
+  int n = std::snprintf(buf, sizeof(buf), "%020llu",
+                        static_cast<unsigned long long>(k));
+  key->assign(static_cast<size_t>(FLAGS_key_size), '0');
+  size_t keep = std::min<size_t>(n, key->size());
+  key->replace(key->size() - keep, keep, buf + n - keep, keep);
+  if (missing) {
+    key->push_back('.');
+  }
+}
+
+// State of the InternalGet callback, which has no argument of its own.
+thread_local const std::string* lookup_key = nullptr;
+thread_local bool lookup_found = false;
+
+void SaveLookupResult(const leveldb::Slice& k, const leveldb::Slice& /*v*/) {
+  lookup_found = (k == leveldb::Slice(*lookup_key));
+}
+
+// Result of one benchmark thread.
+struct ThreadStats {
+  uint64_t ops = 0;
+  uint64_t found = 0;
+  uint64_t bytes = 0;
+  uint64_t nanos = 0;
+  leveldb::AtomicHistogram latency;
+};
+
+class Benchmark {
+ public:
+  Benchmark()
+      : env_(leveldb::Env::Default()),
+        cache_(FLAGS_cache_size > 0 ? leveldb::NewLRUCache(FLAGS_cache_size)
+                                    : nullptr),
+        filter_policy_(FLAGS_bloom_bits > 0
+                           ? leveldb::NewBloomFilterPolicy(FLAGS_bloom_bits)
+                           : nullptr),
+        statistics_(FLAGS_statistics ? leveldb::NewStatistics() : nullptr),
+        distribution_(ParseDistribution(FLAGS_distribution)),
+        file_(nullptr),
+        table_(nullptr),
+        file_size_(0) {
+    if (FLAGS_direct_io) {
+      env_ = leveldb::NewDirectIOEnv(env_);
+    }
+    options_.env = env_;
+    options_.block_cache = cache_;
+    options_.filter_policy = filter_policy_;
+    options_.statistics = statistics_;
+    options_.block_size = FLAGS_block_size;
+    options_.block_restart_interval = FLAGS_block_restart_interval;
+    options_.compression = ParseCompression(FLAGS_compression);
+    if (distribution_ != kUniform) {
+      zipf_.reset(new ZipfianDistribution(FLAGS_num, FLAGS_zipf_theta));
+    }
+  }
+
+  ~Benchmark() {
+    CloseTable();
+    if (FLAGS_direct_io) {
+      delete env_;
+    }
+    delete statistics_;
+    delete filter_policy_;
+    delete cache_;
+  }
+
+  void Run() {
+    PrintHeader();
+    const char* benchmarks = FLAGS_benchmarks;
+    while (benchmarks != nullptr && *benchmarks != '\0') {
+      const char* sep = std::strchr(benchmarks, ',');
+      std::string name;
+      if (sep == nullptr) {
+        name = benchmarks;
+        benchmarks = nullptr;
+      } else {
+        name.assign(benchmarks, sep - benchmarks);
+        benchmarks = sep + 1;
+      }
+      if (name.empty()) {
+        continue;
+      }
+      if (statistics_ != nullptr) {
+        statistics_->Reset();
+      }
+
+      if (name == "fillseq") {
+        Fill(name, false);
+      } else if (name == "fillrandom") {
+        Fill(name, true);
+      } else if (name == "readrandom") {
+        RunReaders(name, &Benchmark::ReadRandom, FLAGS_threads);
+      } else if (name == "readmissing") {
+        RunReaders(name, &Benchmark::ReadMissing, FLAGS_threads);
+      } else if (name == "readseq") {
+        RunReaders(name, &Benchmark::ReadSequential, FLAGS_threads);
+      } else if (name == "readreverse") {
+        RunReaders(name, &Benchmark::ReadReverse, FLAGS_threads);
+      } else if (name == "seekrandom") {
+        RunReaders(name, &Benchmark::SeekRandom, FLAGS_threads);
+      } else if (name == "readscaling") {
+        ReadScaling();
+      } else if (name == "bulkload") {
+        BulkLoad(name);
+      } else {
+        std::fprintf(stderr, "Unknown benchmark '%s'\n", name.c_str());
+        continue;
+      }
+
+      if (statistics_ != nullptr) {
+        std::fprintf(stdout, "%s", statistics_->ToString().c_str());
+      }
+    }
+  }
+
+ private:
+  typedef void (Benchmark::*ReadMethod)(int thread, ThreadStats* stats);
+
+  static leveldb::CompressionType ParseCompression(const char* name) {
+    if (std::strcmp(name, "none") == 0) return leveldb::kNoCompression;
+    if (std::strcmp(name, "snappy") == 0) return leveldb::kSnappyCompression;
+    if (std::strcmp(name, "lz4") == 0) return leveldb::kLZ4Compression;
+    if (std::strcmp(name, "zstd") == 0) return leveldb::kZstdCompression;
+    std::fprintf(stderr, "Unknown compression '%s'\n", name);
+    std::exit(1);
+  }
+
+  static void Check(const leveldb::Status& s) {
+    if (!s.ok()) {
+      std::fprintf(stderr, "%s\n", s.ToString().c_str());
+      std::exit(1);
+    }
+  }
+
+  void PrintHeader() {
+    const double raw_mb =
+        (FLAGS_key_size + FLAGS_value_size) * static_cast<double>(FLAGS_num) /
+        1048576.0;
+    std::fprintf(stdout, "Keys:        %d bytes each\n", FLAGS_key_size);
+    std::fprintf(stdout,
+                 "Values:      %d bytes each (%d bytes after compression)\n",
+                 FLAGS_value_size,
+                 static_cast<int>(FLAGS_value_size * FLAGS_compression_ratio +
+                                  0.5));
+    std::fprintf(stdout, "Entries:     %llu\n",
+                 static_cast<unsigned long long>(FLAGS_num));
+    std::fprintf(stdout, "RawSize:     %.1f MB (estimated)\n", raw_mb);
+    std::fprintf(stdout, "Threads:     %d\n", FLAGS_threads);
+    std::fprintf(stdout, "Block:       %d bytes, restart interval %d\n",
+                 FLAGS_block_size, FLAGS_block_restart_interval);
+    std::fprintf(stdout, "Compression: %s\n", FLAGS_compression);
+    std::fprintf(stdout, "Cache:       %lld bytes\n",
+                 static_cast<long long>(std::max<int64_t>(FLAGS_cache_size, 0)));
+    std::fprintf(stdout, "Bloom:       %d bits/key\n", FLAGS_bloom_bits);
+    std::fprintf(stdout, "Keys from:   %s\n", FLAGS_distribution);
+    std::fprintf(stdout, "------------------------------------------------\n");
+  }
+
+  void CloseTable() {
+    delete table_;
+    table_ = nullptr;
+    delete file_;
+    file_ = nullptr;
+  }
+
+  void OpenTable() {
+    if (table_ != nullptr) {
+      return;
+    }
+    Check(env_->GetFileSize(FLAGS_file, &file_size_));
+    Check(env_->NewRandomAccessFile(FLAGS_file, &file_));
+    Check(leveldb::Table::Open(options_, file_, file_size_, &table_));
+  }
+
+  void Fill(const std::string& name, bool random) {
+    CloseTable();
+
+    std::vector<uint64_t> keys;
+    if (random) {
+      std::mt19937_64 rnd(FLAGS_seed);
+      keys.resize(FLAGS_num);
+      for (uint64_t& k : keys) {
+        k = rnd() % FLAGS_num;
+      }
+      std::sort(keys.begin(), keys.end());
+      keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+    const uint64_t count = random ? keys.size() : FLAGS_num;
+
+    leveldb::WritableFile* file;
+    Check(env_->NewWritableFile(FLAGS_file, &file));
+    ValueGenerator values(FLAGS_seed);
+    ThreadStats stats;
+    std::string key;
+    const uint64_t start = NowNanos();
+    {
+      leveldb::TableBuilder builder(options_, file);
+      uint64_t last = start;
+      for (uint64_t i = 0; i < count; i++) {
+        MakeKey(random ? keys[i] : i, false, &key);
+        builder.Add(key, values.Generate(FLAGS_value_size));
+        if (FLAGS_histogram) {
+          const uint64_t now = NowNanos();
+          stats.latency.Add(now - last);
+          last = now;
+        }
+      }
+      Check(builder.Finish());
+      Check(builder.Sync());
+    }
+    Check(file->Close());
+    stats.nanos = NowNanos() - start;
+    delete file;
+
+    stats.ops = count;
+    stats.found = count;
+    stats.bytes = count * (key.size() + FLAGS_value_size);
+    std::vector<ThreadStats*> all(1, &stats);
+    Report(name, all);
+
+    OpenTable();
+    std::fprintf(stdout, "%-12s : file size %.1f MB\n", name.c_str(),
+                 file_size_ / 1048576.0);
+  }
+
+  void BulkLoad(const std::string& name) {
+    std::vector<uint64_t> keys(FLAGS_num);
+    for (uint64_t i = 0; i < FLAGS_num; i++) {
+      keys[i] = i;
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(FLAGS_seed));
+
+    const size_t slash = FLAGS_file.rfind('/');
+    leveldb::BulkLoadOptions load_options;
+    load_options.temp_dir =
+        slash == std::string::npos ? "." : FLAGS_file.substr(0, slash);
+    load_options.output_prefix = FLAGS_file + ".bulk.";
+    load_options.memory_budget = FLAGS_bulk_memory;
+    load_options.sort_threads = FLAGS_bulk_threads;
+    load_options.merge_threads = FLAGS_bulk_threads;
+    leveldb::Options options = options_;
+    options.max_file_size = FLAGS_bulk_file_size;
+
+    ValueGenerator values(FLAGS_seed);
+    ThreadStats stats;
+    std::string key;
+    std::vector<std::string> files;
+    uint64_t runs;
+    const uint64_t start = NowNanos();
+    {
+      leveldb::BulkLoader loader(options, load_options);
+      for (uint64_t k : keys) {
+        MakeKey(k, false, &key);
+        Check(loader.Add(key, values.Generate(FLAGS_value_size)));
+      }
+      Check(loader.Finish(&files));
+      runs = loader.NumRuns();
+    }
+    stats.nanos = NowNanos() - start;
+
+    uint64_t bytes = 0;
+    for (const std::string& fname : files) {
+      uint64_t size;
+      Check(env_->GetFileSize(fname, &size));
+      bytes += size;
+      env_->RemoveFile(fname);
+    }
+
+    stats.ops = FLAGS_num;
+    stats.found = FLAGS_num;
+    stats.bytes = FLAGS_num * (key.size() + FLAGS_value_size);
+    std::vector<ThreadStats*> all(1, &stats);
+    Report(name, all);
+    std::fprintf(stdout, "%-12s : %llu runs, %zu tables, %.1f MB\n",
+                 name.c_str(), static_cast<unsigned long long>(runs),
+                 files.size(), bytes / 1048576.0);
+  }
+
+  // Returns the aggregate ops/s of all threads.
+  double RunReaders(const std::string& name, ReadMethod method,
+                    int num_threads) {
+    OpenTable();
+
+    std::vector<ThreadStats*> stats;
+    for (int i = 0; i < num_threads; i++) {
+      stats.push_back(new ThreadStats);
+    }
+
+    // Threads wait at the gate so they all start at the same time.
+    std::mutex mu;
+    std::condition_variable cv;
+    bool go = false;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back([&, i] {
+        {
+          std::unique_lock<std::mutex> l(mu);
+          cv.wait(l, [&] { return go; });
+        }
+        const uint64_t start = NowNanos();
+        (this->*method)(i, stats[i]);
+        stats[i]->nanos = NowNanos() - start;
+      });
+    }
+    {
+      std::lock_guard<std::mutex> l(mu);
+      go = true;
+    }
+    cv.notify_all();
+    for (std::thread& t : threads) {
+      t.join();
+    }
+
+    const double ops_per_sec = Report(name, stats);
+    for (ThreadStats* s : stats) {
+      delete s;
+    }
+    return ops_per_sec;
+  }
+
+  // Every thread does --reads lookups, so perfect scaling keeps micros/op
+  // constant and multiplies ops/s by the thread count.
+  void ReadScaling() {
+    double single = 0;
+    for (int n = 1; n <= FLAGS_max_threads; n *= 2) {
+      char name[32];
+      std::snprintf(name, sizeof(name), "readscaling/%d", n);
+      const double ops_per_sec = RunReaders(name, &Benchmark::ReadRandom, n);
+      if (n == 1) {
+        single = ops_per_sec;
+      }
+      const double speedup = ops_per_sec / std::max(single, 1e-9);
+      std::fprintf(stdout, "%-12s : %.2fx of 1 thread, %.0f%% efficiency\n",
+                   name, speedup, 100.0 * speedup / n);
+    }
+    std::fflush(stdout);
+  }
+
+  uint64_t Reads() const {
+    return FLAGS_reads < 0 ? FLAGS_num : static_cast<uint64_t>(FLAGS_reads);
+  }
+
+  void Get(int thread, bool missing, ThreadStats* stats) {
+    KeyGenerator gen(distribution_, zipf_.get(), FLAGS_seed + 1000 + thread);
+    leveldb::ReadOptions options;
+    std::string key;
+    lookup_key = &key;
+    const uint64_t reads = Reads();
+    for (uint64_t i = 0; i < reads; i++) {
+      MakeKey(gen.Next(), missing, &key);
+      lookup_found = false;
+      const uint64_t start = FLAGS_histogram ? NowNanos() : 0;
+      Check(table_->InternalGet(options, key, &SaveLookupResult));
+      if (FLAGS_histogram) {
+        stats->latency.Add(NowNanos() - start);
+      }
+      if (lookup_found) {
+        stats->found++;
+        stats->bytes += key.size() + FLAGS_value_size;
+      }
+    }
+    lookup_key = nullptr;
+    stats->ops = reads;
+  }
+
+  void ReadRandom(int thread, ThreadStats* stats) { Get(thread, false, stats); }
+
+  void ReadMissing(int thread, ThreadStats* stats) { Get(thread, true, stats); }
+
+  void Scan(bool forward, ThreadStats* stats) {
+    leveldb::Iterator* iter = table_->NewIterator(leveldb::ReadOptions());
+    const uint64_t reads = std::min(Reads(), FLAGS_num);
+    uint64_t last = NowNanos();
+    uint64_t i = 0;
+    if (forward) {
+      iter->SeekToFirst();
+    } else {
+      iter->SeekToLast();
+    }
+    while (i < reads && iter->Valid()) {
+      stats->bytes += iter->key().size() + iter->value().size();
+      i++;
+      if (forward) {
+        iter->Next();
+      } else {
+        iter->Prev();
+      }
+      if (FLAGS_histogram) {
+        const uint64_t now = NowNanos();
+        stats->latency.Add(now - last);
+        last = now;
+      }
+    }
+    Check(iter->status());
+    delete iter;
+    stats->ops = i;
+    stats->found = i;
+  }
+
+  void ReadSequential(int /*thread*/, ThreadStats* stats) { Scan(true, stats); }
+
+  void ReadReverse(int /*thread*/, ThreadStats* stats) { Scan(false, stats); }
+
+  void SeekRandom(int thread, ThreadStats* stats) {
+    KeyGenerator gen(distribution_, zipf_.get(), FLAGS_seed + 2000 + thread);
+    leveldb::Iterator* iter = table_->NewIterator(leveldb::ReadOptions());
+    std::string key;
+    const uint64_t reads = Reads();
+    for (uint64_t i = 0; i < reads; i++) {
+      MakeKey(gen.Next(), false, &key);
+      const uint64_t start = FLAGS_histogram ? NowNanos() : 0;
+      iter->Seek(key);
+      if (FLAGS_histogram) {
+        stats->latency.Add(NowNanos() - start);
+      }
+      if (iter->Valid() && iter->key() == key) {
+        stats->found++;
+        stats->bytes += iter->key().size() + iter->value().size();
+      }
+    }
+    Check(iter->status());
+    delete iter;
+    stats->ops = reads;
+  }
+
+  // Throughput is total operations over the slowest thread's time, so
+  // ops/s is the aggregate rate of all threads.  Returns ops/s.
+  double Report(const std::string& name, const std::vector<ThreadStats*>& all) {
+    uint64_t ops = 0, found = 0, bytes = 0, nanos = 0;
+    leveldb::HistogramSnapshot latency;
+    for (const ThreadStats* s : all) {
+      ops += s->ops;
+      found += s->found;
+      bytes += s->bytes;
+      nanos = std::max(nanos, s->nanos);
+      s->latency.MergeInto(&latency);
+    }
+    const double seconds = std::max<uint64_t>(nanos, 1) * 1e-9;
+    const double ops_per_sec = ops / seconds;
+
+    char extra[64] = "";
+    if (found != ops) {
+      std::snprintf(extra, sizeof(extra), " (%llu of %llu found)",
+                    static_cast<unsigned long long>(found),
+                    static_cast<unsigned long long>(ops));
+    }
+    std::fprintf(stdout,
+                 "%-12s : %11.3f micros/op; %11.0f ops/s; %7.1f MB/s%s\n",
+                 name.c_str(), 1e6 / std::max(ops_per_sec, 1e-9), ops_per_sec,
+                 bytes / 1048576.0 / seconds, extra);
+
+    if (FLAGS_histogram && latency.count > 0) {
+      leveldb::HistogramData data;
+      latency.Summarize(&data);
+      std::fprintf(stdout,
+                   "Latency (micros): count %llu avg %.3f min %.3f max %.3f\n"
+                   "  P50 %.3f  P95 %.3f  P99 %.3f  P99.9 %.3f\n",
+                   static_cast<unsigned long long>(data.count),
+                   data.average / 1e3, data.min / 1e3, data.max / 1e3,
+                   data.median / 1e3, data.percentile95 / 1e3,
+                   data.percentile99 / 1e3, data.percentile999 / 1e3);
+    }
+    std::fflush(stdout);
+    return ops_per_sec;
+  }
+
+  leveldb::Env* env_;
+  leveldb::Cache* const cache_;
+  const leveldb::FilterPolicy* const filter_policy_;
+  leveldb::Statistics* const statistics_;
+  const Distribution distribution_;
+  std::unique_ptr<ZipfianDistribution> zipf_;
+  leveldb::Options options_;
+  leveldb::RandomAccessFile* file_;
+  leveldb::Table* table_;
+  uint64_t file_size_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    double d;
+    long long n;
+    char junk;
+    if (std::strncmp(argv[i], "--benchmarks=", 13) == 0) {
+      FLAGS_benchmarks = argv[i] + 13;
+    } else if (std::strncmp(argv[i], "--distribution=", 15) == 0) {
+      FLAGS_distribution = argv[i] + 15;
+    } else if (std::strncmp(argv[i], "--compression=", 14) == 0) {
+      FLAGS_compression = argv[i] + 14;
+    } else if (std::strncmp(argv[i], "--file=", 7) == 0) {
+      FLAGS_file = argv[i] + 7;
+    } else if (sscanf(argv[i], "--compression_ratio=%lf%c", &d, &junk) == 1) {
+      FLAGS_compression_ratio = d;
+    } else if (sscanf(argv[i], "--zipf_theta=%lf%c", &d, &junk) == 1) {
+      FLAGS_zipf_theta = d;
+    } else if (sscanf(argv[i], "--num=%lld%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_num = n;
+    } else if (sscanf(argv[i], "--reads=%lld%c", &n, &junk) == 1) {
+      FLAGS_reads = n;
+    } else if (sscanf(argv[i], "--threads=%lld%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_threads = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--max_threads=%lld%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_max_threads = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--key_size=%lld%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_key_size = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--value_size=%lld%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_value_size = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--block_size=%lld%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_block_size = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--block_restart_interval=%lld%c", &n,
+                      &junk) == 1 &&
+               n > 0) {
+      FLAGS_block_restart_interval = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--cache_size=%lld%c", &n, &junk) == 1) {
+      FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--bloom_bits=%lld%c", &n, &junk) == 1) {
+      FLAGS_bloom_bits = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--direct_io=%lld%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_direct_io = n;
+    } else if (sscanf(argv[i], "--histogram=%lld%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_histogram = n;
+    } else if (sscanf(argv[i], "--statistics=%lld%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_statistics = n;
+    } else if (sscanf(argv[i], "--bulk_memory=%lld%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_bulk_memory = n;
+    } else if (sscanf(argv[i], "--bulk_threads=%lld%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_bulk_threads = static_cast<int>(n);
+    } else if (sscanf(argv[i], "--bulk_file_size=%lld%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_bulk_file_size = n;
+    } else if (sscanf(argv[i], "--seed=%lld%c", &n, &junk) == 1) {
+      FLAGS_seed = n;
+    } else {
+      std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      std::exit(1);
+    }
+  }
+
+  // Keys are decimal key numbers; they must fit or keys would collide.
+  if (std::to_string(FLAGS_num - 1).size() >
+      static_cast<size_t>(FLAGS_key_size)) {
+    std::fprintf(stderr, "--key_size=%d is too small for --num=%llu\n",
+                 FLAGS_key_size, static_cast<unsigned long long>(FLAGS_num));
+    std::exit(1);
+  }
+
+  Benchmark benchmark;
+  benchmark.Run();
+  return 0;
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Compressor turns a finished block into the bytes stored on disk and
+// back.  Every compressor owns one CompressionType value, which is
+// written into the trailer of each block it compressed, so readers can
+// find the right compressor for any block regardless of the options the
+// table was written with.
+//
+// Builtin compressors are registered for kSnappyCompression,
+// kZstdCompression and kLZ4Compression.  A compressor whose library was
+// not available at build time refuses to compress (blocks are then
+// stored uncompressed) and fails to uncompress.  Applications may
+// register their own compressors under unused type values.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
+
+#include <cstddef>
+#include <string>
+
+#include "export.h"
+#include "options.h"
+#include "slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT Compressor {
+ public:
+  virtual ~Compressor();
+
+  // The type byte stored in the trailer of blocks compressed by this
+  // compressor.  Must not be kNoCompression.
+  virtual CompressionType type() const = 0;
+
+  // Return the name of this compressor.  Used for diagnostics only.
+  virtual const char* Name() const = 0;
+
+  // Store the compressed form of "input" in *output.  "options" is the
+  // Options the table is being built with and may carry tuning knobs
+  // (e.g. zstd_compression_level).
+  // Returns false if the block should be stored uncompressed instead.
+  virtual bool Compress(const Options& options, const Slice& input,
+                        std::string* output) const = 0;
+
+  // If "input" looks like a valid compressed block, store the size of
+  // the uncompressed data in *length and return true.  Else return false.
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* length) const = 0;
+
+  // Uncompress "input" into output[0,n-1] where n is the result of a
+  // successful call to GetUncompressedLength().
+  // Returns false if "input" is not valid compressed data.
+  virtual bool Uncompress(const Slice& input, char* output) const = 0;
+};
+
+// Make "compressor" responsible for blocks of type compressor->type(),
+// replacing any compressor previously registered for that type.  The
+// caller keeps ownership and must keep "compressor" alive as long as
+// tables are read or written.
+//
+// Registration is meant to happen at startup, before tables are opened
+// or built with the type.
+LEVELDB_EXPORT void RegisterCompressor(const Compressor* compressor);
+
+// Return the compressor registered for "type", or nullptr if there is
+// none (including for kNoCompression).
+LEVELDB_EXPORT const Compressor* GetCompressor(CompressionType type);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
@@ -19,6 +19,7 @@
 #include <vector>
 
 #include "export.h"
+#include "statistics.h"
 #include "status.h"
 
 // This workaround can be removed when leveldb::Env::DeleteFile is removed.
@@ -48,6 +49,23 @@ class SequentialFile;
 class Slice;
 class WritableFile;
 
+// Activity of one background thread pool of an Env (see
+// Env::GetThreadPoolStats()).
+struct LEVELDB_EXPORT ThreadPoolStats {
+  // Number of threads the pool is configured to run.
+  int threads = 0;
+  // Work items scheduled but not started yet.
+  uint64_t queue_length = 0;
+  // Work items currently running.
+  uint64_t running = 0;
+  // Work items scheduled and finished since the pool was created.
+  uint64_t scheduled = 0;
+  uint64_t completed = 0;
+  // Nanoseconds each work item waited between Schedule() and the start
+  // of its execution.
+  HistogramData queue_wait_nanos;
+};
+
 class LEVELDB_EXPORT Env {
  public:
   Env();
@@ -189,14 +207,44 @@ class LEVELDB_EXPORT Env {
   // REQUIRES: lock has not already been unlocked.
   virtual Status UnlockFile(FileLock* lock) = 0;
 
+  // Background work runs in one thread pool per priority, so a backlog of
+  // low priority work never delays high priority work.
+  enum Priority { kLow = 0, kHigh = 1 };
+
   // Arrange to run "(*function)(arg)" once in a background thread.
   //
   // "function" may run in an unspecified thread.  Multiple functions
   // added to the same Env may run concurrently in different threads.
   // I.e., the caller may not assume that background work items are
   // serialized.
+  //
+  // The work runs at kLow priority.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Like Schedule(function, arg), but runs "function" in the thread pool
+  // of priority "pri".  The default implementation ignores "pri".
+  virtual void Schedule(void (*function)(void* arg), void* arg, Priority pri);
+
+  // Set the number of threads of the "pri" thread pool.  Threads are
+  // started on demand; surplus threads exit when they run out of work.
+  // The default implementation does nothing.
+  virtual void SetBackgroundThreads(int number, Priority pri);
+
+  // Return the number of threads of the "pri" thread pool, or 0 if this
+  // Env does not have thread pools.
+  virtual int GetBackgroundThreads(Priority pri);
+
+  // Pin the threads of the "pri" thread pool to CPUs: thread i runs on
+  // cpus[i % cpus.size()].  An empty "cpus" lets them run on any CPU the
+  // process may use.  Threads apply a change before their next work item.
+  // The default implementation returns NotSupported.
+  virtual Status SetBackgroundThreadCPUs(const std::vector<int>& cpus,
+                                         Priority pri);
+
+  // Store the activity of the "pri" thread pool in *stats and return
+  // true, or return false if this Env does not have thread pools.
+  virtual bool GetThreadPoolStats(Priority pri, ThreadPoolStats* stats);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -248,6 +296,21 @@ class LEVELDB_EXPORT SequentialFile {
   virtual Status Skip(uint64_t n) = 0;
 };
 
+// A single read issued through RandomAccessFile::Submit() or MultiRead().
+struct LEVELDB_EXPORT ReadRequest {
+  // Filled in by the caller.  "scratch" must have room for "n" bytes and,
+  // together with this request, must stay live until the read completes.
+  uint64_t offset = 0;
+  size_t n = 0;
+  char* scratch = nullptr;
+
+  // Filled in by the file once "done" is true; same meaning as the
+  // "result" and return value of RandomAccessFile::Read().
+  Slice result;
+  Status status;
+  bool done = false;
+};
+
 // A file abstraction for randomly reading the contents of a file.
 class LEVELDB_EXPORT RandomAccessFile {
  public:
@@ -269,6 +332,37 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // Returns true if Read() never uses "scratch" and instead sets "*result"
+  // to point at memory owned by this file (e.g. a read-only memory map)
+  // that stays valid until the file is deleted.  Callers may then pass a
+  // null "scratch" to Read() and use the result without copying it.
+  virtual bool IsMemoryMapped() const { return false; }
+
+  // Returns the alignment (a power of two) that "offset", "n" and
+  // "scratch" must all have for Read() to read straight into "scratch",
+  // e.g. the logical block size for files opened for direct I/O.  Other
+  // reads still succeed but may go through an internal bounce buffer and
+  // an extra copy.  Callers that read often should widen their reads to
+  // this alignment and allocate their buffers accordingly.
+  virtual size_t GetRequiredBufferAlignment() const { return 1; }
+
+  // Asynchronous reads.  Submit() starts reading req->n bytes at
+  // req->offset into req->scratch and may return before the data has
+  // arrived.  Wait() blocks until every request in reqs[0,n-1] is done.
+  // A request must be waited for by the thread that submitted it.
+  //
+  // Implementations backed by an asynchronous I/O interface keep many
+  // reads in flight at once.  The default implementation performs the
+  // read synchronously inside Submit().
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void Submit(ReadRequest* req) const;
+  virtual void Wait(ReadRequest* const* reqs, size_t n) const;
+
+  // Submits reqs[0,n-1] and waits for all of them to complete.  Per-read
+  // errors are reported in reqs[i].status.
+  virtual void MultiRead(ReadRequest* reqs, size_t n) const;
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -329,6 +423,33 @@ LEVELDB_EXPORT Status WriteStringToFile(Env* env, const Slice& data,
 LEVELDB_EXPORT Status ReadFileToString(Env* env, const std::string& fname,
                                        std::string* data);
 
+// Returns a new Env that forwards all calls to "base_env", except that the
+// files returned by NewRandomAccessFile() submit reads through a
+// per-thread io_uring instance, so that MultiRead()/Submit() keep many
+// reads in flight per thread.  Read() still uses pread().  When io_uring
+// is not available the files fall back to synchronous pread() for every
+// request.
+//
+// The caller must delete the result when it is no longer needed.
+// *base_env must remain live while the result is in use.
+LEVELDB_EXPORT Env* NewIOUringEnv(Env* base_env);
+
+// Returns a new Env that forwards all calls to "base_env", except that the
+// files returned by NewRandomAccessFile() and NewWritableFile() bypass the
+// operating system's page cache (O_DIRECT), so that blocks are cached only
+// in the block cache and the memory used by a process stays bounded.
+// Unaligned reads go through an aligned bounce buffer; writes are buffered
+// and issued in aligned chunks, and the file is trimmed to its real length
+// on Sync() and Close().  Files are never memory-mapped.  On filesystems
+// that reject O_DIRECT the files fall back to normal cached I/O.
+//
+// Combine with Options::block_alignment so that each block read touches as
+// few device pages as possible.
+//
+// The caller must delete the result when it is no longer needed.
+// *base_env must remain live while the result is in use.
+LEVELDB_EXPORT Env* NewDirectIOEnv(Env* base_env);
+
 // An implementation of Env that forwards all calls to another Env.
 // May be useful to clients who wish to override just part of the
 // functionality of another Env.
@@ -384,6 +505,22 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void Schedule(void (*f)(void*), void* a, Priority pri) override {
+    return target_->Schedule(f, a, pri);
+  }
+  void SetBackgroundThreads(int number, Priority pri) override {
+    target_->SetBackgroundThreads(number, pri);
+  }
+  int GetBackgroundThreads(Priority pri) override {
+    return target_->GetBackgroundThreads(pri);
+  }
+  Status SetBackgroundThreadCPUs(const std::vector<int>& cpus,
+                                 Priority pri) override {
+    return target_->SetBackgroundThreadCPUs(cpus, pri);
+  }
+  bool GetThreadPoolStats(Priority pri, ThreadPoolStats* stats) override {
+    return target_->GetThreadPoolStats(pri, stats);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
@@ -0,0 +1,93 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An IOStatsEnv forwards everything to a base Env and counts the I/O done
+// through the files it opens: operations, bytes, latencies and read sizes,
+// per file and in total.  It answers questions such as "how many bytes did
+// this workload read from disk per byte returned to the user" (read
+// amplification) for a given block size or cache configuration.
+//
+// Memory-mapped files (see RandomAccessFile::IsMemoryMapped()) do not go
+// to disk on Read(), so for them the counts are bytes accessed rather than
+// bytes read from the device.  To measure device reads, wrap an Env that
+// does not memory-map, e.g. NewIOStatsEnv(NewDirectIOEnv(Env::Default())).
+
+#ifndef STORAGE_LEVELDB_INCLUDE_IO_STATS_ENV_H_
+#define STORAGE_LEVELDB_INCLUDE_IO_STATS_ENV_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "env.h"
+#include "export.h"
+#include "statistics.h"
+
+namespace leveldb {
+
+struct LEVELDB_EXPORT IOStats {
+  // Reads through SequentialFile::Read(), RandomAccessFile::Read() and
+  // each request of RandomAccessFile::MultiRead() or Submit(), and the
+  // bytes they returned.
+  uint64_t read_count = 0;
+  uint64_t read_bytes = 0;
+  // WritableFile::Append() calls and the bytes they appended.
+  uint64_t write_count = 0;
+  uint64_t write_bytes = 0;
+  // WritableFile::Sync() calls.
+  uint64_t sync_count = 0;
+
+  // Read latency in nanoseconds.  All requests of a MultiRead() are
+  // recorded with the duration of the whole batch; requests issued with
+  // Submit() and Wait() are counted but not timed.
+  HistogramData read_nanos;
+  // Bytes requested per read.
+  HistogramData read_size;
+  // Duration of each WritableFile::Append() and Flush() call.
+  HistogramData write_nanos;
+  // Duration of each WritableFile::Sync() call.
+  HistogramData sync_nanos;
+
+  // Return a human-readable summary on a few lines.
+  std::string ToString() const;
+};
+
+class LEVELDB_EXPORT IOStatsEnv : public EnvWrapper {
+ public:
+  explicit IOStatsEnv(Env* base_env) : EnvWrapper(base_env) {}
+
+  ~IOStatsEnv() override;
+
+  // Store in *stats the I/O of all files opened through this Env since it
+  // was created or last reset, including files that were closed since.
+  virtual void GetStats(IOStats* stats) const = 0;
+
+  // Store in *stats the I/O of the file with the given name, summed over
+  // every time it was opened.  Returns false if no file with that name
+  // has been opened through this Env.
+  virtual bool GetFileStats(const std::string& fname,
+                            IOStats* stats) const = 0;
+
+  // Store in *names the names of all files opened through this Env.
+  virtual void GetFileNames(std::vector<std::string>* names) const = 0;
+
+  // Set all counters back to zero.  The list of file names is kept.
+  virtual void ResetStats() = 0;
+
+  // Return the totals followed by the stats of every file.
+  std::string ToString() const;
+};
+
+// Return a new IOStatsEnv that wraps "base_env".  The files it returns can
+// be used from many threads exactly like the files of "base_env"; counting
+// takes no locks.
+//
+// The caller must delete the result when it is no longer needed, after
+// every file opened through it.  *base_env must remain live while the
+// result is in use.
+LEVELDB_EXPORT IOStatsEnv* NewIOStatsEnv(Env* base_env);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_IO_STATS_ENV_H_
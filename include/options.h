@@ -17,16 +17,36 @@ class Env;
 class FilterPolicy;
 class Logger;
 class Snapshot;
+class Statistics;
 
 // DB contents are stored in a set of blocks, each of which holds a
 // sequence of key,value pairs.  Each block may be compressed before
 // being stored in a file.  The following enum describes which
 // compression method (if any) is used to compress a block.
-enum CompressionType {
+//
+// The type byte of every block trailer is a CompressionType, and any
+// value of that byte may be given to a compressor registered with
+// RegisterCompressor() (see compressor.h), hence the fixed underlying type.
+enum CompressionType : unsigned char {
   // NOTE: do not change the values of existing entries, as these are
   // part of the persistent format on disk.
   kNoCompression = 0x0,
-  kSnappyCompression = 0x1
+  kSnappyCompression = 0x1,
+  kZstdCompression = 0x2,
+  kLZ4Compression = 0x3
+};
+
+// Each block is followed by a 32-bit checksum of its contents and type
+// byte.  The following enum describes how that checksum is computed.
+// The checksum type is recorded in the table footer, so tables written
+// with different checksum types can be read side by side.
+enum ChecksumType {
+  // NOTE: do not change the values of existing entries, as these are
+  // part of the persistent format on disk.
+  kCRC32c = 0x1,
+  // Lower 32 bits of XXH3-64.  Several times faster than crc32c on CPUs
+  // without crc32c instructions.
+  kXXH3 = 0x4
 };
 
 // Options to control the behavior of a database (passed to DB::Open)
@@ -68,6 +88,13 @@ struct LEVELDB_EXPORT Options {
   // in the same directory as the DB contents if info_log is null.
   Logger* info_log = nullptr;
 
+  // If non-null, tables read and built with these options record counters
+  // and latency histograms into this object (see statistics.h).  It may be
+  // shared by any number of tables and must outlive them.
+  //
+  // Default: nullptr
+  Statistics* statistics = nullptr;
+
   // -------------------
   // Parameters that affect performance
 
@@ -89,10 +116,28 @@ struct LEVELDB_EXPORT Options {
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
-  // If non-null, use the specified cache for blocks.
-  // If null, leveldb will automatically create and use an 8MB internal cache.
+  // If non-null, use the specified cache for blocks.  The cache may be
+  // shared by many tables; each Table allocates its own id from it.
+  // If null, blocks are read from the file on every access.
+  //
+  // Use NewLRUCache(capacity) to create a sharded LRU cache.
   Cache* block_cache = nullptr;
 
+  // If non-null, a second cache tier that holds blocks in compressed form.
+  // A compressed block in block_cache keeps the bytes read from the file
+  // (charged to block_cache) and hands them to this cache when evicted; a
+  // block_cache miss that hits here is uncompressed and, if
+  // ReadOptions::fill_cache is set, promoted back into block_cache, which
+  // is much cheaper than reading the file.  Holding compressed bytes lets
+  // the same memory cover a larger working set.  Uncompressed blocks are
+  // never demoted.
+  //
+  // REQUIRES: block_cache is non-null and different from this cache
+  // (Table::Open returns InvalidArgument if they are the same).
+  // This cache must only be paired with one block_cache and must outlive
+  // it, since deleting block_cache demotes its remaining blocks.
+  Cache* compressed_block_cache = nullptr;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -104,6 +149,38 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // If non-zero, TableBuilder inserts zero padding before a data block
+  // whenever the block (with its trailer) would otherwise straddle more
+  // multiples of this many bytes than its size requires, so that reading
+  // it touches the minimum number of device pages.  Pair it with
+  // NewDirectIOEnv() and the device page size (typically 4096).  Padding
+  // costs at most block_alignment - 1 bytes per block and is cheapest when
+  // block_size is a little below a multiple of the alignment.
+  //
+  // At most 4096: readers treat blocks separated by less than that as
+  // adjacent when coalescing reads, so larger padding would defeat
+  // readahead and MultiGet batching.  TableBuilder reports
+  // InvalidArgument for larger values.
+  //
+  // Default: 0 (blocks are packed back to back)
+  size_t block_alignment = 0;
+
+  // If true, every data block carries a small hash table from key to
+  // restart group.  Point lookups (Table::InternalGet and MultiGet) use
+  // it to jump straight to the group holding the key, or to learn that
+  // the key is absent, instead of binary searching the restart points.
+  // Range seeks are unaffected.  Requires a comparator under which equal
+  // keys are byte-wise identical.  Costs about one byte per key.  Blocks
+  // with more than 253 restart points are written without the table.
+  bool block_hash_index = false;
+
+  // If non-zero, the index of a table is cut into partitions of roughly
+  // this many bytes plus a small top-level index over the partitions.
+  // Readers keep only the top level in memory and load partitions on
+  // demand through the block cache, which keeps open latency and memory
+  // low for very large tables.  If zero, the whole index is one block.
+  size_t index_partition_size = 0;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -128,8 +205,64 @@ struct LEVELDB_EXPORT Options {
   // worth switching to kNoCompression.  Even if the input data is
   // incompressible, the kSnappyCompression implementation will
   // efficiently detect that and will switch to uncompressed mode.
+  //
+  // kLZ4Compression decompresses considerably faster than snappy and suits
+  // tables whose Get latency is dominated by decompression.
+  // kZstdCompression compresses much better at a higher CPU cost and suits
+  // cold tables where storage and I/O bandwidth matter more.  Each block
+  // records its own compression type, so tables can be read whatever
+  // compression they were written with (see compressor.h).
   CompressionType compression = kSnappyCompression;
 
+  // If true, TableBuilder keeps a moving average of how well recent
+  // data blocks compressed.  While it indicates the data is
+  // incompressible (savings below the 12.5% needed to keep a compressed
+  // block), compression is skipped and only every 16th data block is
+  // compressed as a sample; a sample that compresses well turns
+  // compression back on.  Index and meta blocks are always compressed
+  // with "compression".  Saves the CPU spent compressing
+  // already-compressed values.  See TableBuilder::compression_stats()
+  // for the decision counts.
+  //
+  // Default: false
+  bool adaptive_compression = false;
+
+  // If greater than 1, TableBuilder compresses and checksums data blocks
+  // on this many background threads while the caller keeps adding keys.
+  // Blocks are still written to the file in order by the caller's thread,
+  // so the resulting table is identical to a single-threaded build (with
+  // adaptive_compression, bypass decisions may lag by a few blocks).
+  //
+  // Default: 0 (compress inline)
+  int parallel_compression_threads = 0;
+
+  // With parallel_compression_threads, the maximum number of finished
+  // data blocks waiting to be compressed or written.  TableBuilder::Add
+  // blocks when the limit is reached, which bounds memory use to about
+  // this many raw plus compressed blocks.
+  //
+  // Default: 16
+  int parallel_compression_max_inflight = 16;
+
+  // Compression level for kZstdCompression.  Higher levels compress
+  // better but slower; negative levels trade ratio for speed.
+  //
+  // Default: 1
+  int zstd_compression_level = 1;
+
+  // Checksum stored in every block trailer of newly written tables.
+  // Readers take the checksum type from the table footer, so this only
+  // affects TableBuilder.  kCRC32c tables get a 48-byte footer (metaindex
+  // and index handles) ending in kTableMagicNumberV1; kXXH3 tables get a
+  // 49-byte footer that also records the checksum type, ending in
+  // kTableMagicNumberV2.  Older versions reject both with "bad magic
+  // number".  Only the original 28-byte footer (index handle only, ending
+  // in kTableMagicNumber) is readable by both old and new readers; this
+  // version reads it but never writes it.
+  //
+  // Default: kCRC32c
+  ChecksumType checksum = kCRC32c;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
@@ -159,6 +292,19 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // Upper bound on how far an iterator reads ahead during a forward scan.
+  // After a few consecutive forward block reads the iterator fetches the
+  // upcoming blocks with one larger read, doubling the window on every
+  // refill until it reaches this size.  Zero disables readahead.  Has no
+  // effect on memory-mapped files.
+  size_t max_readahead_size = 256 * 1024;
+
+  // If true, a forward scan uses Env::Schedule() to read the blocks that
+  // follow the current one while the caller is still consuming it, so the
+  // next block is usually in memory by the time it is needed.  The reads
+  // run in the Env::kHigh thread pool.
+  bool background_prefetch = false;
 };
 
 // Options that control write operations
@@ -0,0 +1,100 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PerfContext breaks the cost of the operations performed by one thread
+// down into the stages of a table lookup: seeking the index, reading,
+// verifying and uncompressing blocks, and seeking inside blocks.
+//
+// Collection is controlled per thread by SetPerfLevel() and is off by
+// default.  Typical usage:
+//
+//   leveldb::SetPerfLevel(leveldb::kEnableTime);
+//   leveldb::GetPerfContext()->Reset();
+//   table->InternalGet(...);
+//   fprintf(stderr, "%s\n", leveldb::GetPerfContext()->ToString().c_str());
+//   leveldb::SetPerfLevel(leveldb::kDisable);
+//
+// Stages nest: e.g. block_read_nanos and block_seek_nanos of a Get are also
+// part of its get_nanos, and loading an index partition is part of
+// index_seek_nanos.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <cstdint>
+#include <string>
+
+#include "export.h"
+
+namespace leveldb {
+
+// How much of the PerfContext is maintained.
+enum PerfLevel : unsigned char {
+  // Nothing is collected.  Instrumented code only tests the level.
+  kDisable = 0,
+  // Counters are collected, timers stay at zero.
+  kEnableCount = 1,
+  // Counters and timers are collected.  Every timed stage reads the clock
+  // twice, which is noticeable for operations served from memory.
+  kEnableTime = 2
+};
+
+// Set or get the perf level of the calling thread.
+LEVELDB_EXPORT void SetPerfLevel(PerfLevel level);
+LEVELDB_EXPORT PerfLevel GetPerfLevel();
+
+// Counters and timers (in nanoseconds) accumulated by the calling thread
+// since the last Reset().
+struct LEVELDB_EXPORT PerfContext {
+  // Set every field to zero.
+  void Reset();
+
+  // Return "name = value" pairs for all fields, separated by ", ".
+  // If exclude_zero_counters is true, fields that are zero are omitted.
+  std::string ToString(bool exclude_zero_counters = false) const;
+
+  // Table::InternalGet calls and the time spent in them.
+  uint64_t get_count = 0;
+  uint64_t get_nanos = 0;
+
+  // Time spent creating the index iterator and seeking it to the key.
+  uint64_t index_seek_nanos = 0;
+
+  // Filter lookups, and those that proved the key absent so that the
+  // data block was not read.
+  uint64_t filter_check_count = 0;
+  uint64_t filter_useful_count = 0;
+
+  // Blocks found in, and missing from, the block cache.
+  uint64_t block_cache_hit_count = 0;
+  uint64_t block_cache_miss_count = 0;
+
+  // File reads issued for blocks (a readahead or coalesced read of several
+  // blocks counts once), the bytes they returned and their duration.
+  uint64_t block_read_count = 0;
+  uint64_t block_read_bytes = 0;
+  uint64_t block_read_nanos = 0;
+
+  // Time spent verifying block checksums.
+  uint64_t block_checksum_nanos = 0;
+
+  // Blocks uncompressed, the uncompressed bytes produced and the time spent.
+  uint64_t block_decompress_count = 0;
+  uint64_t block_decompressed_bytes = 0;
+  uint64_t block_decompress_nanos = 0;
+
+  // Time spent in Seek() on data and index block iterators.
+  uint64_t block_seek_nanos = 0;
+
+  // Comparator calls made while seeking inside blocks.
+  uint64_t key_comparison_count = 0;
+};
+
+// Return the PerfContext of the calling thread.  The result stays valid for
+// the lifetime of the thread and must only be used by that thread.
+LEVELDB_EXPORT PerfContext* GetPerfContext();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
@@ -0,0 +1,137 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Statistics object collects process-wide counters ("tickers") and
+// value distributions ("histograms") from every Table and TableBuilder
+// whose Options point at it.  Unlike the per-thread PerfContext (see
+// perf_context.h), it aggregates across threads and is meant to be
+// scraped periodically, e.g. with ToPrometheus().
+//
+// Typical usage:
+//
+//   leveldb::Statistics* stats = leveldb::NewStatistics();
+//   options.statistics = stats;
+//   ... open tables, build tables ...
+//   std::string dump = stats->ToString();
+//   delete stats;  // after every user of options is gone
+
+#ifndef STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+#define STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+
+#include <cstdint>
+#include <string>
+
+#include "export.h"
+
+namespace leveldb {
+
+// Counters.  Values only ever grow (until Reset()).
+enum Ticker : uint32_t {
+  // Block cache lookups that found the block (in either cache tier) and
+  // lookups that missed.
+  kBlockCacheHit = 0,
+  kBlockCacheMiss,
+  // The subset of kBlockCacheHit served by Options::compressed_block_cache.
+  kCompressedBlockCacheHit,
+  // Blocks loaded from the file, and their size including the trailer.
+  kBlockRead,
+  kBlockReadBytes,
+  // Point lookups whose data block read was skipped because the filter
+  // proved the key absent.
+  kFilterUseful,
+  // Bytes appended to table files by TableBuilder.
+  kTableBytesWritten,
+  // Data blocks stored compressed, data blocks whose compression did not
+  // save enough and were stored raw, and data blocks not compressed at
+  // all because of Options::adaptive_compression.  Index and meta blocks
+  // are not counted.
+  kBlockCompressed,
+  kBlockCompressionRejected,
+  kBlockCompressionBypassed,
+  // Raw size of the data blocks compression was attempted on, and the size
+  // they were stored with.  Their quotient is the effective compression
+  // ratio.
+  kCompressionInputBytes,
+  kCompressionOutputBytes,
+  kTickerMax
+};
+
+// Distributions of durations in nanoseconds.
+enum Histogram : uint32_t {
+  // Table::InternalGet.
+  kGetNanos = 0,
+  // Loading a block from the file (read, checksum and uncompress) on a
+  // block cache miss, in Get or while iterating.  MultiGet reads its
+  // blocks in batches and only counts them in kBlockRead.
+  kBlockReadNanos,
+  // TableBuilder::Add (including writing a data block when it fills up),
+  // TableBuilder::Finish and TableBuilder::Sync.
+  kTableAddNanos,
+  kTableFinishNanos,
+  kTableSyncNanos,
+  kHistogramMax
+};
+
+// Return the name of a ticker or histogram, e.g. "leveldb.block.cache.hit".
+LEVELDB_EXPORT const char* TickerName(Ticker ticker);
+LEVELDB_EXPORT const char* HistogramName(Histogram histogram);
+
+// Summary of a histogram.  Percentiles are interpolated within buckets
+// whose width is a small fraction of their value.
+struct LEVELDB_EXPORT HistogramData {
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t min = 0;
+  uint64_t max = 0;
+  double average = 0;
+  double median = 0;
+  double percentile95 = 0;
+  double percentile99 = 0;
+  double percentile999 = 0;
+};
+
+class LEVELDB_EXPORT Statistics {
+ public:
+  Statistics() = default;
+
+  Statistics(const Statistics&) = delete;
+  Statistics& operator=(const Statistics&) = delete;
+
+  virtual ~Statistics();
+
+  // Add "count" to "ticker".
+  virtual void RecordTick(Ticker ticker, uint64_t count) = 0;
+
+  // Add one sample with the given value to "histogram".
+  virtual void RecordInHistogram(Histogram histogram, uint64_t value) = 0;
+
+  virtual uint64_t GetTickerCount(Ticker ticker) const = 0;
+  virtual void GetHistogramData(Histogram histogram,
+                                HistogramData* data) const = 0;
+
+  // Set every ticker and histogram back to zero.  Samples recorded
+  // concurrently with Reset() may or may not survive it.
+  virtual void Reset() = 0;
+
+  // Return one line per ticker ("<name> COUNT : <n>") followed by one line
+  // per histogram with its percentiles, maximum, count and sum.
+  std::string ToString() const;
+
+  // Return all tickers as Prometheus counters and all histograms as
+  // summaries (with quantiles 0.5, 0.95, 0.99 and 0.999) plus a "_max"
+  // gauge, in the Prometheus text exposition format.  Dots in names are
+  // replaced by underscores.
+  std::string ToPrometheus() const;
+};
+
+// Return a new Statistics object.  Every thread records into counters
+// owned by the CPU it runs on, so recording is lock-free and rarely
+// contends; readers add up all CPUs.  Memory use is about 9KB per CPU.
+//
+// Safe for concurrent use by multiple threads.
+LEVELDB_EXPORT Statistics* NewStatistics();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
@@ -0,0 +1,192 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The crc32 instruction has a latency of three cycles but a throughput of
+// one per cycle, so a single dependency chain leaves two thirds of the
+// unit idle.  Large buffers are therefore split into three equally sized
+// streams whose CRCs are computed in parallel and then stitched together:
+//
+//   crc(A || B || C) = shift(shift(crc(A), |B|) ^ crc(B), |C|) ^ crc(C)
+//
+// where shift(c, n) is the CRC state after feeding n zero bytes into c,
+// i.e. c * x^(8n) mod P.  That multiplication is one PCLMULQDQ carry-less
+// multiply by a precomputed constant followed by a crc32 reduction.
+//
+// The kernels are compiled with a target attribute, so the rest of the
+// library does not need -msse4.2 and still runs on CPUs without it.
+
+#include "crc32c_sse42.h"
+
+#include "port_config.h"
+
+#if HAVE_SSE42 && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LEVELDB_CRC32C_SSE42 1
+#else
+#define LEVELDB_CRC32C_SSE42 0
+#endif
+
+#if LEVELDB_CRC32C_SSE42
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+
+#include <cstring>
+#endif  // LEVELDB_CRC32C_SSE42
+
+namespace leveldb {
+namespace port {
+
+#if LEVELDB_CRC32C_SSE42
+
+namespace {
+
+// CRC32C (Castagnoli) polynomial in the bit-reflected order used by the
+// crc32 instruction.
+constexpr uint32_t kCRC32CPolynomial = 0x82f63b78;
+
+// CRCs are pre- and post- conditioned by xoring with all ones.
+constexpr uint32_t kCRC32Xor = 0xffffffff;
+
+// Bytes per stream in the three-way interleaved loops.  Buffers are first
+// consumed in 3 * kLongBlockSize chunks, then in 3 * kShortBlockSize chunks.
+constexpr size_t kLongBlockSize = 8192;
+constexpr size_t kShortBlockSize = 256;
+
+// Returns a * b mod P.  Polynomials are bit-reflected: bit 31 holds the
+// coefficient of x^0.
+uint32_t MultiplyModP(uint32_t a, uint32_t b) {
+  uint32_t product = 0;
+  for (uint32_t m = 1u << 31; m != 0; m >>= 1) {
+    if (a & m) {
+      product ^= b;
+    }
+    b = (b & 1) ? (b >> 1) ^ kCRC32CPolynomial : b >> 1;
+  }
+  return product;
+}
+
+// Returns x^n mod P, bit-reflected.
+uint32_t XPowModP(uint64_t n) {
+  uint32_t result = 1u << 31;  // x^0
+  uint32_t power = 1u << 30;   // x^1
+  while (n != 0) {
+    if (n & 1) {
+      result = MultiplyModP(result, power);
+    }
+    power = MultiplyModP(power, power);
+    n >>= 1;
+  }
+  return result;
+}
+
+// Constants for Shift().  The carry-less product of two reflected 32-bit
+// values comes out one bit short, and the crc32 reduction of a 64-bit word
+// multiplies by another x^32, hence the -33.
+struct ShiftConstants {
+  ShiftConstants()
+      : long_block(XPowModP(8 * kLongBlockSize - 33)),
+        short_block(XPowModP(8 * kShortBlockSize - 33)) {}
+
+  const uint64_t long_block;
+  const uint64_t short_block;
+};
+
+const ShiftConstants& GetShiftConstants() {
+  static const ShiftConstants constants;
+  return constants;
+}
+
+inline uint64_t LoadUint64(const uint8_t* p) {
+  uint64_t word;
+  std::memcpy(&word, p, sizeof(word));  // x86-64 is little-endian.
+  return word;
+}
+
+// Returns crc * x^(8n) mod P, where constant is the ShiftConstants entry
+// for n.
+__attribute__((target("sse4.2,pclmul"))) inline uint32_t Shift(
+    uint32_t crc, uint64_t constant) {
+  const __m128i product = _mm_clmulepi64_si128(
+      _mm_cvtsi32_si128(static_cast<int>(crc)),
+      _mm_cvtsi64_si128(static_cast<long long>(constant)), 0x00);
+  return static_cast<uint32_t>(
+      _mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(product))));
+}
+
+// Runs the three-way interleaved loop over as many 3 * block_size chunks as
+// fit in [*p, end).
+__attribute__((target("sse4.2,pclmul"))) inline uint32_t ExtendInterleaved(
+    uint32_t crc, const uint8_t** p, const uint8_t* end, size_t block_size,
+    uint64_t shift_constant) {
+  const uint8_t* q = *p;
+  while (static_cast<size_t>(end - q) >= 3 * block_size) {
+    uint64_t crc0 = crc;
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    for (const uint8_t* stop = q + block_size; q != stop; q += 8) {
+      crc0 = _mm_crc32_u64(crc0, LoadUint64(q));
+      crc1 = _mm_crc32_u64(crc1, LoadUint64(q + block_size));
+      crc2 = _mm_crc32_u64(crc2, LoadUint64(q + 2 * block_size));
+    }
+    q += 2 * block_size;
+
+    crc = Shift(static_cast<uint32_t>(crc0), shift_constant) ^
+          static_cast<uint32_t>(crc1);
+    crc = Shift(crc, shift_constant) ^ static_cast<uint32_t>(crc2);
+  }
+  *p = q;
+  return crc;
+}
+
+}  // namespace
+
+bool CanAccelerateCRC32CWithSSE42() {
+  return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+}
+
+__attribute__((target("sse4.2,pclmul"))) uint32_t SSE42CRC32C(
+    uint32_t crc, const char* buf, size_t size) {
+  const ShiftConstants& constants = GetShiftConstants();
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+  const uint8_t* e = p + size;
+  uint32_t l = crc ^ kCRC32Xor;
+
+  // Process bytes until p is 8-byte aligned.
+  while (p != e && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+    l = _mm_crc32_u8(l, *p++);
+  }
+
+  l = ExtendInterleaved(l, &p, e, kLongBlockSize, constants.long_block);
+  l = ExtendInterleaved(l, &p, e, kShortBlockSize, constants.short_block);
+
+  // Advance one word at a time as far as possible.
+  uint64_t l64 = l;
+  while (e - p >= 8) {
+    l64 = _mm_crc32_u64(l64, LoadUint64(p));
+    p += 8;
+  }
+  l = static_cast<uint32_t>(l64);
+
+  // Process the last few bytes.
+  while (p != e) {
+    l = _mm_crc32_u8(l, *p++);
+  }
+  return l ^ kCRC32Xor;
+}
+
+#else  // !LEVELDB_CRC32C_SSE42
+
+bool CanAccelerateCRC32CWithSSE42() { return false; }
+
+uint32_t SSE42CRC32C(uint32_t crc, const char* buf, size_t size) {
+  // Silence compiler warnings about unused arguments.
+  (void)crc;
+  (void)buf;
+  (void)size;
+  return 0;
+}
+
+#endif  // LEVELDB_CRC32C_SSE42
+
+}  // namespace port
+}  // namespace leveldb
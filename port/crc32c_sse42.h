@@ -0,0 +1,31 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// In-tree CRC32C kernels built on the SSE4.2 crc32 and PCLMULQDQ
+// instructions.  port::AcceleratedCRC32C() uses them when the library is
+// built without Google CRC32C.
+
+#ifndef STORAGE_LEVELDB_PORT_CRC32C_SSE42_H_
+#define STORAGE_LEVELDB_PORT_CRC32C_SSE42_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace leveldb {
+namespace port {
+
+// Returns true if the CPU running this program supports both SSE4.2 and
+// PCLMULQDQ.  Always false on non-x86-64 builds.
+bool CanAccelerateCRC32CWithSSE42();
+
+// Returns the crc32c of concat(A, buf[0,size-1]) where crc is the crc32c
+// of some string A, with the same contract as crc32c::Extend().
+//
+// REQUIRES: CanAccelerateCRC32CWithSSE42() returned true.
+uint32_t SSE42CRC32C(uint32_t crc, const char* buf, size_t size);
+
+}  // namespace port
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_PORT_CRC32C_SSE42_H_
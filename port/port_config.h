@@ -25,9 +25,58 @@
 #define HAVE_CRC32C 0
 #endif  // !defined(HAVE_CRC32C)
 
+// Define to 1 if the compiler can build the in-tree SSE4.2/PCLMULQDQ CRC32C
+// kernels.  They are only used if the CPU supports the instructions.
+// The defaults below are guesses from the target platform; the CMake build
+// probes for these features and overrides them.
+#if !defined(HAVE_SSE42)
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_SSE42 1
+#else
+#define HAVE_SSE42 0
+#endif
+#endif  // !defined(HAVE_SSE42)
+
+// Define to 1 if you have <linux/io_uring.h>.
+#if !defined(HAVE_IO_URING)
+#if defined(__linux__)
+#define HAVE_IO_URING 1
+#else
+#define HAVE_IO_URING 0
+#endif
+#endif  // !defined(HAVE_IO_URING)
+
+// Define to 1 if you have a definition for sched_getcpu() in <sched.h>.
+#if !defined(HAVE_SCHED_GETCPU)
+#if defined(__linux__)
+#define HAVE_SCHED_GETCPU 1
+#else
+#define HAVE_SCHED_GETCPU 0
+#endif
+#endif  // !defined(HAVE_SCHED_GETCPU)
+
+// Define to 1 if you have pthread_setaffinity_np() in <pthread.h>.
+#if !defined(HAVE_PTHREAD_SETAFFINITY_NP)
+#if defined(__linux__)
+#define HAVE_PTHREAD_SETAFFINITY_NP 1
+#else
+#define HAVE_PTHREAD_SETAFFINITY_NP 0
+#endif
+#endif  // !defined(HAVE_PTHREAD_SETAFFINITY_NP)
+
 // Define to 1 if you have Google Snappy.
 #if !defined(HAVE_SNAPPY)
 #define HAVE_SNAPPY 1
 #endif  // !defined(HAVE_SNAPPY)
 
+// Define to 1 if you have LZ4.
+#if !defined(HAVE_LZ4)
+#define HAVE_LZ4 0
+#endif  // !defined(HAVE_LZ4)
+
+// Define to 1 if you have Zstd.
+#if !defined(HAVE_ZSTD)
+#define HAVE_ZSTD 0
+#endif  // !defined(HAVE_ZSTD)
+
 #endif  // STORAGE_LEVELDB_PORT_PORT_CONFIG_H_
@@ -28,14 +28,24 @@
 #if HAVE_SNAPPY
 #include <snappy.h>
 #endif  // HAVE_SNAPPY
+#if HAVE_LZ4
+#include <lz4.h>
+#endif  // HAVE_LZ4
+#if HAVE_ZSTD
+#define ZSTD_STATIC_LINKING_ONLY  // For ZSTD_compressionParameters.
+#include <zstd.h>
+#endif  // HAVE_ZSTD
 
+#include <algorithm>
 #include <cassert>
 #include <condition_variable>  // NOLINT
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <mutex>  // NOLINT
 #include <string>
 
+#include "crc32c_sse42.h"
 #include "thread_annotations.h"
 
 namespace leveldb {
@@ -126,6 +136,182 @@ inline bool Snappy_Uncompress(const char* input, size_t length, char* output) {
 #endif  // HAVE_SNAPPY
 }
 
+// Store the LZ4 compression of "input[0,input_length-1]" in *output.
+// LZ4 blocks do not record their uncompressed length, so it is stored in
+// front of the compressed data as a varint32.
+// Returns false if LZ4 is not supported by this port.
+inline bool LZ4_Compress(const char* input, size_t length,
+                         std::string* output) {
+#if HAVE_LZ4
+  if (length > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+    return false;
+  }
+  char header[5];
+  size_t header_len = 0;
+  uint32_t v = static_cast<uint32_t>(length);
+  while (v >= 128) {
+    header[header_len++] = static_cast<char>(v | 128);
+    v >>= 7;
+  }
+  header[header_len++] = static_cast<char>(v);
+
+  const int bound = LZ4_compressBound(static_cast<int>(length));
+  output->resize(header_len + bound);
+  std::memcpy(&(*output)[0], header, header_len);
+  const int outlen =
+      LZ4_compress_default(input, &(*output)[header_len],
+                           static_cast<int>(length), bound);
+  if (outlen <= 0) {
+    return false;
+  }
+  output->resize(header_len + outlen);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+// If input[0,input_length-1] looks like a valid LZ4 compressed buffer,
+// store the size of the uncompressed data in *result and return true.
+// Else return false.
+inline bool LZ4_GetUncompressedLength(const char* input, size_t length,
+                                      size_t* result) {
+#if HAVE_LZ4
+  uint32_t v = 0;
+  for (size_t i = 0, shift = 0; i < length && shift <= 28; i++, shift += 7) {
+    const uint32_t byte = static_cast<unsigned char>(input[i]);
+    v |= (byte & 127) << shift;
+    if (byte < 128) {
+      *result = v;
+      return true;
+    }
+  }
+  return false;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)result;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+// Attempt to LZ4 uncompress input[0,input_length-1] into *output.
+// Returns true if successful, false if the input is invalid LZ4
+// compressed data.
+//
+// REQUIRES: at least the first "n" bytes of output[] must be writable
+// where "n" is the result of a successful call to
+// LZ4_GetUncompressedLength.
+inline bool LZ4_Uncompress(const char* input, size_t length, char* output) {
+#if HAVE_LZ4
+  size_t ulength;
+  if (!LZ4_GetUncompressedLength(input, length, &ulength)) {
+    return false;
+  }
+  size_t header_len = 1;
+  while (static_cast<unsigned char>(input[header_len - 1]) >= 128) {
+    header_len++;
+  }
+  const int outlen = LZ4_decompress_safe(
+      input + header_len, output, static_cast<int>(length - header_len),
+      static_cast<int>(ulength));
+  return outlen >= 0 && static_cast<size_t>(outlen) == ulength;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+// Store the zstd compression of "input[0,input_length-1]" in *output.
+// Returns false if zstd is not supported by this port.
+inline bool Zstd_Compress(int level, const char* input, size_t length,
+                          std::string* output) {
+#if HAVE_ZSTD
+  // Get the MaxCompressedLength.
+  size_t outlen = ZSTD_compressBound(length);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  ZSTD_CCtx* ctx = ZSTD_createCCtx();
+  ZSTD_compressionParameters parameters =
+      ZSTD_getCParams(level, std::max(length, size_t{1}), /*dictSize=*/0);
+  ZSTD_CCtx_setCParams(ctx, parameters);
+  outlen = ZSTD_compress2(ctx, &(*output)[0], output->size(), input, length);
+  ZSTD_freeCCtx(ctx);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)level;
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+// If input[0,input_length-1] looks like a valid zstd compressed buffer,
+// store the size of the uncompressed data in *result and return true.
+// Else return false.
+inline bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                       size_t* result) {
+#if HAVE_ZSTD
+  size_t size = ZSTD_getFrameContentSize(input, length);
+  if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR) {
+    return false;
+  }
+  *result = size;
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)result;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+// Attempt to zstd uncompress input[0,input_length-1] into *output.
+// Returns true if successful, false if the input is invalid zstd
+// compressed data.
+//
+// REQUIRES: at least the first "n" bytes of output[] must be writable
+// where "n" is the result of a successful call to
+// Zstd_GetUncompressedLength.
+inline bool Zstd_Uncompress(const char* input, size_t length, char* output) {
+#if HAVE_ZSTD
+  size_t outlen;
+  if (!Zstd_GetUncompressedLength(input, length, &outlen)) {
+    return false;
+  }
+  ZSTD_DCtx* ctx = ZSTD_createDCtx();
+  outlen = ZSTD_decompressDCtx(ctx, output, outlen, input, length);
+  ZSTD_freeDCtx(ctx);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
 inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   // Silence compiler warnings about unused arguments.
   (void)func;
@@ -136,6 +322,12 @@ inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
 inline uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size) {
 #if HAVE_CRC32C
   return ::crc32c::Extend(crc, reinterpret_cast<const uint8_t*>(buf), size);
+#elif HAVE_SSE42
+  static const bool can_use_sse42 = CanAccelerateCRC32CWithSSE42();
+  if (can_use_sse42) {
+    return SSE42CRC32C(crc, buf, size);
+  }
+  return 0;
 #else
   // Silence compiler warnings about unused arguments.
   (void)crc;
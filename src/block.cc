@@ -1,6 +1,8 @@
 #include <status.h>
 #include "block.h"
 #include "../util/coding.h"
+#include "../util/hash.h"
+#include "../util/perf_context_imp.h"
 
 
 namespace leveldb {
@@ -33,17 +35,12 @@ namespace leveldb {
         return p;
     }
 
-    // 读取Block最后的restart point length，获得保存的restart point个数
-    // 获取restart point length的头地址
-    inline uint32_t Block::NumRestarts() const {
-        // data_ + size_ Block尾地址
-        return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
-    }
-
     // ------- <- data_
     //
     // ------- <- restart offset
     //
+    // ------- <- hash index（可选）
+    //
     // ------- <- data_ + size_
 
     // 初始化Block的三个地址：data_、restart offset、size_
@@ -51,22 +48,49 @@ namespace leveldb {
     Block::Block(BlockContents contents) // restart point的数量
             : data_(contents.data.data()),
               size_(contents.data.size()),
+              restarts_offset_(0),
+              num_restarts_(0),
+              hash_buckets_(nullptr),
+              num_buckets_(0),
               owned(contents.heap_allocated) {
 
         // 防止size_ - sizeof(uint32_t)溢出
-        // 同时防止NumRestarts()读取到Block前面的数据造成读取restart point出错
+        // 同时防止读取restart point length时读取到Block前面的数据
         if (size_ < sizeof(uint32_t)) {
             size_ = 0;
-        } else {
-            // 由于size_是size_t类型的，是非负数，如果size_ < sizeof(uint32_t)，那么size_ - sizeof(uint32_t) < 0会溢出
-            size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-            // 如果实际存储的restart point比最大的restart point还多的话，说明Block保存的restart point length不合法
-            if (NumRestarts() > max_restarts_allowed) {
+            return;
+        }
+
+        // 读取Block最后的restart point length，获得保存的restart point个数
+        uint32_t num_restarts = DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+        // restart point数组的尾偏移量
+        size_t restarts_end = size_ - sizeof(uint32_t);
+
+        // 最高位为1说明restart point数组之后有hash index
+        if (num_restarts & kBlockHashIndexFlag) {
+            num_restarts &= ~kBlockHashIndexFlag;
+            if (restarts_end < sizeof(uint16_t)) {
                 size_ = 0;
-            } else {
-                // restart point的头偏移量是总的偏移量减去restart point length和restart point所占的长度
-                restarts_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+                return;
             }
+            restarts_end -= sizeof(uint16_t);
+            num_buckets_ = DecodeFixed16(data_ + restarts_end);
+            if (num_buckets_ == 0 || restarts_end < num_buckets_) {
+                size_ = 0;
+                return;
+            }
+            restarts_end -= num_buckets_;
+            hash_buckets_ = reinterpret_cast<const uint8_t *>(data_ + restarts_end);
+        }
+
+        size_t max_restarts_allowed = restarts_end / sizeof(uint32_t);
+        // 如果实际存储的restart point比最大的restart point还多的话，说明Block保存的restart point length不合法
+        if (num_restarts > max_restarts_allowed) {
+            size_ = 0;
+        } else {
+            num_restarts_ = num_restarts;
+            // restart point的头偏移量是restart point数组的尾偏移量减去restart point所占的长度
+            restarts_offset_ = restarts_end - num_restarts * sizeof(uint32_t);
         }
     }
 
@@ -81,6 +105,10 @@ namespace leveldb {
         uint32_t const restarts_; // restart point的头偏移量
         uint32_t const num_restarts_; // restart point的个数，用于二分查找范围
 
+        // 点查询用的hash index，不用hash index时为nullptr
+        const uint8_t *const hash_buckets_;
+        uint16_t const num_buckets_;
+
         // Block的动态属性
         uint32_t restart_index_; //组磁头：指向Block中某一组磁头
         uint32_t current_; //Entry磁头：指向一组中某一Entry的磁头
@@ -94,6 +122,7 @@ namespace leveldb {
 
         // 封装二分查找要用的Compare
         inline int Compare(const Slice &a, const Slice &b) const {
+            PERF_COUNTER_ADD(key_comparison_count, 1);
             return comparator_->Compare(a, b);
         }
 
@@ -128,7 +157,9 @@ namespace leveldb {
         Iter(const Comparator *comparator,
              const char *data,
              uint32_t num_restarts,
-             uint32_t restarts)
+             uint32_t restarts,
+             const uint8_t *hash_buckets,
+             uint16_t num_buckets)
         // 二分查找用的Compare
                 : comparator_(comparator),
 
@@ -136,6 +167,8 @@ namespace leveldb {
                   data_(data),
                   restarts_(restarts),
                   num_restarts_(num_restarts),
+                  hash_buckets_(hash_buckets),
+                  num_buckets_(num_buckets),
 
                 // Block的动态属性
                 // 磁头最开始指向Entry区的尾偏移量
@@ -153,6 +186,12 @@ namespace leveldb {
         // 找到第一个key ≥ target的value
         // 找到最后一个key < target的组
         void Seek(const Slice &target) override {
+            PERF_TIMER_GUARD(block_seek_nanos);
+            // 点查询先用hash index，bucket冲突时才二分查找
+            if (hash_buckets_ != nullptr && SeekForGet(target)) {
+                return;
+            }
+
             uint32_t left = 0;
             uint32_t right = num_restarts_ - 1;
 
@@ -260,8 +299,9 @@ namespace leveldb {
         }
 
         // 返回状态信息，通常请情况下是ok的状态
+        // 解析Entry失败时CorruptionError()会记录错误信息
         Status status() const override {
-            return Status();
+            return status_;
         }
 
         // 移动并读取整个Block中第一个Entry的位置
@@ -312,6 +352,35 @@ namespace leveldb {
         }
 
     private:
+        // 用hash index查找target，找到时指向target，target不在block中时迭代器无效
+        // bucket冲突时返回false，由调用者退回二分查找
+        bool SeekForGet(const Slice &target) {
+            const uint8_t entry = hash_buckets_[Hash(target.data(), target.size(), kBlockHashSeed) % num_buckets_];
+            if (entry == kBlockHashCollision || (entry != kBlockHashNoEntry && entry >= num_restarts_)) {
+                return false;
+            }
+
+            if (entry != kBlockHashNoEntry) {
+                // 直接跳到target所在的组，组内的key只需要判断是否和target相等，不用调用comparator
+                SeekToRestartPoint(entry);
+                while (ParseNextKey() && restart_index_ == entry) {
+                    if (Slice(key_) == target) {
+                        return true;
+                    }
+                }
+                if (!status_.ok()) {
+                    return true;
+                }
+            }
+
+            // target不在block中
+            restart_index_ = num_restarts_;
+            current_ = restarts_;
+            key_.clear();
+            value_.clear();
+            return true;
+        }
+
         void CorruptionError() {
             // 重置磁头
             restart_index_ = num_restarts_; //重置组磁头
@@ -366,21 +435,18 @@ namespace leveldb {
         }
     };
 
-    Iterator *Block::NewIterator(const Comparator *comparator) {
-        // 倘若size_ < sizeof(uint32_t)，则会导致data_ + size_ - sizeof(uint32_t) < data_
-        // 调用NumRestarts()读取restart length肯定会出错
+    Iterator *Block::NewIterator(const Comparator *comparator, bool point_lookup) const {
+        // 构造时发现block的格式不合法，会把size_置为0
         if (size_ < sizeof(uint32_t)) {
             return NewErrorIterator(Status::Corruption("bad block contents"));
         }
 
-        // 获得Block中的restart point的数量
-        const uint32_t num_restarts_ = NumRestarts();
-
-        // 如果为0，说明Block为空
+        // 如果restart point的数量为0，说明Block为空
         if (num_restarts_ == 0) {
             return NewEmptyIterator();
         } else { // 如果不为零，则说明Block正常，生成迭代器
-            return new Iter(comparator, data_, num_restarts_, restarts_offset_);
+            return new Iter(comparator, data_, num_restarts_, restarts_offset_,
+                            point_lookup ? hash_buckets_ : nullptr, num_buckets_);
         }
     }
 
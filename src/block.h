@@ -19,7 +19,17 @@ namespace leveldb {
 
         ~Block();
 
-        Iterator *NewIterator(const Comparator *comparator);
+        // block数据的长度，作为block在cache中的charge
+        size_t size() const { return size_; }
+
+        // block的全部数据，data()[0, size())
+        const char *data() const { return data_; }
+
+        // point_lookup为true时，返回的迭代器用于点查询：
+        // block中有hash index时Seek(target)直接定位到target所在的组，
+        // target不在block中时迭代器可能无效，也可能指向某个 > target的key
+        // block构造之后不再修改，多个线程可以同时在同一个block上创建和使用各自的迭代器
+        Iterator *NewIterator(const Comparator *comparator, bool point_lookup = false) const;
 
     private:
         class Iter;
@@ -27,10 +37,13 @@ namespace leveldb {
         const char *data_;
         size_t size_; //size_要参与和sizeof()的计算，同时它并不会为了持久化被编码，所以声明为size_t，其它的变量都是uint32_t
         uint32_t restarts_offset_;
+        uint32_t num_restarts_;
 
-        bool owned;
+        // block中没有hash index时为nullptr
+        const uint8_t *hash_buckets_;
+        uint16_t num_buckets_;
 
-        uint32_t NumRestarts() const;
+        bool owned;
     };
 }
 #endif //SSTABLE_BLOCK_H
@@ -1,5 +1,10 @@
 #include "block_builder.h"
 
+#include <algorithm>
+
+#include "../util/hash.h"
+#include "format.h"
+
 namespace leveldb {
 
     void BlockBuilder::Add(const Slice &key, const Slice &value) {
@@ -50,6 +55,37 @@ namespace leveldb {
 
         //Entry个数相等
         counter_ ++;
+
+        if (options_->block_hash_index) {
+            hash_entries_.emplace_back(Hash(key.data(), key.size(), kBlockHashSeed),
+                                       static_cast<uint32_t>(restarts_.size() - 1));
+        }
+    }
+
+    // hash index的利用率为3/4，bucket的个数是uint16
+    size_t BlockBuilder::NumHashBuckets() const {
+        return std::min<size_t>(std::max<size_t>(hash_entries_.size() * 4 / 3, 1), 0xffff);
+    }
+
+    bool BlockBuilder::AppendHashIndex() {
+        if (!options_->block_hash_index || restarts_.size() > kBlockHashMaxRestarts) {
+            return false;
+        }
+
+        const size_t num_buckets = NumHashBuckets();
+        std::string buckets(num_buckets, static_cast<char>(kBlockHashNoEntry));
+        for (const auto &entry : hash_entries_) {
+            uint8_t &bucket = reinterpret_cast<uint8_t &>(buckets[entry.first % num_buckets]);
+            if (bucket == kBlockHashNoEntry) {
+                bucket = static_cast<uint8_t>(entry.second);
+            } else if (bucket != entry.second) {
+                // 同一个组中的key hash到同一个bucket没有关系
+                bucket = kBlockHashCollision;
+            }
+        }
+        buffer_.append(buckets);
+        PutFixed16(&buffer_, static_cast<uint16_t>(num_buckets));
+        return true;
     }
 
     Slice BlockBuilder::Finish() {
@@ -58,7 +94,11 @@ namespace leveldb {
             PutFixed32(&buffer_, restarts_[i]);
         }
 
-        PutFixed32(&buffer_, restarts_.size());
+        uint32_t num_restarts = restarts_.size();
+        if (AppendHashIndex()) {
+            num_restarts |= kBlockHashIndexFlag;
+        }
+        PutFixed32(&buffer_, num_restarts);
         finished_ = true;
         return Slice(buffer_);
     }
@@ -69,9 +109,13 @@ namespace leveldb {
     }
 
     size_t BlockBuilder::CurrentSizeEstimate() const {
-        return buffer_.size() +
+        size_t estimate = buffer_.size() +
                 restarts_.size() * sizeof (uint32_t) +
                 sizeof(uint32_t);
+        if (options_->block_hash_index) {
+            estimate += NumHashBuckets() + sizeof(uint16_t);
+        }
+        return estimate;
     }
 
     void BlockBuilder::Reset() {
@@ -84,5 +128,6 @@ namespace leveldb {
         finished_ = false;
 
         last_key_.clear();
+        hash_entries_.clear();
     }
 }
@@ -1,6 +1,7 @@
 #ifndef CMAKE_PROJECT_TEMPLATE_BLOCK_BUILDER_H
 #define CMAKE_PROJECT_TEMPLATE_BLOCK_BUILDER_H
 
+#include <utility>
 #include <vector>
 #include "slice.h"
 #include "../util/coding.h"
@@ -18,6 +19,9 @@ namespace leveldb {
 
         size_t CurrentSizeEstimate() const;
 
+        // 自上次Reset()以来没有Add过任何Entry
+        bool empty() const { return buffer_.empty(); }
+
         void Reset();
 
         Slice Finish();
@@ -31,6 +35,14 @@ namespace leveldb {
         bool finished_;
 
         int counter_;
+
+        // options_->block_hash_index为true时记录每个key的(hash, 所在组的下标)，Finish时生成hash index
+        std::vector<std::pair<uint32_t, uint32_t>> hash_entries_;
+
+        // 生成hash index追加到buffer_，组太多时不生成，返回是否生成了
+        bool AppendHashIndex();
+
+        size_t NumHashBuckets() const;
     };
 }
 
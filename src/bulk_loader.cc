@@ -0,0 +1,626 @@
+#include "bulk_loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <utility>
+
+#include "../include/comparator.h"
+#include "../include/iterator.h"
+#include "../util/mutexlock.h"
+#include "merger.h"
+#include "table.h"
+#include "table_builder.h"
+
+namespace leveldb {
+    // 一个写满之后排序的buffer，key和value依次追加在data中
+    struct BulkLoader::Buffer {
+        struct Entry {
+            // bytewise comparator时是key的前8个字节按大端序组成的整数，不足8个字节补0，
+            // prefix不同时不用访问data就能比较出大小
+            uint64_t prefix;
+            size_t offset;
+            uint32_t key_size;
+            uint32_t value_size;
+        };
+
+        void Append(const Slice &key, const Slice &value, bool with_prefix) {
+            Entry e;
+            e.prefix = 0;
+            if (with_prefix) {
+                const size_t n = std::min<size_t>(key.size(), 8);
+                for (size_t i = 0; i < n; i++) {
+                    e.prefix |= static_cast<uint64_t>(static_cast<unsigned char>(key[i])) << (56 - 8 * i);
+                }
+            }
+            e.offset = data.size();
+            e.key_size = static_cast<uint32_t>(key.size());
+            e.value_size = static_cast<uint32_t>(value.size());
+            data.append(key.data(), key.size());
+            data.append(value.data(), value.size());
+            entries.push_back(e);
+        }
+
+        Slice key(const Entry &e) const { return Slice(data.data() + e.offset, e.key_size); }
+
+        Slice value(const Entry &e) const {
+            return Slice(data.data() + e.offset + e.key_size, e.value_size);
+        }
+
+        size_t MemoryUsage() const { return data.size() + entries.size() * sizeof(Entry); }
+
+        // 保留已经分配的内存，给下一个run使用
+        void Clear() {
+            data.clear();
+            entries.clear();
+        }
+
+        std::string data;
+        std::vector<Entry> entries;
+    };
+
+    // 写入临时文件的一个run，归并之前才打开
+    struct BulkLoader::Run {
+        std::string fname;
+        RandomAccessFile *file = nullptr;
+        Table *table = nullptr;
+    };
+
+    struct BulkLoader::SpillTask {
+        BulkLoader *loader;
+        Buffer *buffer;
+        size_t run_index;
+        std::string fname_prefix;
+    };
+
+    // 把children归并之后由WriteTables写出
+    struct BulkLoader::MergeTask {
+        BulkLoader *loader;
+        std::vector<Iterator *> children;
+        const std::string *lower = nullptr;
+        const std::string *upper = nullptr;
+        const Options *options;
+        uint64_t max_file_size = 0;
+        bool sync = false;
+        std::string fname_prefix;
+        std::vector<std::string> files;
+        Status status;
+    };
+
+    // 遍历一个排好序的buffer，多个线程可以同时各自用一个迭代器读同一个buffer
+    class BulkLoader::BufferIterator : public Iterator {
+    public:
+        BufferIterator(const Comparator *comparator, const Buffer *buffer)
+                : comparator_(comparator), buffer_(buffer), pos_(buffer->entries.size()) {}
+
+        bool Valid() const override { return pos_ < buffer_->entries.size(); }
+
+        void SeekToFirst() override { pos_ = 0; }
+
+        void SeekToLast() override {
+            pos_ = buffer_->entries.empty() ? 0 : buffer_->entries.size() - 1;
+        }
+
+        void Seek(const Slice &target) override {
+            const std::vector<Buffer::Entry> &entries = buffer_->entries;
+            pos_ = std::lower_bound(entries.begin(), entries.end(), target,
+                                    [this](const Buffer::Entry &e, const Slice &t) {
+                                        return comparator_->Compare(buffer_->key(e), t) < 0;
+                                    }) - entries.begin();
+        }
+
+        void Next() override {
+            assert(Valid());
+            pos_++;
+        }
+
+        void Prev() override {
+            assert(Valid());
+            pos_ = (pos_ == 0) ? buffer_->entries.size() : pos_ - 1;
+        }
+
+        Slice key() const override {
+            assert(Valid());
+            return buffer_->key(buffer_->entries[pos_]);
+        }
+
+        Slice value() const override {
+            assert(Valid());
+            return buffer_->value(buffer_->entries[pos_]);
+        }
+
+        Status status() const override { return Status::OK(); }
+
+    private:
+        const Comparator *const comparator_;
+        const Buffer *const buffer_;
+        size_t pos_;
+    };
+
+    namespace {
+        std::atomic<uint64_t> next_loader_id(0);
+    }  // namespace
+
+    BulkLoader::BulkLoader(const Options &options, const BulkLoadOptions &load_options)
+            : options_(options),
+              run_options_(options),
+              load_options_(load_options),
+              env_(options.env),
+              bytewise_(options.comparator == BytewiseComparator()),
+              buffer_size_(std::max<size_t>(load_options.memory_budget /
+                                            (std::max(load_options.sort_threads, 1) + 1), 1)),
+              sample_interval_(buffer_size_ / 64 + 1),
+              current_(new Buffer),
+              sample_countdown_(0),
+              num_runs_(0),
+              finished_(false),
+              cv_(&mu_),
+              num_buffers_(1),
+              pending_(0) {
+        // run只在归并时顺序读一次，不需要压缩、filter和cache
+        run_options_.compression = kNoCompression;
+        run_options_.adaptive_compression = false;
+        run_options_.parallel_compression_threads = 0;
+        run_options_.filter_policy = nullptr;
+        run_options_.block_cache = nullptr;
+        run_options_.compressed_block_cache = nullptr;
+        run_options_.block_hash_index = false;
+        run_options_.index_partition_size = 0;
+        run_options_.block_alignment = 0;
+        run_options_.block_size = load_options.run_block_size;
+        run_options_.statistics = nullptr;
+
+        tag_ = "bulkload-" + std::to_string(env_->NowMicros()) + "-" +
+               std::to_string(next_loader_id.fetch_add(1, std::memory_order_relaxed));
+
+        const int threads = std::max(load_options.sort_threads, load_options.merge_threads);
+        if (env_->GetBackgroundThreads(Env::kLow) < threads) {
+            env_->SetBackgroundThreads(threads, Env::kLow);
+        }
+        current_->data.reserve(buffer_size_);
+    }
+
+    BulkLoader::~BulkLoader() {
+        {
+            MutexLock l(&mu_);
+            while (pending_ > 0) {
+                cv_.Wait();
+            }
+        }
+        CloseRuns(0, runs_.size());
+        for (Buffer *buffer : free_buffers_) {
+            delete buffer;
+        }
+        delete current_;
+    }
+
+    Status BulkLoader::Add(const Slice &key, const Slice &value) {
+        assert(!finished_);
+        if (!status_.ok()) {
+            return status_;
+        }
+        current_->Append(key, value, bytewise_);
+
+        // 按字节数抽样，每个样本代表差不多同样多的数据
+        const size_t size = key.size() + value.size();
+        if (sample_countdown_ <= size) {
+            samples_.push_back(key.ToString());
+            sample_countdown_ = sample_interval_;
+        } else {
+            sample_countdown_ -= size;
+        }
+
+        if (current_->MemoryUsage() >= buffer_size_) {
+            status_ = ScheduleSpill();
+        }
+        return status_;
+    }
+
+    Status BulkLoader::ScheduleSpill() {
+        SpillTask *task = new SpillTask;
+        task->loader = this;
+        task->buffer = current_;
+        task->fname_prefix = TempFileName("run" + std::to_string(num_runs_++) + "-");
+
+        MutexLock l(&mu_);
+        task->run_index = runs_.size();
+        runs_.push_back(nullptr);
+        pending_++;
+        env_->Schedule(&BulkLoader::SpillWork, task, Env::kLow);
+
+        // 换一个空闲的buffer继续Add，sort_threads个buffer都在后台时等其中一个完成
+        const size_t max_buffers = static_cast<size_t>(std::max(load_options_.sort_threads, 1)) + 1;
+        while (free_buffers_.empty() && num_buffers_ >= max_buffers) {
+            cv_.Wait();
+        }
+        if (!free_buffers_.empty()) {
+            current_ = free_buffers_.back();
+            free_buffers_.pop_back();
+        } else {
+            current_ = new Buffer;
+            current_->data.reserve(buffer_size_);
+            num_buffers_++;
+        }
+        return bg_status_;
+    }
+
+    void BulkLoader::SpillWork(void *arg) {
+        SpillTask *task = reinterpret_cast<SpillTask *>(arg);
+        BulkLoader *loader = task->loader;
+        Buffer *buffer = task->buffer;
+
+        loader->SortBuffer(buffer);
+        BufferIterator iter(loader->options_.comparator, buffer);
+        std::vector<std::string> files;
+        Status s = loader->WriteTables(&iter, nullptr, nullptr, loader->run_options_, 0, false,
+                                       task->fname_prefix, &files);
+        Run *run = nullptr;
+        if (s.ok() && !files.empty()) {
+            run = new Run;
+            run->fname = files[0];
+        } else {
+            for (const std::string &fname : files) {
+                loader->env_->RemoveFile(fname);
+            }
+        }
+        buffer->Clear();
+
+        MutexLock l(&loader->mu_);
+        loader->runs_[task->run_index] = run;
+        if (!s.ok() && loader->bg_status_.ok()) {
+            loader->bg_status_ = s;
+        }
+        loader->free_buffers_.push_back(buffer);
+        loader->pending_--;
+        loader->cv_.SignalAll();
+        delete task;
+    }
+
+    void BulkLoader::SortBuffer(Buffer *buffer) const {
+        const Comparator *comparator = options_.comparator;
+        const bool bytewise = bytewise_;
+        std::sort(buffer->entries.begin(), buffer->entries.end(),
+                  [buffer, comparator, bytewise](const Buffer::Entry &a, const Buffer::Entry &b) {
+                      if (bytewise && a.prefix != b.prefix) {
+                          return a.prefix < b.prefix;
+                      }
+                      const int r = comparator->Compare(buffer->key(a), buffer->key(b));
+                      // offset大的是后加入的，排在前面
+                      return r < 0 || (r == 0 && a.offset > b.offset);
+                  });
+    }
+
+    Status BulkLoader::WriteTables(Iterator *iter, const std::string *lower, const std::string *upper,
+                                   const Options &options, uint64_t max_file_size, bool sync,
+                                   const std::string &fname_prefix, std::vector<std::string> *files) const {
+        const Comparator *comparator = options_.comparator;
+        Status s;
+        WritableFile *file = nullptr;
+        TableBuilder *builder = nullptr;
+        // 上一个写出的key，可能在上一个文件里
+        std::string last_key;
+        bool has_last_key = false;
+
+        if (lower != nullptr) {
+            iter->Seek(*lower);
+        } else {
+            iter->SeekToFirst();
+        }
+        for (; iter->Valid(); iter->Next()) {
+            const Slice key = iter->key();
+            if (upper != nullptr && comparator->Compare(key, *upper) >= 0) {
+                break;
+            }
+            // 相同的key中新的value先输出，之后的都是旧的
+            if (has_last_key && comparator->Compare(key, last_key) == 0) {
+                continue;
+            }
+            if (builder == nullptr) {
+                const std::string fname = fname_prefix + std::to_string(files->size());
+                s = env_->NewWritableFile(fname, &file);
+                if (!s.ok()) {
+                    break;
+                }
+                files->push_back(fname);
+                builder = new TableBuilder(options, file);
+            }
+            builder->Add(key, iter->value());
+            last_key.assign(key.data(), key.size());
+            has_last_key = true;
+
+            if (max_file_size > 0 && builder->FileSize() >= max_file_size) {
+                s = FinishTable(builder, file, sync);
+                builder = nullptr;
+                file = nullptr;
+                if (!s.ok()) {
+                    break;
+                }
+            }
+        }
+        if (s.ok()) {
+            s = iter->status();
+        }
+        if (builder != nullptr) {
+            if (s.ok()) {
+                s = FinishTable(builder, file, sync);
+            } else {
+                delete builder;
+                delete file;
+            }
+        }
+        return s;
+    }
+
+    Status BulkLoader::FinishTable(TableBuilder *builder, WritableFile *file, bool sync) {
+        Status s = builder->Finish();
+        if (s.ok() && sync) {
+            s = builder->Sync();
+        }
+        delete builder;
+        if (s.ok()) {
+            s = file->Close();
+        }
+        delete file;
+        return s;
+    }
+
+    Status BulkLoader::Finish(std::vector<std::string> *files) {
+        assert(!finished_);
+        finished_ = true;
+        files->clear();
+
+        // 最后一个buffer不写run，在等待后台写run的同时排序，直接参与最后一趟归并
+        SortBuffer(current_);
+        Status s = status_;
+        {
+            MutexLock l(&mu_);
+            while (pending_ > 0) {
+                cv_.Wait();
+            }
+            if (s.ok()) {
+                s = bg_status_;
+            }
+        }
+        // 空闲的buffer不再使用，释放之后归并时有更多内存
+        for (Buffer *buffer : free_buffers_) {
+            delete buffer;
+        }
+        free_buffers_.clear();
+
+        if (s.ok()) {
+            s = ReduceRuns();
+        }
+        if (s.ok()) {
+            s = MergeRuns(files);
+        }
+        CloseRuns(0, runs_.size());
+        runs_.clear();
+        current_->Clear();
+        return s;
+    }
+
+    Status BulkLoader::ReduceRuns() {
+        const size_t width = static_cast<size_t>(std::max(load_options_.max_merge_width, 2));
+        Status s;
+        while (s.ok() && runs_.size() > width) {
+            // 相邻的run分成一组归并成一个新run，新run在原来这组run的位置，保持run的新旧顺序
+            std::vector<std::pair<size_t, size_t>> groups;
+            std::vector<MergeTask *> tasks;
+            for (size_t first = 0; first < runs_.size(); first += width) {
+                groups.emplace_back(first, std::min(first + width, runs_.size()));
+            }
+            const ReadOptions read_options = RunReadOptions(groups.size() * width);
+            for (const std::pair<size_t, size_t> &g : groups) {
+                MergeTask *task = nullptr;
+                if (s.ok() && g.second - g.first > 1) {
+                    s = OpenRuns(g.first, g.second);
+                    if (s.ok()) {
+                        task = new MergeTask;
+                        task->loader = this;
+                        AddRunIterators(g.first, g.second, read_options, &task->children);
+                        task->options = &run_options_;
+                        task->fname_prefix = TempFileName("run" + std::to_string(num_runs_++) + "-");
+                    }
+                }
+                tasks.push_back(task);
+            }
+            RunMergeTasks(tasks);
+
+            std::vector<Run *> runs;
+            for (size_t i = 0; i < groups.size(); i++) {
+                MergeTask *task = tasks[i];
+                if (task != nullptr && task->status.ok() && !task->files.empty()) {
+                    CloseRuns(groups[i].first, groups[i].second);
+                    Run *run = new Run;
+                    run->fname = task->files[0];
+                    runs.push_back(run);
+                } else {
+                    // 没有归并或者归并失败的组保留原来的run，失败时由Finish统一删除
+                    if (task != nullptr) {
+                        if (s.ok()) {
+                            s = task->status;
+                        }
+                        for (const std::string &fname : task->files) {
+                            env_->RemoveFile(fname);
+                        }
+                    }
+                    for (size_t j = groups[i].first; j < groups[i].second; j++) {
+                        runs.push_back(runs_[j]);
+                    }
+                }
+                delete task;
+            }
+            runs_.swap(runs);
+        }
+        return s;
+    }
+
+    Status BulkLoader::MergeRuns(std::vector<std::string> *files) {
+        if (runs_.empty() && current_->entries.empty()) {
+            return Status::OK();
+        }
+        Status s = OpenRuns(0, runs_.size());
+        if (!s.ok()) {
+            return s;
+        }
+
+        // max_file_size为0时只有一个输出文件，不能分段
+        const int partitions = options_.max_file_size == 0 ? 1 : std::max(load_options_.merge_threads, 1);
+        const std::vector<std::string> splitters = ChooseSplitters(partitions);
+        const size_t n = splitters.size() + 1;
+        const ReadOptions read_options = RunReadOptions(n * runs_.size());
+        std::vector<MergeTask *> tasks;
+        for (size_t i = 0; i < n; i++) {
+            MergeTask *task = new MergeTask;
+            task->loader = this;
+            // 最后一个buffer比所有run都新
+            task->children.push_back(new BufferIterator(options_.comparator, current_));
+            AddRunIterators(0, runs_.size(), read_options, &task->children);
+            task->lower = (i == 0) ? nullptr : &splitters[i - 1];
+            task->upper = (i + 1 == n) ? nullptr : &splitters[i];
+            task->options = &options_;
+            task->max_file_size = options_.max_file_size;
+            task->sync = true;
+            task->fname_prefix = load_options_.output_prefix + tag_ + "." + std::to_string(i) + ".";
+            tasks.push_back(task);
+        }
+        RunMergeTasks(tasks);
+
+        for (MergeTask *task : tasks) {
+            if (s.ok()) {
+                s = task->status;
+            }
+        }
+        // 各段的文件按key的顺序连续编号，出错时删除所有输出
+        for (MergeTask *task : tasks) {
+            for (const std::string &fname : task->files) {
+                if (s.ok()) {
+                    char buf[32];
+                    std::snprintf(buf, sizeof(buf), "%06d.sst", static_cast<int>(files->size()));
+                    const std::string target = load_options_.output_prefix + buf;
+                    s = env_->RenameFile(fname, target);
+                    if (s.ok()) {
+                        files->push_back(target);
+                        continue;
+                    }
+                }
+                env_->RemoveFile(fname);
+            }
+            delete task;
+        }
+        if (!s.ok()) {
+            for (const std::string &fname : *files) {
+                env_->RemoveFile(fname);
+            }
+            files->clear();
+        }
+        return s;
+    }
+
+    void BulkLoader::MergeWork(void *arg) {
+        MergeTask *task = reinterpret_cast<MergeTask *>(arg);
+        BulkLoader *loader = task->loader;
+        Iterator *iter = NewMergingIterator(loader->options_.comparator, task->children.data(),
+                                            static_cast<int>(task->children.size()));
+        // children归iter所有
+        task->children.clear();
+        task->status = loader->WriteTables(iter, task->lower, task->upper, *task->options,
+                                           task->max_file_size, task->sync, task->fname_prefix,
+                                           &task->files);
+        delete iter;
+
+        MutexLock l(&loader->mu_);
+        loader->pending_--;
+        loader->cv_.SignalAll();
+    }
+
+    void BulkLoader::RunMergeTasks(const std::vector<MergeTask *> &tasks) {
+        MutexLock l(&mu_);
+        for (MergeTask *task : tasks) {
+            if (task != nullptr) {
+                pending_++;
+                env_->Schedule(&BulkLoader::MergeWork, task, Env::kLow);
+            }
+        }
+        while (pending_ > 0) {
+            cv_.Wait();
+        }
+    }
+
+    std::vector<std::string> BulkLoader::ChooseSplitters(int n) {
+        std::vector<std::string> splitters;
+        if (n <= 1 || samples_.empty()) {
+            return splitters;
+        }
+        const Comparator *comparator = options_.comparator;
+        std::sort(samples_.begin(), samples_.end(), [comparator](const std::string &a, const std::string &b) {
+            return comparator->Compare(a, b) < 0;
+        });
+        for (int i = 1; i < n; i++) {
+            const std::string &key = samples_[samples_.size() * i / n];
+            // 重复的分割点会产生空的分段
+            if (splitters.empty() || comparator->Compare(splitters.back(), key) < 0) {
+                splitters.push_back(key);
+            }
+        }
+        return splitters;
+    }
+
+    ReadOptions BulkLoader::RunReadOptions(size_t iterators) const {
+        ReadOptions read_options;
+        read_options.fill_cache = false;
+        // 同时打开的run迭代器的预读总量不超过memory_budget
+        read_options.max_readahead_size = std::min(
+                read_options.max_readahead_size, load_options_.memory_budget / std::max<size_t>(iterators, 1));
+        return read_options;
+    }
+
+    Status BulkLoader::OpenRuns(size_t first, size_t last) {
+        Status s;
+        for (size_t i = first; i < last && s.ok(); i++) {
+            Run *run = runs_[i];
+            if (run->table != nullptr) {
+                continue;
+            }
+            uint64_t size;
+            s = env_->GetFileSize(run->fname, &size);
+            if (s.ok()) {
+                s = env_->NewRandomAccessFile(run->fname, &run->file);
+            }
+            if (s.ok()) {
+                s = Table::Open(run_options_, run->file, size, &run->table);
+            }
+        }
+        return s;
+    }
+
+    void BulkLoader::AddRunIterators(size_t first, size_t last, const ReadOptions &read_options,
+                                     std::vector<Iterator *> *iters) const {
+        // 编号大的run更新，放在前面，相同的key时先输出
+        for (size_t i = last; i > first; i--) {
+            iters->push_back(runs_[i - 1]->table->NewIterator(read_options));
+        }
+    }
+
+    void BulkLoader::CloseRuns(size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            Run *run = runs_[i];
+            if (run == nullptr) {
+                continue;
+            }
+            delete run->table;
+            delete run->file;
+            env_->RemoveFile(run->fname);
+            delete run;
+            runs_[i] = nullptr;
+        }
+    }
+
+    std::string BulkLoader::TempFileName(const std::string &name) const {
+        return load_options_.temp_dir + "/" + tag_ + "-" + name;
+    }
+
+    uint64_t BulkLoader::NumRuns() const {
+        return num_runs_;
+    }
+}
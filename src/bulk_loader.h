@@ -0,0 +1,172 @@
+#ifndef SSTABLE_BULK_LOADER_H
+#define SSTABLE_BULK_LOADER_H
+
+#include <string>
+#include <vector>
+
+#include "../include/env.h"
+#include "../include/iterator.h"
+#include "../include/options.h"
+#include "../include/slice.h"
+#include "../include/status.h"
+#include "../port/port_stdcxx.h"
+
+namespace leveldb {
+    class Table;
+    class TableBuilder;
+
+    struct BulkLoadOptions {
+        // 排好序的run写到这个目录下的临时文件中，Finish之后或者析构时删除
+        std::string temp_dir;
+
+        // 输出table的文件名是output_prefix + 6位序号 + ".sst"，序号从0开始按key的顺序递增
+        std::string output_prefix;
+
+        // 缓存还没排序的kv对的内存上限，包括正在后台排序和写入的buffer
+        // 平均分给sort_threads + 1个buffer，每个写满的buffer排序后成为一个run
+        size_t memory_budget = 256 * 1024 * 1024;
+
+        // 最多同时有这么多个写满的buffer在后台排序、写入run文件，Add在它们都没完成时等待
+        int sort_threads = 4;
+
+        // 最后一趟归并按key范围切成这么多段并行归并，每段输出各自的table文件
+        // Options::max_file_size为0时只输出一个table，只能用一个线程归并
+        int merge_threads = 4;
+
+        // 一次归并最多打开的run数，run更多时先把相邻的run分组归并成更大的run
+        int max_merge_width = 256;
+
+        // run文件的block大小，run只会被顺序读写一次，大block减少index entry和读取次数
+        size_t run_block_size = 64 * 1024;
+    };
+
+    // 外排序批量导入：接受任意顺序的kv对，输出按key有序的一个或多个sstable
+    //
+    // Add把kv对追加到内存buffer中，buffer写满后交给Env的kLow线程池排序，
+    // 写成一个不压缩的临时table(run)，多个buffer的排序和写入并行进行
+    // Finish把最后一个buffer留在内存中排序，和所有run一起用NewMergingIterator归并，
+    // 按Options::max_file_size切分输出文件；归并按抽样得到的key范围分段，由多个线程同时进行
+    //
+    // 输出table使用构造时传入的Options，Options::comparator决定key的顺序
+    // 同一个key多次Add时只保留最后一次的value
+    // 构造时如果Env的kLow线程池的线程数少于sort_threads和merge_threads，会把它调大
+    //
+    // 不是线程安全的，Add和Finish需要由调用者同步
+    class BulkLoader {
+    public:
+        BulkLoader(const Options &options, const BulkLoadOptions &load_options);
+
+        BulkLoader(const BulkLoader &) = delete;
+
+        BulkLoader &operator=(const BulkLoader &) = delete;
+
+        // 等待后台任务结束，删除没有删除的临时文件
+        ~BulkLoader();
+
+        // 后台写run失败之后返回那个错误，之后的kv对都被丢弃
+        Status Add(const Slice &key, const Slice &value);
+
+        // 完成排序和归并，成功时*files按key的顺序保存输出的文件名，没有数据时不输出文件
+        // 调用之后不能再调用Add
+        Status Finish(std::vector<std::string> *files);
+
+        // 写入临时文件的run数，包括中间归并生成的run
+        uint64_t NumRuns() const;
+
+    private:
+        struct Buffer;
+        struct Run;
+        struct SpillTask;
+        struct MergeTask;
+        class BufferIterator;
+
+        // buffer中的kv对按key排序，相同的key后加入的排在前面
+        void SortBuffer(Buffer *buffer) const;
+
+        // 把写满的current_交给后台排序并写成一个run，换一个空闲的buffer给之后的Add使用，
+        // 没有空闲的buffer时等待，返回后台任务的第一个错误
+        Status ScheduleSpill();
+
+        static void SpillWork(void *arg);
+
+        static void MergeWork(void *arg);
+
+        // 把iter中[lower, upper)范围的kv对写成table文件，文件名是fname_prefix + 序号
+        // lower或upper为nullptr时表示没有下界或上界；max_file_size为0时只写一个文件
+        // 相同的key只保留第一个；sync为true时每个文件Sync之后再关闭
+        Status WriteTables(Iterator *iter, const std::string *lower, const std::string *upper,
+                           const Options &options, uint64_t max_file_size, bool sync,
+                           const std::string &fname_prefix, std::vector<std::string> *files) const;
+
+        // 取得builder和file的所有权
+        static Status FinishTable(TableBuilder *builder, WritableFile *file, bool sync);
+
+        // run多于max_merge_width时，把相邻的run分组归并，直到不超过max_merge_width
+        Status ReduceRuns();
+
+        // 最后一趟归并，把current_和所有run归并成输出文件
+        Status MergeRuns(std::vector<std::string> *files);
+
+        // 在Env的kLow线程池中执行tasks中不为nullptr的任务，等待它们全部完成
+        void RunMergeTasks(const std::vector<MergeTask *> &tasks);
+
+        // 从抽样的key中选出把数据分成最多n段的分割点
+        std::vector<std::string> ChooseSplitters(int n);
+
+        // 读run的ReadOptions，iterators是同时打开的run迭代器数
+        ReadOptions RunReadOptions(size_t iterators) const;
+
+        Status OpenRuns(size_t first, size_t last);
+
+        // 把runs_[first, last)的迭代器按从新到旧的顺序加入*iters，相同的key新的先输出
+        // REQUIRES: OpenRuns(first, last)成功
+        void AddRunIterators(size_t first, size_t last, const ReadOptions &read_options,
+                             std::vector<Iterator *> *iters) const;
+
+        // 关闭并删除runs_[first, last)的文件
+        void CloseRuns(size_t first, size_t last);
+
+        std::string TempFileName(const std::string &name) const;
+
+        const Options options_;
+        // 写run使用的Options：不压缩，没有filter和cache
+        Options run_options_;
+        const BulkLoadOptions load_options_;
+        Env *const env_;
+        // comparator是BytewiseComparator，可以用key的前缀加速排序
+        const bool bytewise_;
+        // 每个buffer的容量
+        const size_t buffer_size_;
+        // 每加入这么多字节的kv对抽样一个key
+        const size_t sample_interval_;
+        // 区分同一个目录下不同BulkLoader的临时文件
+        std::string tag_;
+
+        // 以下只由调用Add和Finish的线程访问
+        // 正在Add的buffer
+        Buffer *current_;
+        // 距离下一次抽样还有多少字节
+        size_t sample_countdown_;
+        // 抽样得到的key，用来切分最后一趟归并的key范围
+        std::vector<std::string> samples_;
+        uint64_t num_runs_;
+        bool finished_;
+        Status status_;
+
+        // 以下由mu_保护
+        port::Mutex mu_;
+        port::CondVar cv_;
+        // 空闲的buffer
+        std::vector<Buffer *> free_buffers_;
+        // 已经分配的buffer数，不超过sort_threads + 1
+        size_t num_buffers_;
+        // 还没完成的后台任务数
+        int pending_;
+        // 下标越大的run越新，后台写完之前是nullptr
+        std::vector<Run *> runs_;
+        // 后台任务的第一个错误
+        Status bg_status_;
+    };
+}
+
+#endif //SSTABLE_BULK_LOADER_H
@@ -0,0 +1,103 @@
+#include "filter_block.h"
+
+#include <cassert>
+
+#include "../util/coding.h"
+
+namespace leveldb {
+    // 每2KB的data生成一个filter
+    static const size_t kFilterBaseLg = 11;
+    static const size_t kFilterBase = 1 << kFilterBaseLg;
+
+    FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy *policy)
+            : policy_(policy) {}
+
+    void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
+        // block_offset之前的每个2KB区间都要有一个filter
+        // 中间没有data block开头的区间，生成的是空filter
+        uint64_t filter_index = (block_offset / kFilterBase);
+        assert(filter_index >= filter_offsets_.size());
+        while (filter_index > filter_offsets_.size()) {
+            GenerateFilter();
+        }
+    }
+
+    void FilterBlockBuilder::AddKey(const Slice &key) {
+        Slice k = key;
+        start_.push_back(keys_.size());
+        keys_.append(k.data(), k.size());
+    }
+
+    Slice FilterBlockBuilder::Finish() {
+        // 还有没生成filter的key
+        if (!start_.empty()) {
+            GenerateFilter();
+        }
+
+        // 追加每个filter的偏移量
+        const uint32_t array_offset = result_.size();
+        for (size_t i = 0; i < filter_offsets_.size(); i++) {
+            PutFixed32(&result_, filter_offsets_[i]);
+        }
+
+        PutFixed32(&result_, array_offset);
+        result_.push_back(kFilterBaseLg);  // Save encoding parameter in result
+        return Slice(result_);
+    }
+
+    void FilterBlockBuilder::GenerateFilter() {
+        const size_t num_keys = start_.size();
+        if (num_keys == 0) {
+            // 这个区间没有key，只记录一个偏移量，filter长度为0
+            filter_offsets_.push_back(result_.size());
+            return;
+        }
+
+        // 从keys_中切出每一个key
+        start_.push_back(keys_.size());  // Simplify length computation
+        tmp_keys_.resize(num_keys);
+        for (size_t i = 0; i < num_keys; i++) {
+            const char *base = keys_.data() + start_[i];
+            size_t length = start_[i + 1] - start_[i];
+            tmp_keys_[i] = Slice(base, length);
+        }
+
+        // 生成filter并追加到result_
+        filter_offsets_.push_back(result_.size());
+        policy_->CreateFilter(&tmp_keys_[0], static_cast<int>(num_keys), &result_);
+
+        tmp_keys_.clear();
+        keys_.clear();
+        start_.clear();
+    }
+
+    FilterBlockReader::FilterBlockReader(const FilterPolicy *policy,
+                                         const Slice &contents)
+            : policy_(policy), data_(nullptr), offset_(nullptr), num_(0), base_lg_(0) {
+        size_t n = contents.size();
+        // 至少要有1Byte的base_lg和4Byte的offset array的开头偏移量
+        if (n < 5) return;
+        base_lg_ = contents[n - 1];
+        uint32_t last_word = DecodeFixed32(contents.data() + n - 5);
+        if (last_word > n - 5) return;
+        data_ = contents.data();
+        offset_ = data_ + last_word;
+        num_ = (n - 5 - last_word) / 4;
+    }
+
+    bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice &key) const {
+        uint64_t index = block_offset >> base_lg_;
+        if (index < num_) {
+            uint32_t start = DecodeFixed32(offset_ + index * 4);
+            uint32_t limit = DecodeFixed32(offset_ + index * 4 + 4);
+            if (start <= limit && limit <= static_cast<size_t>(offset_ - data_)) {
+                Slice filter = Slice(data_ + start, limit - start);
+                return policy_->KeyMayMatch(key, filter);
+            } else if (start == limit) {
+                // 空filter说明这个区间没有任何key
+                return false;
+            }
+        }
+        return true;  // 出错时当作可能存在，交给data block判断
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef SSTABLE_FILTER_BLOCK_H
+#define SSTABLE_FILTER_BLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "slice.h"
+#include "../include/filter_policy.h"
+#include "../util/hash.h"
+
+namespace leveldb {
+    class FilterPolicy;
+
+    // filter block保存了sstable中所有key的filter
+    // 每2KB(1 << kFilterBaseLg)的文件偏移量对应一个filter
+    // 一个data block的所有key都放在它的起始偏移量对应的filter里
+    //
+    // 布局：
+    // [filter 0]
+    // [filter 1]
+    // ...
+    // [filter N-1]
+    // [offset of filter 0]    : 4 bytes
+    // ...
+    // [offset of filter N-1]  : 4 bytes
+    // [offset of beginning of offset array] : 4 bytes
+    // lg(base)                : 1 byte
+    //
+    // 调用顺序必须满足正则表达式：(StartBlock AddKey*)* Finish
+    class FilterBlockBuilder {
+    public:
+        explicit FilterBlockBuilder(const FilterPolicy *policy);
+
+        FilterBlockBuilder(const FilterBlockBuilder &) = delete;
+
+        FilterBlockBuilder &operator=(const FilterBlockBuilder &) = delete;
+
+        // 下一个data block的开头偏移量为block_offset
+        void StartBlock(uint64_t block_offset);
+
+        void AddKey(const Slice &key);
+
+        Slice Finish();
+
+    private:
+        // 用keys_中的key生成一个filter
+        void GenerateFilter();
+
+        const FilterPolicy *policy_;
+        std::string keys_;             // 把所有key拼接在一起
+        std::vector<size_t> start_;    // 每个key在keys_中的开头偏移量
+        std::string result_;           // 已经生成的filter数据
+        std::vector<Slice> tmp_keys_;  // policy_->CreateFilter()的参数
+        std::vector<uint32_t> filter_offsets_;
+    };
+
+    class FilterBlockReader {
+    public:
+        // REQUIRES: contents和policy在reader的生命周期内都有效
+        FilterBlockReader(const FilterPolicy *policy, const Slice &contents);
+
+        // block_offset开头的data block中可能有key时返回true
+        bool KeyMayMatch(uint64_t block_offset, const Slice &key) const;
+
+    private:
+        const FilterPolicy *policy_;
+        const char *data_;    // filter block的头地址
+        const char *offset_;  // offset array的头地址
+        size_t num_;          // filter的个数
+        size_t base_lg_;      // 见kFilterBaseLg
+    };
+}
+
+#endif //SSTABLE_FILTER_BLOCK_H
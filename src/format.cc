@@ -1,5 +1,12 @@
 #include "format.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include "../include/compressor.h"
+#include "../util/perf_context_imp.h"
+#include "../util/xxhash.h"
+
 namespace leveldb {
 
     void BlockHandle::EncodeTo(std::string *dst) const {
@@ -22,27 +29,43 @@ namespace leveldb {
         }
     }
 
-    // index_handle + padding
+    // [checksum type]，只有不是crc32c时才有
+    // metaindex_handle + index_handle + padding
     // magic number
     void Footer::EncodeTo(std::string *dst) const {
         const size_t original_size = dst->size();
 
+        // crc32c的table不需要ChecksumType字节
+        const bool legacy = (checksum_type_ == kCRC32c);
+        if (!legacy) {
+            dst->push_back(static_cast<char>(checksum_type_));
+        }
+        const size_t handles_start = dst->size();
+
+        metaindex_handle_.EncodeTo(dst); // add metaindex_handle to dst
         index_handle_.EncodeTo(dst); // add index_handle to dst
-        dst->resize(BlockHandle::kMaxEncodedLength); // padding
+        dst->resize(handles_start + 2 * BlockHandle::kMaxEncodedLength); // padding
 
         // @todo 为什么不直接调用PutFixed64接口进行持久化？
-        PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-        PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+        const uint64_t magic = legacy ? kTableMagicNumberV1 : kTableMagicNumberV2;
+        PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+        PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
         //PutFixed64(dst, kTableMagicNumber);
 
-        assert(original_size + kEncodedLength == dst->size());
+        assert(original_size + (legacy ? kLegacyEncodedLength : kMaxEncodedLength) == dst->size());
         (void) original_size;
     }
 
-    //index_handle + padding
-    //magic number
+    // [checksum type]
+    // metaindex_handle + index_handle + padding，最初的格式只有index_handle + padding
+    // magic number
+    // input是文件末尾的至少kOriginalEncodedLength个字节，magic number在input的最后
     Status Footer::DecodeFrom(Slice *input) {
-        const char *magic_ptr = input->data() + kEncodedLength - 8;
+        if (input->size() < kOriginalEncodedLength) {
+            return Status::Corruption("footer too short");
+        }
+        const char *end = input->data() + input->size();
+        const char *magic_ptr = end - 8;
 
         const uint32_t magic_lo = DecodeFixed32(magic_ptr);
         const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
@@ -50,70 +73,104 @@ namespace leveldb {
                                 (static_cast<uint64_t>(magic_lo)));
         //const uint64_t magic = DecodeFixed64(magic_ptr);
 
-        if (magic != kTableMagicNumber) {
+        const char *handles = end - kLegacyEncodedLength;
+        if (magic == kTableMagicNumber) {
+            // 最初的格式：没有metaindex block，block都用crc32c校验
+            checksum_type_ = kCRC32c;
+            has_metaindex_ = false;
+            Slice handle_input(end - kOriginalEncodedLength, BlockHandle::kMaxEncodedLength);
+            Status status = index_handle_.DecodeFrom(&handle_input);
+            if (status.ok()) {
+                *input = Slice(end, 0);
+            }
+            return status;
+        }
+        if (input->size() < kLegacyEncodedLength) {
+            return Status::Corruption("footer too short");
+        }
+        has_metaindex_ = true;
+        if (magic == kTableMagicNumberV1) {
+            checksum_type_ = kCRC32c;
+        } else if (magic == kTableMagicNumberV2) {
+            if (input->size() < kMaxEncodedLength) {
+                return Status::Corruption("footer too short");
+            }
+            const unsigned char type = static_cast<unsigned char>(handles[-1]);
+            if (type != kCRC32c && type != kXXH3) {
+                return Status::Corruption("unknown block checksum type");
+            }
+            checksum_type_ = static_cast<ChecksumType>(type);
+        } else {
             return Status::Corruption("not an sstable (bad magic number)");
         }
 
-        Status status = index_handle_.DecodeFrom(input);
+        Slice handle_input(handles, 2 * BlockHandle::kMaxEncodedLength);
+        Status status = metaindex_handle_.DecodeFrom(&handle_input);
+        if (status.ok()) {
+            status = index_handle_.DecodeFrom(&handle_input);
+        }
 
-        // @todo 为什么还要对input进行这样的处理呢？
+        // footer之后的数据留在input中
         if (status.ok()) {
-            const char *end = magic_ptr + 8;
-            *input = Slice(end, input->data() + input->size() - end);
+            *input = Slice(end, 0);
         }
 
         return status;
     }
 
-    Status ReadBlock(RandomAccessFile *file, const ReadOptions &options,
-                     const BlockHandle &handle, BlockContents *result) {
+    uint32_t ComputeBlockChecksum(ChecksumType checksum_type, const char *data, size_t n, char type) {
+        if (checksum_type == kXXH3) {
+            // type和data不一定连续（写的时候type在单独的trailer里），
+            // 所以不把type一起hash，而是乘上一个奇数常量混进低32位
+            const uint32_t h = static_cast<uint32_t>(XXH3Hash64(data, n));
+            return h ^ (static_cast<uint8_t>(type) * 0x6b9083d9u);
+        }
+        uint32_t crc = crc32c::Value(data, n);
+        crc = crc32c::Extend(crc, &type, 1);
+        return crc32c::Mask(crc);
+    }
+
+    // 校验block
+    // data后面就是type和校验值
+    static bool VerifyBlockChecksum(ChecksumType checksum_type, const char *data, size_t n) {
+        const uint32_t expected = DecodeFixed32(data + n + 1);
+        PERF_TIMER_GUARD(block_checksum_nanos);
+        if (checksum_type == kCRC32c) {
+            // 计算data[0, n]的crc，type和data是连续的，一次算完
+            return crc32c::Unmask(expected) == crc32c::Value(data, n + 1);
+        }
+        return expected == ComputeBlockChecksum(checksum_type, data, n, data[n]);
+    }
+
+    Status DecodeBlockContents(const char *data, size_t n, bool data_is_stable,
+                               const ReadOptions &options, ChecksumType checksum_type,
+                               BlockContents *result, bool keep_compressed) {
         result->data = Slice();
         result->cachable = false;
         result->heap_allocated = false;
+        result->compression_type = kNoCompression;
+        result->compressed.clear();
 
-        // 准备好保存block的空间
-        size_t n = static_cast<size_t>(handle.size());
-        char *buf = new char[n + kBlockTrailerSize];
-
-        Slice contents;
-        // 根据BlockHandle从文件中读取数据到buf
-        // 如果底层用mmap，会把磁盘中的数据映射到content中
-        Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-
-        if(!s.ok()){
-            delete[] buf;
-            return s;
-        }
-
-        if(contents.size() != n + kBlockTrailerSize){
-            delete[] buf;
-            return Status::Corruption("truncated block read");
+        // crc校验
+        if(options.verify_checksums && !VerifyBlockChecksum(checksum_type, data, n)){
+            return Status::Corruption("block checksum mismatch");
         }
 
-        // crc校验
-        const char *data = contents.data();
+        return UncompressBlockContents(data, n, data_is_stable, result, keep_compressed);
+    }
 
-        if(options.verify_checksums){
-            // 读取出crc值，data后面就是type和crc值
-            const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
-            // 计算data[0, n]的crc
-            const uint32_t actual = crc32c::Value(data, n + 1);
-            // 如果校验失败
-            if(actual != crc){
-                delete[] buf;
-                s = Status::Corruption("block checksum mismatch");
-                return s;
-            }
-        }
+    Status UncompressBlockContents(const char *data, size_t n, bool data_is_stable, BlockContents *result,
+                                   bool keep_compressed) {
+        result->data = Slice();
+        result->cachable = false;
+        result->heap_allocated = false;
+        result->compression_type = static_cast<CompressionType>(data[n]);
+        result->compressed.clear();
 
         // 解压缩
         switch (data[n]) {
             case kNoCompression:
-                // 如果两者不相等
-                // 说明读取时调用的是mmap接口
-                if (data != buf){
-                    delete[] buf;
-
+                if (data_is_stable){
                     // 直接从映射的内存中读取数据返回
                     result->data = Slice(data, n);
 
@@ -123,37 +180,166 @@ namespace leveldb {
                     // 下回读取磁盘中同一块区域的数据还能从内存中读取
                     result->heap_allocated = false;
                 }else{
-                    // 返回临时变量中的data数据
-                    result->data = Slice(buf, n);
-                    // 因为buf是临时的，所以需要cache到LRUCache
+                    // data所在的buffer是临时的，拷贝一份
+                    char *copy = new char[n];
+                    memcpy(copy, data, n);
+                    result->data = Slice(copy, n);
                     result->cachable = true;
-
                     result->heap_allocated = true;
                 }
                 break;
-            case kSnappyCompression:{
+            default:{
+                // 其余的type交给注册的Compressor解压
+                const Compressor *compressor = GetCompressor(static_cast<CompressionType>(data[n]));
+                if (compressor == nullptr) {
+                    return Status::Corruption("bad block type");
+                }
+                PERF_TIMER_GUARD(block_decompress_nanos);
+                const Slice input(data, n);
                 size_t ulength = 0;
-                if(!port::Snappy_GetUncompressedLength(contents.data(), contents.size(), &ulength)){
-                    delete[] buf;
+                if (!compressor->GetUncompressedLength(input, &ulength)) {
                     return Status::Corruption("corrupted compressed block contents");
                 }
                 char *ubuf = new char[ulength];
-                if (!port::Snappy_Uncompress(data, n, ubuf)) {
-                    delete[] buf;
+                if (!compressor->Uncompress(input, ubuf)) {
                     delete[] ubuf;
                     return Status::Corruption("corrupted compressed block contents");
                 }
 
-                delete[] buf;
                 result->data = Slice(ubuf, ulength);
                 result->heap_allocated = true;
                 result->cachable = true;
+                if (keep_compressed) {
+                    result->compressed.assign(data, n + 1);
+                }
+                PERF_COUNTER_ADD(block_decompress_count, 1);
+                PERF_COUNTER_ADD(block_decompressed_bytes, ulength);
                 break;
             }
-            default:
-                delete[] buf;
-                return Status::Corruption("bad block type");
         }
         return Status::OK();
     }
+
+    Status DecodeHeapBlockContents(char *buf, size_t n, const ReadOptions &options,
+                                   ChecksumType checksum_type, BlockContents *result,
+                                   bool keep_compressed) {
+        result->data = Slice();
+        result->cachable = false;
+        result->heap_allocated = false;
+        result->compression_type = kNoCompression;
+        result->compressed.clear();
+
+        // 没有压缩，直接把buf交给Block
+        // 因为buf是临时读出来的，所以需要cache到LRUCache
+        if (buf[n] == kNoCompression) {
+            if(options.verify_checksums && !VerifyBlockChecksum(checksum_type, buf, n)){
+                delete[] buf;
+                return Status::Corruption("block checksum mismatch");
+            }
+            result->data = Slice(buf, n);
+            result->cachable = true;
+            result->heap_allocated = true;
+            result->compression_type = kNoCompression;
+            return Status::OK();
+        }
+
+        // 压缩的数据解压到新分配的内存中，buf就用不到了
+        Status s = DecodeBlockContents(buf, n, false, options, checksum_type, result, keep_compressed);
+        delete[] buf;
+        return s;
+    }
+
+    void AlignedBuffer::Reserve(size_t alignment, size_t capacity) {
+        if (data_ != nullptr && capacity_ >= capacity &&
+            (reinterpret_cast<uintptr_t>(data_) & (alignment - 1)) == 0) {
+            return;
+        }
+        delete[] base_;
+        base_ = new char[capacity + alignment - 1];
+        const uintptr_t mask = static_cast<uintptr_t>(alignment - 1);
+        data_ = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(base_) + mask) & ~mask);
+        capacity_ = capacity;
+    }
+
+    void AlignedBuffer::Swap(AlignedBuffer *other) {
+        std::swap(base_, other->base_);
+        std::swap(data_, other->data_);
+        std::swap(capacity_, other->capacity_);
+    }
+
+    Status ReadBlock(RandomAccessFile *file, const ReadOptions &options, ChecksumType checksum_type,
+                     const BlockHandle &handle, BlockContents *result, bool keep_compressed) {
+        result->data = Slice();
+        result->cachable = false;
+        result->heap_allocated = false;
+        result->compression_type = kNoCompression;
+        result->compressed.clear();
+
+        size_t n = static_cast<size_t>(handle.size());
+
+        // 文件要求对齐（比如direct I/O）时，按对齐的范围直接读到对齐的buffer中，
+        // 数据在buffer中间，解析完就释放buffer
+        const size_t alignment = file->IsMemoryMapped() ? 1 : file->GetRequiredBufferAlignment();
+        if (alignment > 1) {
+            uint64_t read_offset = handle.offset();
+            size_t read_len = n + kBlockTrailerSize;
+            AlignReadRange(alignment, &read_offset, &read_len);
+            AlignedBuffer aligned;
+            aligned.Reserve(alignment, read_len);
+            Slice contents;
+            Status s;
+            {
+                PERF_TIMER_GUARD(block_read_nanos);
+                s = file->Read(read_offset, read_len, &contents, aligned.data());
+            }
+            PERF_COUNTER_ADD(block_read_count, 1);
+            PERF_COUNTER_ADD(block_read_bytes, contents.size());
+            if (!s.ok()) {
+                return s;
+            }
+            const size_t skip = static_cast<size_t>(handle.offset() - read_offset);
+            if (contents.size() < skip + n + kBlockTrailerSize) {
+                return Status::Corruption("truncated block read");
+            }
+            return DecodeBlockContents(contents.data() + skip, n, false, options, checksum_type, result,
+                                       keep_compressed);
+        }
+
+        // 准备好保存block的空间
+        // 如果底层用mmap，Read()直接返回映射区域中的数据，根本用不到buf，
+        // 这时就不分配buf了，省去每次读取block的一次malloc/free
+        char *buf = file->IsMemoryMapped() ? nullptr : new char[n + kBlockTrailerSize];
+
+        Slice contents;
+        // 根据BlockHandle从文件中读取数据到buf
+        // 如果底层用mmap，会把磁盘中的数据映射到content中
+        Status s;
+        {
+            PERF_TIMER_GUARD(block_read_nanos);
+            s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+        }
+        PERF_COUNTER_ADD(block_read_count, 1);
+        PERF_COUNTER_ADD(block_read_bytes, contents.size());
+
+        if(!s.ok()){
+            delete[] buf;
+            return s;
+        }
+
+        if(contents.size() != n + kBlockTrailerSize){
+            delete[] buf;
+            return Status::Corruption("truncated block read");
+        }
+
+        const char *data = contents.data();
+
+        // 数据读到了buf中，交给DecodeHeapBlockContents，未压缩时不用再拷贝一次
+        if (data == buf) {
+            return DecodeHeapBlockContents(buf, n, options, checksum_type, result, keep_compressed);
+        }
+
+        s = DecodeBlockContents(data, n, true, options, checksum_type, result, keep_compressed);
+        delete[] buf;
+        return s;
+    }
 }
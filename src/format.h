@@ -41,13 +41,31 @@ namespace leveldb {
 
     class Footer {
     public:
-        // 一个index block handle加上padding是BlockHandle::kMaxEncodedLength
+        // 最初的格式只有index block handle，加上padding是BlockHandle::kMaxEncodedLength，magic number是kTableMagicNumber
+        // 现在的格式是metaindex block handle和index block handle，加上padding是2 * BlockHandle::kMaxEncodedLength，
+        // magic number是kTableMagicNumberV1
         // magic number为uint64_t，8Byte
+        // 校验类型不是crc32c时，footer最前面再多一个字节的ChecksumType，magic number换成kTableMagicNumberV2
         enum {
-            kEncodedLength = BlockHandle::kMaxEncodedLength + 8
+            kOriginalEncodedLength = BlockHandle::kMaxEncodedLength + 8,
+            kLegacyEncodedLength = 2 * BlockHandle::kMaxEncodedLength + 8,
+            kMaxEncodedLength = kLegacyEncodedLength + 1
         };
 
-        Footer() = default;
+        Footer() : checksum_type_(kCRC32c), has_metaindex_(true) {}
+
+        // block trailer中校验值的类型
+        void set_checksum_type(ChecksumType type) { checksum_type_ = type; }
+
+        ChecksumType checksum_type() const { return checksum_type_; }
+
+        // metaindex block保存了filter block等meta block的名字和handle
+        void set_metaindex_handle(const BlockHandle &h) { metaindex_handle_ = h; }
+
+        BlockHandle metaindex_handle() const { return metaindex_handle_; }
+
+        // 最初格式的table没有metaindex block，也就没有filter，index只有一个block
+        bool has_metaindex() const { return has_metaindex_; }
 
         void set_index_handle(const BlockHandle &index_handle) { index_handle_ = index_handle; }
 
@@ -58,25 +76,132 @@ namespace leveldb {
         Status DecodeFrom(Slice *input);
 
     private:
+        ChecksumType checksum_type_;
+        bool has_metaindex_;
+        BlockHandle metaindex_handle_;
         BlockHandle index_handle_;
     };
 
     // kTableMagicNumber was picked by running
     //    echo http://code.google.com/p/leveldb/ | sha1sum
     // and taking the leading 64 bits.
+    // 只有最初格式的footer用这个magic number
     static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+    // 带有metaindex block handle的footer用这个magic number，
+    // 和最初的格式区分开，老版本读到这种table会报bad magic number
+    static const uint64_t kTableMagicNumberV1 = 0xe4a93c7b15d06f28ull;
+
+    // footer中带有ChecksumType字节的table用这个magic number，
+    // 老版本读到这种table会报bad magic number，而不是报所有block校验失败
+    static const uint64_t kTableMagicNumberV2 = 0x6c3a91e4d05f27b9ull;
+
     // 1Byte的type加上4Byte的CRC校验值
     static const size_t kBlockTrailerSize = 5;
 
+    // Options::block_alignment的上限，也就是data block之前padding的上限
+    // 读取时间隔小于这个值的两个block当作首尾相接，见Table::ScanState和Table::MultiGet
+    static const uint64_t kMaxBlockAlignment = 4 * 1024;
+
+    // block末尾的restart point个数的最高位为1时，restart point数组之后还有一个hash index：
+    //    bucket[0, num_buckets) : 每个bucket 1Byte，是key hash到这里的组（restart point）的下标
+    //    num_buckets : uint16
+    //    num_restarts | kBlockHashIndexFlag : uint32
+    static const uint32_t kBlockHashIndexFlag = 1u << 31;
+    // bucket中没有key
+    static const uint8_t kBlockHashNoEntry = 255;
+    // 多个组的key hash到了同一个bucket，只能退回二分查找
+    static const uint8_t kBlockHashCollision = 254;
+    // 组的下标要能放进一个bucket，组太多的block不写hash index
+    static const uint32_t kBlockHashMaxRestarts = 253;
+    static const uint32_t kBlockHashSeed = 0x9d2c5680;
+
+    // metaindex block中记录index类型的key，值是一个字节的IndexType
+    // 没有这个key的table只有一个index block
+    static const char kIndexTypeMetaKey[] = "index.type";
+
+    enum IndexType : unsigned char {
+        // footer中的index handle指向唯一的index block
+        kSingleLevelIndex = 0x0,
+        // index被切分成多个分区block，footer中的index handle指向顶层index，
+        // 顶层index的每个entry是：分区中最后一个key -> 分区的handle
+        kPartitionedIndex = 0x1
+    };
+
     struct BlockContents {
         Slice data;
         bool cachable;
         bool heap_allocated;
+        // block在文件中的压缩类型，data已经是解压之后的数据
+        CompressionType compression_type;
+        // 压缩过的block在文件中的原始数据：block内容 + 1Byte的type，和从磁盘读出来的一样
+        // 只有解码时传入了keep_compressed并且block是压缩过的才有，否则为空
+        std::string compressed;
+    };
+
+    // 计算block trailer中保存的校验值：data[0, n)是block内容，type是压缩类型
+    // kCRC32c是masked crc32c(data + type)
+    // kXXH3是XXH3-64(data)的低32位，再和type混合
+    uint32_t ComputeBlockChecksum(ChecksumType checksum_type, const char *data, size_t n, char type);
+
+    // 按RandomAccessFile::GetRequiredBufferAlignment()对齐的读取buffer
+    // alignment必须是2的幂，为1时和new char[]一样
+    class AlignedBuffer {
+    public:
+        AlignedBuffer() : base_(nullptr), data_(nullptr), capacity_(0) {}
+
+        AlignedBuffer(const AlignedBuffer &) = delete;
+
+        AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+        ~AlignedBuffer() { delete[] base_; }
+
+        // 保证data()至少有capacity字节并且按alignment对齐，空间不够时重新分配，不保留原来的数据
+        void Reserve(size_t alignment, size_t capacity);
+
+        char *data() const { return data_; }
+
+        void Swap(AlignedBuffer *other);
+
+    private:
+        char *base_;  // new[]分配的内存，data_是其中对齐的位置
+        char *data_;
+        size_t capacity_;
     };
 
-    Status ReadBlock(RandomAccessFile *file, const ReadOptions &options,
-                     const BlockHandle &handle, BlockContents *result);
+    // 把读取的范围[*offset, *offset + *n)扩大到alignment的边界
+    // 用对齐的范围和AlignedBuffer读取，direct I/O的文件就能直接读进buffer，不用经过自己的bounce buffer再拷贝一次
+    inline void AlignReadRange(size_t alignment, uint64_t *offset, size_t *n) {
+        const uint64_t mask = static_cast<uint64_t>(alignment - 1);
+        const uint64_t end = (*offset + *n + mask) & ~mask;
+        *offset &= ~mask;
+        *n = static_cast<size_t>(end - *offset);
+    }
+
+    // checksum_type来自table的footer
+    // keep_compressed为true时，压缩过的block把原始数据保存到result->compressed
+    Status ReadBlock(RandomAccessFile *file, const ReadOptions &options, ChecksumType checksum_type,
+                     const BlockHandle &handle, BlockContents *result, bool keep_compressed = false);
+
+    // data[0, n + kBlockTrailerSize)是一个block的原始数据：block内容 + type + 校验值
+    // 校验（如果需要的话）并按照type解压缩，结果保存到result
+    //
+    // data_is_stable为true时，data在文件的生命周期内都有效（比如mmap映射的内存），
+    // 未压缩的block直接引用data；否则data所在的buffer是临时的，未压缩的block要拷贝一份
+    Status DecodeBlockContents(const char *data, size_t n, bool data_is_stable,
+                               const ReadOptions &options, ChecksumType checksum_type,
+                               BlockContents *result, bool keep_compressed = false);
+
+    // data[0, n + 1)是block内容 + type，不做校验，只按照type解压缩
+    // 用于从compressed block cache中取出的、已经校验过的数据
+    Status UncompressBlockContents(const char *data, size_t n, bool data_is_stable, BlockContents *result,
+                                   bool keep_compressed = false);
+
+    // 和DecodeBlockContents一样，但buf是new[]分配的、临时读出来的数据，由这个函数接管
+    // 未压缩的block直接使用buf，省去一次拷贝；否则解压后释放buf
+    Status DecodeHeapBlockContents(char *buf, size_t n, const ReadOptions &options,
+                                   ChecksumType checksum_type, BlockContents *result,
+                                   bool keep_compressed = false);
 }
 
 
@@ -0,0 +1,96 @@
+#ifndef SSTABLE_ITERATOR_WRAPPER_H
+#define SSTABLE_ITERATOR_WRAPPER_H
+
+#include <cassert>
+
+#include "../include/iterator.h"
+#include "slice.h"
+
+namespace leveldb {
+    // 包装一个Iterator，缓存它的Valid()和key()
+    // 避免每次调用都经过虚函数，也提高了cache局部性
+    class IteratorWrapper {
+    public:
+        IteratorWrapper() : iter_(nullptr), valid_(false) {}
+
+        explicit IteratorWrapper(Iterator *iter) : iter_(nullptr) { Set(iter); }
+
+        ~IteratorWrapper() { delete iter_; }
+
+        Iterator *iter() const { return iter_; }
+
+        // 接管iter的所有权，释放原来的迭代器
+        void Set(Iterator *iter) {
+            delete iter_;
+            iter_ = iter;
+            if (iter_ == nullptr) {
+                valid_ = false;
+            } else {
+                Update();
+            }
+        }
+
+        // Iterator interface methods
+        bool Valid() const { return valid_; }
+
+        Slice key() const {
+            assert(Valid());
+            return key_;
+        }
+
+        Slice value() const {
+            assert(Valid());
+            return iter_->value();
+        }
+
+        // Methods below require iter() != nullptr
+        Status status() const {
+            assert(iter_);
+            return iter_->status();
+        }
+
+        void Next() {
+            assert(iter_);
+            iter_->Next();
+            Update();
+        }
+
+        void Prev() {
+            assert(iter_);
+            iter_->Prev();
+            Update();
+        }
+
+        void Seek(const Slice &k) {
+            assert(iter_);
+            iter_->Seek(k);
+            Update();
+        }
+
+        void SeekToFirst() {
+            assert(iter_);
+            iter_->SeekToFirst();
+            Update();
+        }
+
+        void SeekToLast() {
+            assert(iter_);
+            iter_->SeekToLast();
+            Update();
+        }
+
+    private:
+        void Update() {
+            valid_ = iter_->Valid();
+            if (valid_) {
+                key_ = iter_->key();
+            }
+        }
+
+        Iterator *iter_;
+        bool valid_;
+        Slice key_;
+    };
+}
+
+#endif //SSTABLE_ITERATOR_WRAPPER_H
@@ -1,10 +1,27 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <random>
 #include "block_builder.h"
 #include "block.h"
+#include "bulk_loader.h"
+#include "cache.h"
+#include "compressor.h"
+#include "filter_policy.h"
+#include "io_stats_env.h"
+#include "merger.h"
+#include "perf_context.h"
+#include "statistics.h"
 #include "snappy.h"
 #include "table.h"
 #include "string"
+#include "../port/crc32c_sse42.h"
+#include "../util/crc32c.h"
+#include "../util/hash.h"
 
 #define OS "Linux"
 #define KV_NUM 160 * 160
@@ -26,6 +43,52 @@ std::string value = "value";
 
 int get_quene[KV_NUM];
 
+// 编译时不一定有snappy等压缩库，测试压缩相关的功能时用这个注册在未使用的类型上的游程编码
+const leveldb::CompressionType kTestCompression = static_cast<leveldb::CompressionType>(0x40);
+
+// 4Byte的原长度，之后每两个字节是一段连续相同的字符：段长(1~255) + 字符
+class RunLengthCompressor : public leveldb::Compressor {
+public:
+    leveldb::CompressionType type() const override { return kTestCompression; }
+
+    const char *Name() const override { return "test.RunLength"; }
+
+    bool Compress(const leveldb::Options & /*options*/, const leveldb::Slice &input,
+                  std::string *output) const override {
+        output->clear();
+        leveldb::PutFixed32(output, static_cast<uint32_t>(input.size()));
+        for (size_t i = 0; i < input.size();) {
+            size_t j = i;
+            while (j < input.size() && input[j] == input[i] && j - i < 255) {
+                j++;
+            }
+            output->push_back(static_cast<char>(j - i));
+            output->push_back(input[i]);
+            i = j;
+        }
+        return true;
+    }
+
+    bool GetUncompressedLength(const leveldb::Slice &input, size_t *length) const override {
+        if (input.size() < 4 || input.size() % 2 != 0) {
+            return false;
+        }
+        *length = leveldb::DecodeFixed32(input.data());
+        return true;
+    }
+
+    bool Uncompress(const leveldb::Slice &input, char *output) const override {
+        for (size_t i = 4; i < input.size(); i += 2) {
+            const size_t n = static_cast<unsigned char>(input[i]);
+            memset(output, input[i + 1], n);
+            output += n;
+        }
+        return true;
+    }
+};
+
+RunLengthCompressor run_length_compressor;
+
 // 如果有报错，就显示出来
 void check_status(const leveldb::Status &s) {
     if (!s.ok()) {
@@ -97,6 +160,7 @@ void init() {
     init_get_quene();
     init_config();
     init_test_case();
+    leveldb::RegisterCompressor(&run_length_compressor);
 }
 
 // 根据index取test_case中取数，追加到head后面
@@ -163,7 +227,1509 @@ void test_block_read() {
         table->InternalGet(readOptions, add_number_to_slice("key", get_quene[i]), kv_handler);
     }
 
-    printf("All test passed\n");
+}
+
+// 用迭代器顺序遍历整个SSTable，kv对的顺序应该和test_case一致
+void test_table_scan() {
+    leveldb::Table *table = nullptr;
+
+    uint64_t size;
+    env->GetFileSize(path, &size);
+    s = leveldb::Table::Open(options, randomAccessFile, size, &table);
+    check_status(s);
+
+    leveldb::Iterator *iter = table->NewIterator(readOptions);
+
+    int i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        assert(iter->key().ToString() == key + test_case[i]);
+        kv_handler(iter->key(), iter->value());
+        i++;
+    }
+    assert(i == KV_NUM);
+    check_status(iter->status());
+
+    // 反向遍历
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+        i--;
+        assert(iter->key().ToString() == key + test_case[i]);
+    }
+    assert(i == 0);
+
+    delete iter;
+}
+
+// 新增的测试把文件写在Env的测试目录下
+std::string test_file(const std::string &name) {
+    std::string dir;
+    check_status(env->GetTestDirectory(&dir));
+    return dir + "/" + name;
+}
+
+// 用options写一个包含所有test_case的SSTable
+void write_test_table(const leveldb::Options &table_options, const std::string &fname) {
+    leveldb::WritableFile *out;
+    check_status(env->NewWritableFile(fname, &out));
+    {
+        leveldb::TableBuilder builder(table_options, out);
+        for (int i = 0; i < KV_NUM; ++i) {
+            // add_number_to_slice返回的Slice指向已经析构的临时string，这里保存好再Add
+            const std::string k = key + test_case[i];
+            const std::string v = value + test_case[i];
+            builder.Add(k, v);
+        }
+        check_status(builder.Finish());
+    }
+    check_status(out->Close());
+    delete out;
+}
+
+// 打开fname并顺序遍历，返回遍历结束时的状态
+leveldb::Status scan_test_table(const std::string &fname, int *count) {
+    leveldb::RandomAccessFile *in;
+    check_status(env->NewRandomAccessFile(fname, &in));
+    uint64_t size;
+    check_status(env->GetFileSize(fname, &size));
+    leveldb::Table *table = nullptr;
+    leveldb::Status status = leveldb::Table::Open(options, in, size, &table);
+    *count = 0;
+    if (status.ok()) {
+        leveldb::Iterator *iter = table->NewIterator(readOptions);
+        // 校验失败的block会被跳过，迭代器继续输出后面的block，所以出错之后就停下来
+        for (iter->SeekToFirst(); iter->Valid() && iter->status().ok(); iter->Next()) {
+            assert(iter->key().ToString() == key + test_case[*count]);
+            kv_handler(iter->key(), iter->value());
+            (*count)++;
+        }
+        status = iter->status();
+        delete iter;
+        delete table;
+    }
+    delete in;
+    return status;
+}
+
+// InternalGet把第一个 >= 查询key的kv对交给handle_result，lookup_handler记录下来
+bool lookup_called = false;
+std::string lookup_result_key;
+std::string lookup_result_value;
+
+void lookup_handler(const leveldb::Slice &key, const leveldb::Slice &value) {
+    lookup_called = true;
+    lookup_result_key = key.ToString();
+    lookup_result_value = value.ToString();
+    kv_handler(key, value);
+}
+
+// 用InternalGet查询k，返回是否找到了k
+bool table_get(leveldb::Table *table, const leveldb::ReadOptions &read_options, const std::string &k) {
+    lookup_called = false;
+    check_status(table->InternalGet(read_options, k, lookup_handler));
+    return lookup_called && lookup_result_key == k;
+}
+
+// 解析table文件contents的footer和index block，返回所有data block的handle
+// 要求index block没有压缩，也没有分区
+std::vector<leveldb::BlockHandle> read_data_block_handles(const std::string &contents) {
+    leveldb::Slice footer_input(contents);
+    leveldb::Footer footer;
+    check_status(footer.DecodeFrom(&footer_input));
+    const leveldb::BlockHandle index_handle = footer.index_handle();
+    leveldb::BlockContents index_contents;
+    index_contents.data = leveldb::Slice(contents.data() + index_handle.offset(), index_handle.size());
+    index_contents.cachable = false;
+    index_contents.heap_allocated = false;
+    index_contents.compression_type = leveldb::kNoCompression;
+    leveldb::Block index_block(index_contents);
+
+    std::vector<leveldb::BlockHandle> handles;
+    leveldb::Iterator *iter = index_block.NewIterator(options.comparator);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        leveldb::Slice input = iter->value();
+        leveldb::BlockHandle handle;
+        check_status(handle.DecodeFrom(&input));
+        handles.push_back(handle);
+    }
+    check_status(iter->status());
+    delete iter;
+    return handles;
+}
+
+// 两种校验类型的table都能重新打开读取，footer分别是48字节(crc32c)和49字节(xxh3)的格式
+// data block中改动一个字节之后，两种校验类型都要报告corruption
+void test_checksum_types() {
+    const leveldb::ChecksumType types[] = {leveldb::kCRC32c, leveldb::kXXH3};
+    for (leveldb::ChecksumType type : types) {
+        leveldb::Options table_options = options;
+        table_options.checksum = type;
+        table_options.compression = leveldb::kNoCompression;
+        const std::string fname = test_file(type == leveldb::kCRC32c ? "checksum_crc32c.sst" : "checksum_xxh3.sst");
+        write_test_table(table_options, fname);
+
+        std::string contents;
+        check_status(leveldb::ReadFileToString(env, fname, &contents));
+        const uint64_t magic = leveldb::DecodeFixed64(contents.data() + contents.size() - 8);
+        if (type == leveldb::kCRC32c) {
+            assert(magic == leveldb::kTableMagicNumberV1);
+        } else {
+            assert(magic == leveldb::kTableMagicNumberV2);
+            const size_t type_offset = contents.size() - leveldb::Footer::kMaxEncodedLength;
+            assert(contents[type_offset] == static_cast<char>(leveldb::kXXH3));
+        }
+        (void) magic;
+
+        int count;
+        check_status(scan_test_table(fname, &count));
+        assert(count == KV_NUM);
+
+        // 第一个data block从偏移量0开始
+        contents[10] ^= 0x1;
+        check_status(leveldb::WriteStringToFile(env, contents, fname));
+        leveldb::Status status = scan_test_table(fname, &count);
+        assert(status.IsCorruption());
+        (void) status;
+
+        env->RemoveFile(fname);
+    }
+}
+
+// 检查归并迭代器当前的kv对是不是参照结果中的第pos个，value中记录了key来自哪个child
+void check_merged_entry(leveldb::Iterator *iter, const std::vector<std::pair<std::string, int>> &expected, int pos) {
+    assert(pos >= 0 && pos < static_cast<int>(expected.size()));
+    assert(iter->Valid());
+    assert(iter->key().ToString() == expected[pos].first);
+    assert(iter->value().ToString() == std::to_string(expected[pos].second));
+}
+
+// 参照结果中第一个 >= target的位置，相同的key从下标小的child开始
+int merged_lower_bound(const std::vector<std::pair<std::string, int>> &expected, const std::string &target) {
+    return static_cast<int>(std::lower_bound(expected.begin(), expected.end(), std::make_pair(target, -1)) -
+                            expected.begin());
+}
+
+// 用BlockBuilder写几个key大量重叠的block作为children，NewMergingIterator归并之后
+// 和把所有kv对按(key, child下标)排好序的参照结果比较
+// 正向遍历时相同的key下标小的child先输出，反向遍历时相反，所以Next/Prev总是在参照结果中前进/后退一个位置，
+// 随机地交替Next、Prev、Seek可以覆盖改变方向时相同key的处理
+void test_merging_iterator() {
+    const int kChildren = 6;
+    const int kKeys = 2000;
+    std::mt19937 rnd(301);
+    std::vector<std::string> block_data(kChildren);
+    std::vector<leveldb::Block *> blocks;
+    std::vector<std::pair<std::string, int>> expected;
+    for (int c = 0; c < kChildren; c++) {
+        leveldb::BlockBuilder builder(&options);
+        // 最后一个child是空的
+        for (int i = 0; i < kKeys && c != kChildren - 1; i++) {
+            if (i % (c + 1) == 0 || rnd() % 3 == 0) {
+                const std::string k = key + test_case[i];
+                builder.Add(k, std::to_string(c));
+                expected.emplace_back(k, c);
+            }
+        }
+        block_data[c] = builder.Finish().ToString();
+        leveldb::BlockContents contents;
+        contents.data = block_data[c];
+        contents.cachable = false;
+        contents.heap_allocated = false;
+        contents.compression_type = leveldb::kNoCompression;
+        blocks.push_back(new leveldb::Block(contents));
+    }
+    std::sort(expected.begin(), expected.end());
+    const int total = static_cast<int>(expected.size());
+
+    std::vector<leveldb::Iterator *> children;
+    for (leveldb::Block *block : blocks) {
+        children.push_back(block->NewIterator(options.comparator));
+    }
+    leveldb::Iterator *iter = leveldb::NewMergingIterator(options.comparator, children.data(), kChildren);
+
+    // 正向遍历
+    int pos = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        check_merged_entry(iter, expected, pos++);
+    }
+    assert(pos == total);
+
+    // 反向遍历
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+        check_merged_entry(iter, expected, --pos);
+    }
+    assert(pos == 0);
+
+    // 随机走动，无效之后重新定位
+    iter->SeekToFirst();
+    pos = 0;
+    for (int step = 0; step < 100000; step++) {
+        const int op = static_cast<int>(rnd() % 20);
+        if (iter->Valid() && op < 9) {
+            iter->Next();
+            pos++;
+        } else if (iter->Valid() && op < 18) {
+            iter->Prev();
+            pos--;
+        } else if (op == 18) {
+            // 已有的key、两个key之间、所有key之前、所有key之后
+            std::string target;
+            switch (rnd() % 4) {
+                case 0:
+                    target = expected[rnd() % total].first;
+                    break;
+                case 1:
+                    target = expected[rnd() % total].first + "0";
+                    break;
+                case 2:
+                    target = "a";
+                    break;
+                default:
+                    target = "z";
+                    break;
+            }
+            iter->Seek(target);
+            pos = merged_lower_bound(expected, target);
+        } else if (rnd() % 2 == 0) {
+            iter->SeekToFirst();
+            pos = 0;
+        } else {
+            iter->SeekToLast();
+            pos = total - 1;
+        }
+
+        if (pos < 0 || pos >= total) {
+            assert(!iter->Valid());
+            iter->SeekToFirst();
+            pos = 0;
+        }
+        check_merged_entry(iter, expected, pos);
+    }
+    check_status(iter->status());
+
+    delete iter;
+    for (leveldb::Block *block : blocks) {
+        delete block;
+    }
+}
+
+// dir下除了.和..之外的文件数
+int count_files(const std::string &dir) {
+    std::vector<std::string> children;
+    check_status(env->GetChildren(dir, &children));
+    int count = 0;
+    for (const std::string &child : children) {
+        if (child != "." && child != "..") {
+            count++;
+        }
+    }
+    return count;
+}
+
+// 乱序、有大量重复key的kv对交给BulkLoader，输出的table按顺序拼起来应该和std::map的结果一样，相同的key保留最后一次的value
+// memory_budget很小，会写出很多个run，max_merge_width为2时最后一趟归并之前要先用ReduceRuns分组归并
+// merge_threads个线程各自归并一段key范围，max_file_size很小，每段都会切成多个文件
+// Finish之后temp_dir中不能留下临时文件
+void test_bulk_loader() {
+    const int kAdds = 30000;
+    const int kDistinctKeys = 3000;
+    const std::string temp_dir = test_file("bulkload_tmp");
+    env->CreateDir(temp_dir);
+    assert(count_files(temp_dir) == 0);
+
+    leveldb::Options table_options = options;
+    table_options.max_file_size = 16 * 1024;
+    leveldb::BulkLoadOptions load_options;
+    load_options.temp_dir = temp_dir;
+    load_options.output_prefix = test_file("bulkload-");
+    load_options.memory_budget = 64 * 1024;
+    load_options.sort_threads = 2;
+    load_options.merge_threads = 4;
+    load_options.max_merge_width = 2;
+    load_options.run_block_size = 4096;
+
+    std::map<std::string, std::string> expected;
+    std::vector<std::string> files;
+    uint64_t num_runs;
+    {
+        leveldb::BulkLoader loader(table_options, load_options);
+        std::mt19937 rnd(301);
+        for (int i = 0; i < kAdds; i++) {
+            const std::string k = key + test_case[rnd() % kDistinctKeys];
+            const std::string v = value + std::to_string(i);
+            expected[k] = v;
+            check_status(loader.Add(k, v));
+        }
+        check_status(loader.Finish(&files));
+        num_runs = loader.NumRuns();
+    }
+    // 初始的run超过max_merge_width个，ReduceRuns又写出了中间的run
+    assert(num_runs > 2 * static_cast<uint64_t>(load_options.max_merge_width));
+    assert(files.size() > static_cast<size_t>(load_options.merge_threads));
+    assert(count_files(temp_dir) == 0);
+    (void) num_runs;
+
+    std::map<std::string, std::string>::const_iterator next = expected.begin();
+    for (const std::string &fname : files) {
+        leveldb::RandomAccessFile *in;
+        check_status(env->NewRandomAccessFile(fname, &in));
+        uint64_t size;
+        check_status(env->GetFileSize(fname, &size));
+        leveldb::Table *table = nullptr;
+        check_status(leveldb::Table::Open(table_options, in, size, &table));
+        leveldb::Iterator *iter = table->NewIterator(readOptions);
+        int count = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            assert(next != expected.end());
+            assert(iter->key().ToString() == next->first);
+            assert(iter->value().ToString() == next->second);
+            ++next;
+            count++;
+        }
+        assert(count > 0);
+        check_status(iter->status());
+        delete iter;
+        delete table;
+        delete in;
+        env->RemoveFile(fname);
+    }
+    assert(next == expected.end());
+    env->RemoveDir(temp_dir);
+}
+
+// block_alignment为4096时，每个data block跨过的对齐单位数都是最少的，不超过4096字节的block不跨边界
+// 用direct I/O的Env读取时，遍历和点查的结果都要正确
+// 超过kMaxBlockAlignment的对齐单位会被TableBuilder拒绝
+void test_block_alignment() {
+    const uint64_t kAlignment = 4096;
+    leveldb::Options table_options = options;
+    table_options.block_alignment = kAlignment;
+    table_options.block_size = 3000;
+    table_options.compression = leveldb::kNoCompression;
+    const std::string fname = test_file("aligned.sst");
+    write_test_table(table_options, fname);
+
+    std::string contents;
+    check_status(leveldb::ReadFileToString(env, fname, &contents));
+    const std::vector<leveldb::BlockHandle> handles = read_data_block_handles(contents);
+    assert(handles.size() > 2);
+    uint64_t end = 0;
+    int padded = 0;
+    for (const leveldb::BlockHandle &handle : handles) {
+        const uint64_t n = handle.size() + leveldb::kBlockTrailerSize;
+        const uint64_t first_unit = handle.offset() / kAlignment;
+        const uint64_t last_unit = (handle.offset() + n - 1) / kAlignment;
+        assert(last_unit - first_unit + 1 == (n + kAlignment - 1) / kAlignment);
+        // padding不到一个对齐单位
+        assert(handle.offset() >= end && handle.offset() - end < kAlignment);
+        if (handle.offset() != end) {
+            padded++;
+        }
+        end = handle.offset() + n;
+        (void) first_unit;
+        (void) last_unit;
+    }
+    assert(padded > 0);
+    (void) padded;
+
+    leveldb::Env *direct_env = leveldb::NewDirectIOEnv(env);
+    leveldb::RandomAccessFile *in;
+    check_status(direct_env->NewRandomAccessFile(fname, &in));
+    leveldb::Table *table = nullptr;
+    check_status(leveldb::Table::Open(table_options, in, contents.size(), &table));
+
+    leveldb::Iterator *iter = table->NewIterator(readOptions);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        assert(iter->key().ToString() == key + test_case[count]);
+        kv_handler(iter->key(), iter->value());
+        count++;
+    }
+    assert(count == KV_NUM);
+    check_status(iter->status());
+    delete iter;
+
+    for (int i = 0; i < KV_NUM; i += 7) {
+        const bool found = table_get(table, readOptions, key + test_case[get_quene[i]]);
+        assert(found);
+        (void) found;
+    }
+
+    delete table;
+    delete in;
+    delete direct_env;
+    env->RemoveFile(fname);
+
+    table_options.block_alignment = 2 * leveldb::kMaxBlockAlignment;
+    leveldb::WritableFile *out;
+    check_status(env->NewWritableFile(fname, &out));
+    {
+        leveldb::TableBuilder builder(table_options, out);
+        builder.Add(key, value);
+        leveldb::Status status = builder.Finish();
+        assert(status.IsInvalidArgument());
+        (void) status;
+    }
+    delete out;
+    env->RemoveFile(fname);
+}
+
+// 打开fname，读取通过Env::NewRandomAccessFile得到的file，table和file都由调用者删除
+leveldb::Table *open_test_table(const leveldb::Options &table_options, const std::string &fname,
+                                leveldb::RandomAccessFile **file) {
+    check_status(env->NewRandomAccessFile(fname, file));
+    uint64_t size;
+    check_status(env->GetFileSize(fname, &size));
+    leveldb::Table *table = nullptr;
+    check_status(leveldb::Table::Open(table_options, *file, size, &table));
+    return table;
+}
+
+// 顺序遍历table，检查所有的kv对
+void check_table_scan(leveldb::Table *table, const leveldb::ReadOptions &read_options) {
+    leveldb::Iterator *iter = table->NewIterator(read_options);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        assert(iter->key().ToString() == key + test_case[count]);
+        kv_handler(iter->key(), iter->value());
+        count++;
+    }
+    assert(count == KV_NUM);
+    check_status(iter->status());
+    delete iter;
+}
+
+// block_cache很小，第一次遍历时被淘汰的压缩block降级到compressed_block_cache，
+// 第二次遍历时只有没压缩的block需要重新读文件，其余都由两层cache提供
+// fill_cache为false时两层cache都不变
+// block_cache和compressed_block_cache是同一个cache时Table::Open报错
+void test_compressed_block_cache() {
+    leveldb::Statistics *stats = leveldb::NewStatistics();
+    leveldb::Options table_options = options;
+    table_options.compression = kTestCompression;
+    table_options.statistics = stats;
+    const std::string fname = test_file("compressed_cache.sst");
+    write_test_table(table_options, fname);
+    const uint64_t raw_blocks = stats->GetTickerCount(leveldb::kBlockCompressionRejected);
+    assert(stats->GetTickerCount(leveldb::kBlockCompressed) > raw_blocks);
+    stats->Reset();
+
+    leveldb::Cache *block_cache = leveldb::NewLRUCache(64 * 1024);
+    leveldb::Cache *compressed_cache = leveldb::NewLRUCache(8 * 1024 * 1024);
+    table_options.block_cache = block_cache;
+    table_options.compressed_block_cache = block_cache;
+
+    leveldb::RandomAccessFile *in;
+    check_status(env->NewRandomAccessFile(fname, &in));
+    uint64_t size;
+    check_status(env->GetFileSize(fname, &size));
+    leveldb::Table *table = nullptr;
+    leveldb::Status status = leveldb::Table::Open(table_options, in, size, &table);
+    assert(status.IsInvalidArgument());
+    (void) status;
+    delete in;
+
+    table_options.compressed_block_cache = compressed_cache;
+    table = open_test_table(table_options, fname, &in);
+    check_table_scan(table, readOptions);
+    assert(stats->GetTickerCount(leveldb::kBlockRead) > 0);
+    assert(stats->GetTickerCount(leveldb::kCompressedBlockCacheHit) == 0);
+    assert(compressed_cache->TotalCharge() > 0);
+
+    stats->Reset();
+    check_table_scan(table, readOptions);
+    // 压缩之后节省不到1/8的block以原始数据保存，淘汰之后不会降级，只有它们需要重新读文件
+    assert(stats->GetTickerCount(leveldb::kBlockRead) <= raw_blocks);
+    assert(stats->GetTickerCount(leveldb::kCompressedBlockCacheHit) > 0);
+
+    leveldb::ReadOptions no_fill = readOptions;
+    no_fill.fill_cache = false;
+    const size_t block_charge = block_cache->TotalCharge();
+    const size_t compressed_charge = compressed_cache->TotalCharge();
+    check_table_scan(table, no_fill);
+    assert(block_cache->TotalCharge() == block_charge);
+    assert(compressed_cache->TotalCharge() == compressed_charge);
+    (void) raw_blocks;
+    (void) block_charge;
+    (void) compressed_charge;
+
+    delete table;
+    delete in;
+    // block_cache删除时剩下的block降级到compressed_block_cache，所以要先删除
+    delete block_cache;
+    delete compressed_cache;
+    delete stats;
+    env->RemoveFile(fname);
+}
+
+// 线程池测试中的任务共享的状态
+struct PoolTaskState {
+    std::mutex mu;
+    std::condition_variable cv;
+    int running = 0;
+    int max_running = 0;
+    int finished = 0;
+    // gate_open为true之后任务才结束，同时执行的任务数达到wait_running时自动设为true
+    int wait_running = 0;
+    bool gate_open = false;
+};
+
+// 任务最多阻塞这么久，线程池的行为不对时测试会失败而不是卡住
+const std::chrono::seconds kPoolTaskTimeout(10);
+
+void blocking_pool_task(void *arg) {
+    PoolTaskState *state = reinterpret_cast<PoolTaskState *>(arg);
+    std::unique_lock<std::mutex> l(state->mu);
+    state->running++;
+    state->max_running = std::max(state->max_running, state->running);
+    if (state->wait_running > 0 && state->running >= state->wait_running) {
+        state->gate_open = true;
+    }
+    state->cv.notify_all();
+    state->cv.wait_for(l, kPoolTaskTimeout, [state] { return state->gate_open; });
+    state->running--;
+    state->finished++;
+    state->cv.notify_all();
+}
+
+// 等待state中结束的任务达到n个
+bool wait_pool_tasks(PoolTaskState *state, int n) {
+    std::unique_lock<std::mutex> l(state->mu);
+    return state->cv.wait_for(l, kPoolTaskTimeout, [state, n] { return state->finished >= n; });
+}
+
+// 任务结束之后线程池才更新completed，等待它追上
+leveldb::ThreadPoolStats wait_pool_completed(leveldb::Env::Priority pri, uint64_t completed) {
+    leveldb::ThreadPoolStats stats;
+    for (int i = 0; i < 10000; i++) {
+        const bool has_pool = env->GetThreadPoolStats(pri, &stats);
+        assert(has_pool);
+        (void) has_pool;
+        if (stats.completed >= completed) {
+            break;
+        }
+        env->SleepForMicroseconds(1000);
+    }
+    return stats;
+}
+
+// SetBackgroundThreads(n, pri)之后n个任务可以同时执行
+// kLow的线程都被阻塞、还有任务在排队时，kHigh的任务照样执行
+// GetThreadPoolStats的排队、执行和完成的计数，以及排队时间随之变化
+void test_thread_pool() {
+    const int kThreads = 4;
+    env->SetBackgroundThreads(kThreads, leveldb::Env::kLow);
+    assert(env->GetBackgroundThreads(leveldb::Env::kLow) == kThreads);
+    {
+        PoolTaskState state;
+        state.wait_running = kThreads;
+        for (int i = 0; i < kThreads; i++) {
+            env->Schedule(blocking_pool_task, &state, leveldb::Env::kLow);
+        }
+        const bool finished = wait_pool_tasks(&state, kThreads);
+        assert(finished);
+        assert(state.max_running == kThreads);
+        (void) finished;
+    }
+
+    env->SetBackgroundThreads(1, leveldb::Env::kLow);
+    env->SetBackgroundThreads(1, leveldb::Env::kHigh);
+    leveldb::ThreadPoolStats before;
+    env->GetThreadPoolStats(leveldb::Env::kLow, &before);
+    const uint64_t low_completed = wait_pool_completed(leveldb::Env::kLow, before.scheduled).completed;
+
+    const int kLowTasks = 4;
+    PoolTaskState low;
+    for (int i = 0; i < kLowTasks; i++) {
+        env->Schedule(blocking_pool_task, &low, leveldb::Env::kLow);
+    }
+    bool started;
+    {
+        std::unique_lock<std::mutex> l(low.mu);
+        started = low.cv.wait_for(l, kPoolTaskTimeout, [&low] { return low.running == 1; });
+    }
+    assert(started);
+    leveldb::ThreadPoolStats blocked;
+    env->GetThreadPoolStats(leveldb::Env::kLow, &blocked);
+    assert(blocked.threads == 1);
+    assert(blocked.running == 1);
+    assert(blocked.queue_length == kLowTasks - 1);
+    assert(blocked.scheduled == before.scheduled + kLowTasks);
+
+    PoolTaskState high;
+    high.gate_open = true;
+    env->Schedule(blocking_pool_task, &high, leveldb::Env::kHigh);
+    const bool high_finished = wait_pool_tasks(&high, 1);
+    assert(high_finished);
+    {
+        std::lock_guard<std::mutex> l(low.mu);
+        assert(low.finished == 0);
+        low.gate_open = true;
+        low.cv.notify_all();
+    }
+    const bool low_finished = wait_pool_tasks(&low, kLowTasks);
+    assert(low_finished);
+
+    const leveldb::ThreadPoolStats after = wait_pool_completed(leveldb::Env::kLow, low_completed + kLowTasks);
+    assert(after.completed == low_completed + kLowTasks);
+    assert(after.queue_length == 0);
+    assert(after.running == 0);
+    // 排在后面的任务至少等待了第一个任务阻塞的这段时间
+    assert(after.queue_wait_nanos.count >= before.queue_wait_nanos.count + kLowTasks);
+    assert(after.queue_wait_nanos.max > 0);
+    (void) started;
+    (void) high_finished;
+    (void) low_finished;
+    (void) blocked;
+    (void) after;
+}
+
+// 把crc32c校验的table的footer改写成最初的28字节格式：index handle + padding + kTableMagicNumber
+// metaindex block还留在文件中，但是没有被引用，和最初的writer写出的table一样没有filter
+void rewrite_original_footer(const std::string &fname) {
+    std::string contents;
+    check_status(leveldb::ReadFileToString(env, fname, &contents));
+    leveldb::Slice footer_input(contents);
+    leveldb::Footer footer;
+    check_status(footer.DecodeFrom(&footer_input));
+    assert(footer.has_metaindex() && footer.checksum_type() == leveldb::kCRC32c);
+
+    contents.resize(contents.size() - leveldb::Footer::kLegacyEncodedLength);
+    const size_t footer_start = contents.size();
+    footer.index_handle().EncodeTo(&contents);
+    contents.resize(footer_start + leveldb::BlockHandle::kMaxEncodedLength);
+    leveldb::PutFixed64(&contents, leveldb::kTableMagicNumber);
+    assert(contents.size() - footer_start == leveldb::Footer::kOriginalEncodedLength);
+    check_status(leveldb::WriteStringToFile(env, contents, fname));
+}
+
+// 在key + test_case[i]和下一个key之间，table中不存在
+std::string missing_key(int i) {
+    return key + test_case[i] + "#";
+}
+
+// 配置了filter_policy时，不存在的key几乎都被filter排除，不读取data block；存在的key都能查到
+// 最初格式的table没有filter，配置了filter_policy也照样读取
+void test_bloom_filter() {
+    const leveldb::FilterPolicy *policy = leveldb::NewBloomFilterPolicy(10);
+    leveldb::Options table_options = options;
+    table_options.filter_policy = policy;
+    table_options.checksum = leveldb::kCRC32c;
+    const std::string fname = test_file("bloom.sst");
+    write_test_table(table_options, fname);
+
+    const int kLookups = 2000;
+    leveldb::SetPerfLevel(leveldb::kEnableCount);
+    leveldb::PerfContext *perf = leveldb::GetPerfContext();
+    for (int original = 0; original < 2; original++) {
+        if (original) {
+            rewrite_original_footer(fname);
+        }
+        leveldb::RandomAccessFile *in;
+        leveldb::Table *table = open_test_table(table_options, fname, &in);
+        check_table_scan(table, readOptions);
+
+        perf->Reset();
+        int found = 0;
+        for (int i = 0; i < kLookups; i++) {
+            found += table_get(table, readOptions, missing_key(get_quene[i]));
+        }
+        assert(found == 0);
+        if (original) {
+            assert(perf->filter_check_count == 0);
+            assert(perf->block_read_count == kLookups);
+        } else {
+            // 10 bits/key的误判率大约是1%
+            assert(perf->filter_check_count == kLookups);
+            assert(perf->filter_useful_count > kLookups * 95 / 100);
+            assert(perf->block_read_count == kLookups - perf->filter_useful_count);
+        }
+
+        perf->Reset();
+        for (int i = 0; i < kLookups; i++) {
+            found += table_get(table, readOptions, key + test_case[get_quene[i]]);
+        }
+        assert(found == kLookups);
+        assert(perf->filter_useful_count == 0);
+        assert(perf->block_read_count == kLookups);
+
+        (void) found;
+        delete table;
+        delete in;
+    }
+    leveldb::SetPerfLevel(leveldb::kDisable);
+    env->RemoveFile(fname);
+    delete policy;
+}
+
+// Env::Default()用mmap读取table，读到的block直接指向mmap的内存，不会放入block cache
+// 这个file把读到的数据复制到scratch中，像pread一样，读到的block才能放入block cache
+class CopyingRandomAccessFile : public leveldb::RandomAccessFile {
+public:
+    explicit CopyingRandomAccessFile(leveldb::RandomAccessFile *target) : target_(target) {}
+
+    ~CopyingRandomAccessFile() override { delete target_; }
+
+    leveldb::Status Read(uint64_t offset, size_t n, leveldb::Slice *result, char *scratch) const override {
+        leveldb::Status status = target_->Read(offset, n, result, scratch);
+        if (status.ok() && result->data() != scratch) {
+            memcpy(scratch, result->data(), result->size());
+            *result = leveldb::Slice(scratch, result->size());
+        }
+        return status;
+    }
+
+private:
+    leveldb::RandomAccessFile *const target_;
+};
+
+// MultiGet的结果要和逐个InternalGet的一样：keys乱序、有重复、有不存在的key（包括比所有key都小和都大的），
+// 还有一段连续的key分布在文件中相邻的多个block上，会被合并成一次读取
+// 没有block cache、block cache为空、block cache中已经有这些block三种情况都检查
+void test_multi_get() {
+    leveldb::Options table_options = options;
+    table_options.compression = leveldb::kNoCompression;
+    const std::string fname = test_file("multi_get.sst");
+    write_test_table(table_options, fname);
+
+    std::vector<std::string> lookups;
+    for (int i = 0; i < 500; i++) {
+        lookups.push_back(key + test_case[get_quene[i]]);
+        lookups.push_back(missing_key(get_quene[i + 500]));
+    }
+    for (int i = 10000; i < 12000; i += 3) {
+        lookups.push_back(key + test_case[i]);
+    }
+    for (int i = 0; i < 100; i++) {
+        lookups.push_back(lookups[get_quene[i] % lookups.size()]);
+    }
+    lookups.push_back("a");
+    lookups.push_back(key + "~");
+    std::shuffle(lookups.begin(), lookups.end(), std::mt19937(301));
+    const std::vector<leveldb::Slice> keys(lookups.begin(), lookups.end());
+
+    leveldb::SetPerfLevel(leveldb::kEnableCount);
+    leveldb::PerfContext *perf = leveldb::GetPerfContext();
+    leveldb::Cache *cache = leveldb::NewLRUCache(64 * 1024 * 1024);
+    for (int cached = 0; cached < 2; cached++) {
+        table_options.block_cache = cached ? cache : nullptr;
+        leveldb::RandomAccessFile *mapped;
+        check_status(env->NewRandomAccessFile(fname, &mapped));
+        CopyingRandomAccessFile in(mapped);
+        uint64_t size;
+        check_status(env->GetFileSize(fname, &size));
+        leveldb::Table *table = nullptr;
+        check_status(leveldb::Table::Open(table_options, &in, size, &table));
+
+        perf->Reset();
+        std::vector<std::string> expected(lookups.size());
+        std::vector<bool> found(lookups.size());
+        for (size_t i = 0; i < lookups.size(); i++) {
+            found[i] = table_get(table, readOptions, lookups[i]);
+            if (found[i]) {
+                expected[i] = lookup_result_value;
+            }
+        }
+        const uint64_t get_reads = perf->block_read_count;
+
+        // 有cache时第一次MultiGet之前先清空cache，第二次时block都在cache中
+        for (int pass = 0; pass < 1 + cached; pass++) {
+            if (cached && pass == 0) {
+                cache->Prune();
+                assert(cache->TotalCharge() == 0);
+            }
+            perf->Reset();
+            std::vector<std::string> values;
+            std::vector<leveldb::Status> statuses;
+            table->MultiGet(readOptions, keys, &values, &statuses);
+            assert(values.size() == lookups.size() && statuses.size() == lookups.size());
+            for (size_t i = 0; i < lookups.size(); i++) {
+                if (found[i]) {
+                    assert(statuses[i].ok());
+                    assert(values[i] == expected[i]);
+                } else {
+                    assert(statuses[i].IsNotFound());
+                }
+            }
+            // 每个block最多读一次，相邻的block合并读取
+            if (pass == 0) {
+                assert(perf->block_read_count > 0 && perf->block_read_count < get_reads);
+            } else {
+                assert(perf->block_read_count == 0);
+            }
+        }
+        (void) get_reads;
+
+        delete table;
+    }
+    leveldb::SetPerfLevel(leveldb::kDisable);
+    delete cache;
+    env->RemoveFile(fname);
+}
+
+// 分区index：小的index_partition_size写出很多个分区，正向、反向遍历，以及在每个key和key之间Seek都要正确，
+// Seek之后Prev会跨过分区的边界
+// 点查的结果和同样数据、不分区的table一样；分区经过block cache和不经过都检查
+void test_partitioned_index() {
+    leveldb::Options table_options = options;
+    table_options.compression = leveldb::kNoCompression;
+    const std::string flat_name = test_file("flat_index.sst");
+    write_test_table(table_options, flat_name);
+    table_options.index_partition_size = 1024;
+    const std::string fname = test_file("partitioned_index.sst");
+    write_test_table(table_options, fname);
+
+    // 分区index的顶层index中是每个分区的handle
+    std::string flat_contents, contents;
+    check_status(leveldb::ReadFileToString(env, flat_name, &flat_contents));
+    check_status(leveldb::ReadFileToString(env, fname, &contents));
+    const size_t num_blocks = read_data_block_handles(flat_contents).size();
+    const size_t num_partitions = read_data_block_handles(contents).size();
+    assert(num_partitions > 1 && num_partitions < num_blocks);
+    (void) num_blocks;
+    (void) num_partitions;
+
+    leveldb::Cache *cache = leveldb::NewLRUCache(1024 * 1024);
+    for (int cached = 0; cached < 2; cached++) {
+        table_options.block_cache = cached ? cache : nullptr;
+        leveldb::RandomAccessFile *mapped;
+        check_status(env->NewRandomAccessFile(flat_name, &mapped));
+        CopyingRandomAccessFile flat_in(mapped);
+        leveldb::Table *flat = nullptr;
+        check_status(leveldb::Table::Open(table_options, &flat_in, flat_contents.size(), &flat));
+        check_status(env->NewRandomAccessFile(fname, &mapped));
+        CopyingRandomAccessFile in(mapped);
+        leveldb::Table *table = nullptr;
+        check_status(leveldb::Table::Open(table_options, &in, contents.size(), &table));
+
+        check_table_scan(table, readOptions);
+        leveldb::Iterator *iter = table->NewIterator(readOptions);
+        int i = KV_NUM;
+        for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+            i--;
+            assert(iter->key().ToString() == key + test_case[i]);
+        }
+        assert(i == 0);
+
+        for (i = 0; i < KV_NUM; i++) {
+            iter->Seek(key + test_case[i]);
+            assert(iter->Valid() && iter->key().ToString() == key + test_case[i]);
+            iter->Seek(missing_key(i));
+            if (i + 1 < KV_NUM) {
+                assert(iter->Valid() && iter->key().ToString() == key + test_case[i + 1]);
+                iter->Prev();
+            } else {
+                assert(!iter->Valid());
+                iter->SeekToLast();
+            }
+            assert(iter->Valid() && iter->key().ToString() == key + test_case[i]);
+        }
+        iter->Seek("a");
+        assert(iter->Valid() && iter->key().ToString() == key + test_case[0]);
+        check_status(iter->status());
+        delete iter;
+
+        for (i = 0; i < KV_NUM; i++) {
+            const std::string k = (i % 2 == 0) ? key + test_case[get_quene[i]] : missing_key(get_quene[i]);
+            const bool found = table_get(table, readOptions, k);
+            const std::string v = lookup_result_value;
+            const bool flat_found = table_get(flat, readOptions, k);
+            assert(found == (i % 2 == 0));
+            assert(flat_found == found);
+            assert(!found || lookup_result_value == v);
+            (void) found;
+            (void) flat_found;
+        }
+
+        delete table;
+        delete flat;
+    }
+    delete cache;
+    env->RemoveFile(flat_name);
+    env->RemoveFile(fname);
+}
+
+// 用test_case[begin, end)的kv对生成一个block，block中有没有hash index由block_options决定
+std::string build_test_block(const leveldb::Options &block_options, int begin, int end) {
+    leveldb::BlockBuilder builder(&block_options);
+    for (int i = begin; i < end; i++) {
+        builder.Add(key + test_case[i], value + test_case[i]);
+    }
+    return builder.Finish().ToString();
+}
+
+leveldb::Block *new_test_block(const std::string &data) {
+    leveldb::BlockContents contents;
+    contents.data = data;
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    contents.compression_type = leveldb::kNoCompression;
+    return new leveldb::Block(contents);
+}
+
+// block末尾的restart point个数中有没有hash index的标记
+bool has_block_hash_index(const leveldb::Slice &block) {
+    return (leveldb::DecodeFixed32(block.data() + block.size() - 4) & leveldb::kBlockHashIndexFlag) != 0;
+}
+
+// 点查询用的迭代器在block中查找test_case[begin, end)中的key和它们之间不存在的key
+// 有hash index时，不存在的key只要没有落在冲突的bucket上，迭代器就是无效的，InternalGet不会调用handle_result
+void check_point_lookup(const std::string &data, int begin, int end) {
+    leveldb::Block *block = new_test_block(data);
+    leveldb::Iterator *iter = block->NewIterator(options.comparator, true);
+    const bool hashed = has_block_hash_index(data);
+    int invalid_misses = 0;
+    for (int i = begin; i < end; i++) {
+        const std::string k = key + test_case[i];
+        iter->Seek(k);
+        assert(iter->Valid() && iter->key().ToString() == k);
+        assert(iter->value().ToString() == value + test_case[i]);
+
+        const std::string miss = missing_key(i);
+        iter->Seek(miss);
+        bool collision = true;
+        if (hashed) {
+            const size_t num_buckets = leveldb::DecodeFixed16(data.data() + data.size() - 6);
+            const char *buckets = data.data() + data.size() - 6 - num_buckets;
+            const uint32_t h = leveldb::Hash(miss.data(), miss.size(), leveldb::kBlockHashSeed);
+            collision = static_cast<uint8_t>(buckets[h % num_buckets]) == leveldb::kBlockHashCollision;
+        }
+        if (!collision) {
+            assert(!iter->Valid());
+            invalid_misses++;
+        } else if (i + 1 < end) {
+            // 退回二分查找，指向下一个key
+            assert(iter->Valid() && iter->key().ToString() == key + test_case[i + 1]);
+        }
+        check_status(iter->status());
+    }
+    assert(hashed == (invalid_misses > 0));
+    (void) invalid_misses;
+    delete iter;
+    delete block;
+}
+
+// block hash index：restart point不超过253个的block带有hash index，点查询的命中和不存在都要正确，
+// restart point更多的block不写hash index，照常二分查找
+// 整个table的点查询结果和不带hash index的table一样
+void test_block_hash_index() {
+    leveldb::Options block_options = options;
+    block_options.block_hash_index = true;
+    const std::string small = build_test_block(block_options, 1000, 1400);
+    assert(has_block_hash_index(small));
+    check_point_lookup(small, 1000, 1400);
+
+    block_options.block_restart_interval = 1;
+    const std::string large = build_test_block(block_options, 1000, 1000 + leveldb::kBlockHashMaxRestarts + 1);
+    assert(!has_block_hash_index(large));
+    check_point_lookup(large, 1000, 1000 + leveldb::kBlockHashMaxRestarts + 1);
+
+    leveldb::Options table_options = options;
+    table_options.compression = leveldb::kNoCompression;
+    const std::string plain_name = test_file("no_hash_index.sst");
+    write_test_table(table_options, plain_name);
+    leveldb::RandomAccessFile *plain_in;
+    leveldb::Table *plain = open_test_table(table_options, plain_name, &plain_in);
+
+    // 第二个table的block很大，开头的block中restart point超过253个，后面的block key很长，不超过253个
+    for (int big_blocks = 0; big_blocks < 2; big_blocks++) {
+        table_options.block_hash_index = true;
+        table_options.block_restart_interval = big_blocks ? 1 : 16;
+        table_options.block_size = big_blocks ? 256 * 1024 : 4 * 1024;
+        const std::string fname = test_file("hash_index.sst");
+        write_test_table(table_options, fname);
+
+        std::string contents;
+        check_status(leveldb::ReadFileToString(env, fname, &contents));
+        int hashed = 0, unhashed = 0;
+        for (const leveldb::BlockHandle &handle : read_data_block_handles(contents)) {
+            if (has_block_hash_index(leveldb::Slice(contents.data() + handle.offset(), handle.size()))) {
+                hashed++;
+            } else {
+                unhashed++;
+            }
+        }
+        assert(hashed > 0);
+        assert(big_blocks ? unhashed > 0 : unhashed == 0);
+        (void) hashed;
+        (void) unhashed;
+
+        leveldb::RandomAccessFile *in;
+        leveldb::Table *table = open_test_table(table_options, fname, &in);
+        check_table_scan(table, readOptions);
+        for (int i = 0; i < KV_NUM; i++) {
+            const std::string k = (i % 2 == 0) ? key + test_case[get_quene[i]] : missing_key(get_quene[i]);
+            const bool found = table_get(table, readOptions, k);
+            const std::string v = lookup_result_value;
+            const bool plain_found = table_get(plain, readOptions, k);
+            assert(found == (i % 2 == 0));
+            assert(plain_found == found);
+            assert(!found || lookup_result_value == v);
+            (void) found;
+            (void) plain_found;
+        }
+        delete table;
+        delete in;
+        env->RemoveFile(fname);
+    }
+
+    delete plain;
+    delete plain_in;
+    env->RemoveFile(plain_name);
+}
+
+// crc32c::Extend在CPU支持时用SSE4.2/PCLMULQDQ计算，结果要和查表的实现一样
+// 长度覆盖0到4KB（包括按3个通道交错计算的各个分界），起始地址覆盖各种不对齐的情况，初始crc不为0
+void test_crc32c() {
+    assert(leveldb::crc32c::Value("123456789", 9) == 0xe3069283);
+    const bool sse42 = leveldb::port::CanAccelerateCRC32CWithSSE42();
+
+    const size_t kMaxLength = 4096;
+    const size_t kMaxOffset = 16;
+    std::string data(kMaxLength + kMaxOffset, '\0');
+    std::mt19937 rnd(301);
+    for (char &c : data) {
+        c = static_cast<char>(rnd());
+    }
+    for (size_t offset = 0; offset < kMaxOffset; offset++) {
+        const uint32_t init_crc = static_cast<uint32_t>(rnd());
+        for (size_t n = 0; n <= kMaxLength; n++) {
+            const char *p = data.data() + offset;
+            const uint32_t expected = leveldb::crc32c::ExtendPortable(init_crc, p, n);
+            assert(leveldb::crc32c::Extend(init_crc, p, n) == expected);
+            if (sse42) {
+                assert(leveldb::port::SSE42CRC32C(init_crc, p, n) == expected);
+            }
+            (void) p;
+            (void) expected;
+        }
+    }
+    (void) sse42;
+}
+
+// 自适应压缩：不可压缩的value连续写入之后跳过压缩，只抽样压缩；value变得可压缩之后，抽样发现了就恢复压缩
+// 写出的table照常可以读取
+void test_adaptive_compression() {
+    const int kEntries = 400;
+    const int kValueSize = 1000;
+    leveldb::Options table_options = options;
+    table_options.compression = kTestCompression;
+    table_options.adaptive_compression = true;
+    const std::string fname = test_file("adaptive.sst");
+
+    std::mt19937 rnd(301);
+    std::vector<std::string> values;
+    for (int i = 0; i < 2 * kEntries; i++) {
+        std::string v(kValueSize, 'x');
+        if (i < kEntries) {
+            for (char &c : v) {
+                c = static_cast<char>(rnd());
+            }
+        }
+        values.push_back(v);
+    }
+    std::vector<std::string> keys;
+    for (int i = 0; i < 2 * kEntries; i++) {
+        keys.push_back(key + test_case[i]);
+    }
+
+    leveldb::WritableFile *out;
+    check_status(env->NewWritableFile(fname, &out));
+    {
+        leveldb::TableBuilder builder(table_options, out);
+        for (int i = 0; i < kEntries; i++) {
+            builder.Add(keys[i], values[i]);
+        }
+        const leveldb::TableBuilder::CompressionStats incompressible = builder.compression_stats();
+        assert(incompressible.bypassed > 0);
+        assert(incompressible.sampled > 0);
+        assert(incompressible.compressed == 0);
+
+        for (int i = kEntries; i < 2 * kEntries; i++) {
+            builder.Add(keys[i], values[i]);
+        }
+        check_status(builder.Finish());
+        const leveldb::TableBuilder::CompressionStats &stats = builder.compression_stats();
+        // 第一次抽样压缩的block就让压缩率的移动平均降到阈值以下，之后的block都压缩
+        // 所以最多再跳过一个抽样间隔的block
+        const uint64_t blocks = stats.compressed + stats.rejected + stats.bypassed -
+                                (incompressible.compressed + incompressible.rejected + incompressible.bypassed);
+        assert(blocks > 32);
+        assert(stats.bypassed - incompressible.bypassed <= 16);
+        assert(stats.compressed >= blocks - 16);
+        (void) blocks;
+        (void) incompressible;
+        (void) stats;
+    }
+    check_status(out->Close());
+    delete out;
+
+    leveldb::RandomAccessFile *in;
+    leveldb::Table *table = open_test_table(table_options, fname, &in);
+    leveldb::Iterator *iter = table->NewIterator(readOptions);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        assert(iter->key().ToString() == keys[count]);
+        assert(iter->value().ToString() == values[count]);
+        count++;
+    }
+    assert(count == 2 * kEntries);
+    check_status(iter->status());
+    delete iter;
+    delete table;
+    delete in;
+    env->RemoveFile(fname);
+}
+
+// parallel_compression_threads > 1时写出的table要和串行写出的逐字节相同，
+// 包括filter（key要等block写入、知道offset之后才加入）和block_alignment的padding
+void test_parallel_compression() {
+    const leveldb::FilterPolicy *policy = leveldb::NewBloomFilterPolicy(10);
+    for (int variant = 0; variant < 3; variant++) {
+        leveldb::Options table_options = options;
+        table_options.compression = kTestCompression;
+        if (variant >= 1) {
+            table_options.filter_policy = policy;
+        }
+        if (variant >= 2) {
+            table_options.block_alignment = 4096;
+        }
+        const std::string serial_name = test_file("serial.sst");
+        write_test_table(table_options, serial_name);
+        table_options.parallel_compression_threads = 4;
+        table_options.parallel_compression_max_inflight = 8;
+        const std::string parallel_name = test_file("parallel.sst");
+        write_test_table(table_options, parallel_name);
+
+        std::string serial, parallel;
+        check_status(leveldb::ReadFileToString(env, serial_name, &serial));
+        check_status(leveldb::ReadFileToString(env, parallel_name, &parallel));
+        assert(serial == parallel);
+
+        int count;
+        check_status(scan_test_table(parallel_name, &count));
+        assert(count == KV_NUM);
+        env->RemoveFile(serial_name);
+        env->RemoveFile(parallel_name);
+    }
+    delete policy;
+}
+
+// 每个注册的Compressor都能还原自己压缩的数据，用每种压缩类型写出的table都能读取
+// 编译时没有对应压缩库的Compressor拒绝压缩，block按不压缩写入，跳过压缩相关的检查
+void test_compressors() {
+    std::mt19937 rnd(301);
+    std::vector<std::string> inputs;
+    inputs.push_back("");
+    inputs.push_back("a");
+    std::string text;
+    while (text.size() < 64 * 1024) {
+        text += key + test_case[text.size() % KV_NUM];
+    }
+    inputs.push_back(text);
+    std::string random(4096, '\0');
+    for (char &c : random) {
+        c = static_cast<char>(rnd());
+    }
+    inputs.push_back(random);
+
+    const leveldb::CompressionType types[] = {leveldb::kSnappyCompression, leveldb::kZstdCompression,
+                                              leveldb::kLZ4Compression, kTestCompression};
+    for (leveldb::CompressionType type : types) {
+        const leveldb::Compressor *compressor = leveldb::GetCompressor(type);
+        assert(compressor != nullptr && compressor->type() == type);
+        std::string compressed;
+        const bool available = compressor->Compress(options, text, &compressed);
+        // TableBuilder只保存至少节省1/8的压缩结果
+        const bool effective = available && compressed.size() < text.size() - text.size() / 8;
+        for (const std::string &input : inputs) {
+            if (!available || !compressor->Compress(options, input, &compressed)) {
+                continue;
+            }
+            size_t length;
+            const bool ok = compressor->GetUncompressedLength(compressed, &length);
+            assert(ok && length == input.size());
+            (void) ok;
+            std::string output(length, '\0');
+            const bool uncompressed = compressor->Uncompress(compressed, &output[0]);
+            assert(uncompressed && output == input);
+            (void) uncompressed;
+        }
+
+        leveldb::Statistics *stats = leveldb::NewStatistics();
+        leveldb::Options table_options = options;
+        table_options.compression = type;
+        table_options.statistics = stats;
+        const std::string fname = test_file("compressor.sst");
+        write_test_table(table_options, fname);
+        if (effective) {
+            assert(stats->GetTickerCount(leveldb::kBlockCompressed) > 0);
+        }
+        int count;
+        check_status(scan_test_table(fname, &count));
+        assert(count == KV_NUM);
+        env->RemoveFile(fname);
+        delete stats;
+    }
+    assert(leveldb::GetCompressor(leveldb::kNoCompression) == nullptr);
+}
+
+// kEnableCount时一次冷的InternalGet记录get_count、block cache未命中和读取block的次数，计时的字段保持为0
+// kDisable时什么都不记录
+void test_perf_context() {
+    leveldb::Options table_options = options;
+    table_options.compression = leveldb::kNoCompression;
+    const std::string fname = test_file("perf_context.sst");
+    write_test_table(table_options, fname);
+
+    leveldb::PerfContext *perf = leveldb::GetPerfContext();
+    const leveldb::PerfLevel levels[] = {leveldb::kEnableCount, leveldb::kDisable};
+    for (leveldb::PerfLevel level : levels) {
+        leveldb::Cache *cache = leveldb::NewLRUCache(1024 * 1024);
+        table_options.block_cache = cache;
+        leveldb::RandomAccessFile *in;
+        leveldb::Table *table = open_test_table(table_options, fname, &in);
+
+        leveldb::SetPerfLevel(level);
+        assert(leveldb::GetPerfLevel() == level);
+        perf->Reset();
+        const bool found = table_get(table, readOptions, key + test_case[KV_NUM / 2]);
+        assert(found);
+        (void) found;
+        if (level == leveldb::kEnableCount) {
+            assert(perf->get_count == 1);
+            assert(perf->block_cache_miss_count == 1);
+            assert(perf->block_cache_hit_count == 0);
+            assert(perf->block_read_count == 1);
+            assert(perf->block_read_bytes > 0);
+            assert(perf->get_nanos == 0 && perf->block_read_nanos == 0);
+        } else {
+            assert(perf->get_count == 0);
+            assert(perf->block_cache_miss_count == 0);
+            assert(perf->block_read_count == 0);
+            assert(perf->ToString(true).empty());
+        }
+
+        delete table;
+        delete in;
+        delete cache;
+    }
+    leveldb::SetPerfLevel(leveldb::kDisable);
+    env->RemoveFile(fname);
+}
+
+// 已知的操作之后检查Statistics的ticker和histogram，以及ToPrometheus的输出
+void test_statistics() {
+    leveldb::Statistics *stats = leveldb::NewStatistics();
+    leveldb::Options table_options = options;
+    table_options.compression = leveldb::kNoCompression;
+    table_options.statistics = stats;
+    const std::string fname = test_file("statistics.sst");
+    write_test_table(table_options, fname);
+    uint64_t size;
+    check_status(env->GetFileSize(fname, &size));
+    assert(stats->GetTickerCount(leveldb::kTableBytesWritten) == size);
+    assert(stats->GetTickerCount(leveldb::kBlockCompressed) == 0);
+    leveldb::HistogramData add;
+    stats->GetHistogramData(leveldb::kTableAddNanos, &add);
+    assert(add.count == KV_NUM);
+    leveldb::HistogramData finish;
+    stats->GetHistogramData(leveldb::kTableFinishNanos, &finish);
+    assert(finish.count == 1);
+    (void) add;
+    (void) finish;
+
+    // 同一个key查询两次，第一次读取block放入cache，第二次命中
+    leveldb::Cache *cache = leveldb::NewLRUCache(1024 * 1024);
+    table_options.block_cache = cache;
+    leveldb::RandomAccessFile *mapped;
+    check_status(env->NewRandomAccessFile(fname, &mapped));
+    CopyingRandomAccessFile in(mapped);
+    leveldb::Table *table = nullptr;
+    check_status(leveldb::Table::Open(table_options, &in, size, &table));
+    stats->Reset();
+    for (int i = 0; i < 2; i++) {
+        const bool found = table_get(table, readOptions, key + test_case[KV_NUM / 2]);
+        assert(found);
+        (void) found;
+    }
+    assert(stats->GetTickerCount(leveldb::kBlockCacheMiss) == 1);
+    assert(stats->GetTickerCount(leveldb::kBlockCacheHit) == 1);
+    assert(stats->GetTickerCount(leveldb::kBlockRead) == 1);
+    assert(stats->GetTickerCount(leveldb::kBlockReadBytes) > leveldb::kBlockTrailerSize);
+    assert(stats->GetTickerCount(leveldb::kTableBytesWritten) == 0);
+    leveldb::HistogramData get;
+    stats->GetHistogramData(leveldb::kGetNanos, &get);
+    assert(get.count == 2 && get.max > 0 && get.sum >= get.max);
+    (void) get;
+
+    const std::string text = stats->ToPrometheus();
+    assert(text.find("# TYPE leveldb_block_cache_hit_total counter\nleveldb_block_cache_hit_total 1\n") !=
+           std::string::npos);
+    assert(text.find("\nleveldb_block_cache_miss_total 1\n") != std::string::npos);
+    assert(text.find("\nleveldb_table_bytes_written_total 0\n") != std::string::npos);
+    assert(text.find("# TYPE leveldb_get_nanos summary\nleveldb_get_nanos{quantile=\"0.5\"} ") != std::string::npos);
+    assert(text.find("\nleveldb_get_nanos{quantile=\"0.999\"} ") != std::string::npos);
+    assert(text.find("\nleveldb_get_nanos_count 2\n") != std::string::npos);
+    assert(text.find("# TYPE leveldb_get_nanos_max gauge\n") != std::string::npos);
+    assert(stats->ToString().find("leveldb.block.cache.hit COUNT : 1\n") != std::string::npos);
+    (void) text;
+
+    stats->Reset();
+    assert(stats->GetTickerCount(leveldb::kBlockCacheHit) == 0);
+    delete table;
+    delete cache;
+    delete stats;
+    env->RemoveFile(fname);
+}
+
+// 通过NewIOStatsEnv写入和读取table：写入的字节数等于文件大小，
+// 一次没有cache的InternalGet读取一个block，读取的次数和字节数和PerfContext记录的一致
+// 每个文件的统计分开记录，总的统计是所有文件之和
+void test_io_stats_env() {
+    leveldb::IOStatsEnv *io_env = leveldb::NewIOStatsEnv(env);
+    leveldb::Options table_options = options;
+    table_options.compression = leveldb::kNoCompression;
+    const std::string fname = test_file("io_stats.sst");
+    const std::string other_name = test_file("io_stats_other.sst");
+    leveldb::WritableFile *out;
+    check_status(io_env->NewWritableFile(fname, &out));
+    {
+        leveldb::TableBuilder builder(table_options, out);
+        for (int i = 0; i < KV_NUM; ++i) {
+            builder.Add(key + test_case[i], value + test_case[i]);
+        }
+        check_status(builder.Finish());
+        check_status(builder.Sync());
+    }
+    check_status(out->Close());
+    delete out;
+    check_status(io_env->NewWritableFile(other_name, &out));
+    check_status(out->Append("other"));
+    check_status(out->Close());
+    delete out;
+
+    uint64_t size;
+    check_status(env->GetFileSize(fname, &size));
+    leveldb::IOStats file_stats;
+    bool known = io_env->GetFileStats(fname, &file_stats);
+    assert(known);
+    assert(file_stats.write_bytes == size);
+    assert(file_stats.write_count > 0 && file_stats.sync_count == 1);
+    assert(file_stats.read_count == 0);
+
+    leveldb::RandomAccessFile *in;
+    check_status(io_env->NewRandomAccessFile(fname, &in));
+    leveldb::Table *table = nullptr;
+    check_status(leveldb::Table::Open(table_options, in, size, &table));
+    io_env->ResetStats();
+
+    leveldb::SetPerfLevel(leveldb::kEnableCount);
+    leveldb::PerfContext *perf = leveldb::GetPerfContext();
+    perf->Reset();
+    const bool found = table_get(table, readOptions, key + test_case[KV_NUM / 3]);
+    assert(found);
+    (void) found;
+    leveldb::SetPerfLevel(leveldb::kDisable);
+    known = io_env->GetFileStats(fname, &file_stats);
+    assert(known);
+    assert(file_stats.read_count == 1 && perf->block_read_count == 1);
+    assert(file_stats.read_bytes == perf->block_read_bytes);
+    assert(file_stats.read_size.count == 1);
+    assert(file_stats.write_bytes == 0);
+
+    check_table_scan(table, readOptions);
+    known = io_env->GetFileStats(fname, &file_stats);
+    assert(known);
+    assert(file_stats.read_count > 1);
+    // 顺序扫描把所有data block读了一遍，最多再加上第一次查询的block
+    assert(file_stats.read_bytes >= size / 2 && file_stats.read_bytes <= size);
+
+    leveldb::IOStats other_stats, total;
+    known = io_env->GetFileStats(other_name, &other_stats);
+    assert(known);
+    assert(other_stats.write_bytes == 0 && other_stats.read_count == 0);
+    assert(!io_env->GetFileStats(test_file("io_stats_missing.sst"), &other_stats));
+    io_env->GetStats(&total);
+    assert(total.read_count == file_stats.read_count && total.read_bytes == file_stats.read_bytes);
+    std::vector<std::string> names;
+    io_env->GetFileNames(&names);
+    assert(std::count(names.begin(), names.end(), fname) == 1);
+    assert(std::count(names.begin(), names.end(), other_name) == 1);
+    (void) known;
+
+    delete table;
+    delete in;
+    delete io_env;
+    env->RemoveFile(fname);
+    env->RemoveFile(other_name);
+}
+
+// cache测试中的value是int，deleter记录被删除的次数
+int cache_deleted = 0;
+
+void count_cache_deleter(const leveldb::Slice & /*key*/, void *value) {
+    cache_deleted++;
+    delete reinterpret_cast<int *>(value);
+}
+
+leveldb::Cache::Handle *cache_insert(leveldb::Cache *cache, int k, int v) {
+    const std::string cache_key = std::to_string(k);
+    return cache->Insert(cache_key, new int(v), 1, count_cache_deleter);
+}
+
+// 查询k，命中时返回value，否则返回-1
+int cache_lookup(leveldb::Cache *cache, int k) {
+    leveldb::Cache::Handle *handle = cache->Lookup(std::to_string(k));
+    if (handle == nullptr) {
+        return -1;
+    }
+    const int v = *reinterpret_cast<int *>(cache->Value(handle));
+    cache->Release(handle);
+    return v;
+}
+
+// LRU cache：总的charge不超过capacity，最近用过的entry不被淘汰，
+// 被引用的entry即使被淘汰或者替换也要等Release之后才删除，NewId不重复
+void test_lru_cache() {
+    const size_t kCapacity = 160;
+    leveldb::Cache *cache = leveldb::NewLRUCache(kCapacity);
+    cache_deleted = 0;
+
+    // 一直引用着的entry
+    leveldb::Cache::Handle *pinned = cache_insert(cache, -1, 1000);
+    for (int i = 0; i < 2000; i++) {
+        cache->Release(cache_insert(cache, i, i * 10));
+        // 反复访问0，它一直是所在shard中最近用过的
+        assert(cache_lookup(cache, 0) == 0);
+    }
+    assert(cache->TotalCharge() <= kCapacity + 1);
+    assert(cache_deleted >= 2000 - static_cast<int>(kCapacity));
+    assert(cache_lookup(cache, 0) == 0);
+    assert(cache_lookup(cache, 1) == -1);
+    assert(*reinterpret_cast<int *>(cache->Value(pinned)) == 1000);
+
+    // 替换被引用的entry：查询得到新的value，旧的value在Release之后才删除
+    const int deleted = cache_deleted;
+    cache->Release(cache_insert(cache, -1, 2000));
+    assert(cache_lookup(cache, -1) == 2000);
+    assert(*reinterpret_cast<int *>(cache->Value(pinned)) == 1000);
+    assert(cache_deleted == deleted);
+    cache->Release(pinned);
+    assert(cache_deleted == deleted + 1);
+
+    cache->Erase(std::to_string(-1));
+    assert(cache_lookup(cache, -1) == -1);
+    assert(cache_deleted == deleted + 2);
+
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 1000; i++) {
+        ids.push_back(cache->NewId());
+    }
+    std::sort(ids.begin(), ids.end());
+    assert(std::unique(ids.begin(), ids.end()) == ids.end());
+
+    // 析构时删除剩下的所有entry
+    delete cache;
+    assert(cache_deleted == 2000 + 2);
 }
 
 int main(int argc, const char *argv[]) {
@@ -171,6 +1737,26 @@ int main(int argc, const char *argv[]) {
     test_test_case();
     test_block_write();
     test_block_read();
+    test_table_scan();
+    test_checksum_types();
+    test_merging_iterator();
+    test_bulk_loader();
+    test_lru_cache();
+    test_block_alignment();
+    test_compressed_block_cache();
+    test_thread_pool();
+    test_bloom_filter();
+    test_multi_get();
+    test_partitioned_index();
+    test_block_hash_index();
+    test_crc32c();
+    test_adaptive_compression();
+    test_parallel_compression();
+    test_compressors();
+    test_perf_context();
+    test_statistics();
+    test_io_stats_env();
 
+    printf("All test passed\n");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,236 @@
+#include "merger.h"
+
+#include <vector>
+
+#include "iterator_wrapper.h"
+
+namespace leveldb {
+    namespace {
+        class MergingIterator : public Iterator {
+        public:
+            MergingIterator(const Comparator *comparator, Iterator **children, int n);
+
+            ~MergingIterator() override { delete[] children_; }
+
+            bool Valid() const override { return children_[tree_[0]].Valid(); }
+
+            void SeekToFirst() override;
+
+            void SeekToLast() override;
+
+            void Seek(const Slice &target) override;
+
+            void Next() override;
+
+            void Prev() override;
+
+            Slice key() const override {
+                assert(Valid());
+                return children_[tree_[0]].key();
+            }
+
+            Slice value() const override {
+                assert(Valid());
+                return children_[tree_[0]].value();
+            }
+
+            Status status() const override;
+
+        private:
+            enum Direction { kForward, kReverse };
+
+            // child a是否应该排在child b前面，无效的child排在最后
+            bool Before(int a, int b) const;
+
+            // 所有child重新定位之后，自底向上重建整棵树，O(n)
+            void Rebuild();
+
+            // 只有child i变了，从叶子i到根重新比赛，O(log n)
+            void Replay(int i);
+
+            const Comparator *comparator_;
+            IteratorWrapper *children_;
+            const int n_;
+            // 叶子的个数，是 ≥ n_ 的2的幂，下标 ≥ n_ 的叶子是一直无效的填充
+            int leaves_;
+            // 败者树：tree_[1, leaves_)是内部结点，保存在这个结点比赛中输掉的child，
+            // 结点i的子结点是2i和2i+1，叶子i对应结点leaves_ + i；tree_[0]保存最终的胜者，即当前的child
+            std::vector<int> tree_;
+            Direction direction_;
+        };
+
+        MergingIterator::MergingIterator(const Comparator *comparator, Iterator **children, int n)
+                : comparator_(comparator),
+                  children_(new IteratorWrapper[n]),
+                  n_(n),
+                  leaves_(1),
+                  direction_(kForward) {
+            for (int i = 0; i < n; i++) {
+                children_[i].Set(children[i]);
+            }
+            while (leaves_ < n) {
+                leaves_ *= 2;
+            }
+            // 还没有定位时所有child都无效，胜者是哪个都一样
+            tree_.assign(leaves_, 0);
+        }
+
+        bool MergingIterator::Before(int a, int b) const {
+            if (a >= n_ || !children_[a].Valid()) {
+                return false;
+            }
+            if (b >= n_ || !children_[b].Valid()) {
+                return true;
+            }
+            int r = comparator_->Compare(children_[a].key(), children_[b].key());
+            if (direction_ == kForward) {
+                return r < 0 || (r == 0 && a < b);
+            } else {
+                return r > 0 || (r == 0 && a > b);
+            }
+        }
+
+        void MergingIterator::Rebuild() {
+            if (leaves_ == 1) {
+                tree_[0] = 0;
+                return;
+            }
+            // winners[i]是结点i的子树中的胜者
+            std::vector<int> winners(2 * leaves_);
+            for (int i = 0; i < leaves_; i++) {
+                winners[leaves_ + i] = i;
+            }
+            for (int node = leaves_ - 1; node >= 1; node--) {
+                int a = winners[2 * node];
+                int b = winners[2 * node + 1];
+                if (Before(b, a)) {
+                    std::swap(a, b);
+                }
+                winners[node] = a;
+                tree_[node] = b;
+            }
+            tree_[0] = winners[1];
+        }
+
+        void MergingIterator::Replay(int i) {
+            int winner = i;
+            for (int node = (leaves_ + i) / 2; node >= 1; node /= 2) {
+                // 和上次在这个结点输掉的child比，输的留下，赢的继续向上
+                if (Before(tree_[node], winner)) {
+                    std::swap(tree_[node], winner);
+                }
+            }
+            tree_[0] = winner;
+        }
+
+        void MergingIterator::SeekToFirst() {
+            for (int i = 0; i < n_; i++) {
+                children_[i].SeekToFirst();
+            }
+            direction_ = kForward;
+            Rebuild();
+        }
+
+        void MergingIterator::SeekToLast() {
+            for (int i = 0; i < n_; i++) {
+                children_[i].SeekToLast();
+            }
+            direction_ = kReverse;
+            Rebuild();
+        }
+
+        void MergingIterator::Seek(const Slice &target) {
+            for (int i = 0; i < n_; i++) {
+                children_[i].Seek(target);
+            }
+            direction_ = kForward;
+            Rebuild();
+        }
+
+        void MergingIterator::Next() {
+            assert(Valid());
+            const int current = tree_[0];
+
+            // 反向遍历时，其它child都停在 ≤ key()的位置，
+            // 要把它们移到正向顺序中current之后的位置才能开始正向遍历
+            // key和key()相等的child中，下标比current小的在正向顺序中排在current之前，要跳过
+            if (direction_ != kForward) {
+                const std::string saved_key = key().ToString();
+                for (int i = 0; i < n_; i++) {
+                    if (i == current) {
+                        continue;
+                    }
+                    IteratorWrapper &child = children_[i];
+                    child.Seek(saved_key);
+                    if (child.Valid() && i < current && comparator_->Compare(saved_key, child.key()) == 0) {
+                        child.Next();
+                    }
+                }
+                direction_ = kForward;
+                children_[current].Next();
+                Rebuild();
+                return;
+            }
+
+            children_[current].Next();
+            Replay(current);
+        }
+
+        void MergingIterator::Prev() {
+            assert(Valid());
+            const int current = tree_[0];
+
+            // 正向遍历时，其它child都停在 ≥ key()的位置，
+            // 要把它们移到正向顺序中current之前的位置才能开始反向遍历
+            // key和key()相等的child中，下标比current小的在正向顺序中排在current之前，不用后退
+            if (direction_ != kReverse) {
+                const std::string saved_key = key().ToString();
+                for (int i = 0; i < n_; i++) {
+                    if (i == current) {
+                        continue;
+                    }
+                    IteratorWrapper &child = children_[i];
+                    child.Seek(saved_key);
+                    if (child.Valid()) {
+                        // child在第一个 ≥ key()的位置
+                        if (i > current || comparator_->Compare(saved_key, child.key()) != 0) {
+                            child.Prev();
+                        }
+                    } else {
+                        // child中没有 ≥ key()的数据，最后一个就是 < key()的
+                        child.SeekToLast();
+                    }
+                }
+                direction_ = kReverse;
+                children_[current].Prev();
+                Rebuild();
+                return;
+            }
+
+            children_[current].Prev();
+            Replay(current);
+        }
+
+        Status MergingIterator::status() const {
+            Status status;
+            for (int i = 0; i < n_; i++) {
+                status = children_[i].status();
+                if (!status.ok()) {
+                    break;
+                }
+            }
+            return status;
+        }
+    }  // namespace
+
+    Iterator *NewMergingIterator(const Comparator *comparator, Iterator **children, int n) {
+        assert(n >= 0);
+        if (n == 0) {
+            return NewEmptyIterator();
+        } else if (n == 1) {
+            return children[0];
+        } else {
+            return new MergingIterator(comparator, children, n);
+        }
+    }
+}
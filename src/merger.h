@@ -0,0 +1,21 @@
+#ifndef SSTABLE_MERGER_H
+#define SSTABLE_MERGER_H
+
+#include "../include/comparator.h"
+#include "../include/iterator.h"
+
+namespace leveldb {
+    class Comparator;
+
+    // 返回一个归并children[0, n-1]的迭代器，按comparator的顺序输出所有children中的kv对
+    // 取得children中所有迭代器的所有权，不再需要时负责释放，children数组本身仍属于调用者
+    //
+    // 用败者树(loser tree)选出当前最小(反向遍历时最大)的child，
+    // Next/Prev只需要沿叶子到根的路径比较约log2(n)次，而不是n次
+    // 多个child中有相同的key时全部输出，正向遍历时下标小的child先输出，反向遍历时相反
+    //
+    // REQUIRES: n >= 0
+    Iterator *NewMergingIterator(const Comparator *comparator, Iterator **children, int n);
+}
+
+#endif //SSTABLE_MERGER_H
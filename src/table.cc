@@ -1,84 +1,665 @@
 #include "table.h"
 
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "../include/cache.h"
+#include "../include/compressor.h"
+#include "../include/filter_policy.h"
+#include "../util/coding.h"
+#include "../util/mutexlock.h"
+#include "../util/perf_context_imp.h"
+#include "../util/statistics_imp.h"
+#include "filter_block.h"
+#include "two_level_iterator.h"
+
 namespace leveldb{
     struct Table::Rep{
 
+        // 分区index时是顶层index，只有它常驻内存，分区按需通过block cache读取
         Block *index_block;
+        bool partitioned_index;
         RandomAccessFile *file;
         Options options;
+        // 在block cache中区分不同table的id，和block的offset一起组成cache的key
+        uint64_t cache_id;
+
+        // 没有配置filter_policy或者table中没有对应的filter block时为nullptr
+        FilterBlockReader *filter;
+        // filter的数据，filter_data由table负责释放
+        const char *filter_data;
+
+        // data block之后依次是filter block、metaindex block和index block
+        // 预读不会越过metaindex block的起始位置
+        uint64_t data_end;
+        // block trailer中校验值的类型，来自footer
+        ChecksumType checksum_type;
     };
 
     Status Table::Open(const Options &options, RandomAccessFile *file, uint64_t size, Table **table) {
+        if (size < Footer::kOriginalEncodedLength) {
+            return Status::Corruption("file is too short to be an sstable");
+        }
+        // block_cache淘汰block时在deleter中把压缩的数据插入compressed_block_cache，
+        // 两者是同一个cache的话会在持有cache锁的时候再次加锁，导致死锁
+        if (options.compressed_block_cache != nullptr && options.compressed_block_cache == options.block_cache) {
+            return Status::InvalidArgument("compressed_block_cache must differ from block_cache");
+        }
+
         Slice footer_input;
 
-        char footer_space[Footer::kEncodedLength];
+        // 不知道footer是哪种格式，按最长的读，由DecodeFrom根据magic number判断
+        char footer_space[Footer::kMaxEncodedLength];
+        const size_t footer_size = static_cast<size_t>(
+                std::min<uint64_t>(size, Footer::kMaxEncodedLength));
 
-        Status s = file->Read(size - Footer::kEncodedLength, Footer::kEncodedLength, &footer_input, footer_space);
+        Status s = file->Read(size - footer_size, footer_size, &footer_input, footer_space);
 
         if(!s.ok()) return s;
+        if (footer_input.size() != footer_size) {
+            return Status::Corruption("truncated footer read");
+        }
 
         Footer footer;
         s = footer.DecodeFrom(&footer_input);
         if(!s.ok()) return s;
 
-        BlockContents index_block_contents;
         ReadOptions opt;
 
         opt.verify_checksums = true;
 
-        s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
+        // 读取metaindex block，从中得到index的类型
+        // 最初格式的table没有metaindex block，只有一个index block
+        Block *meta = nullptr;
+        bool partitioned_index = false;
+        if (footer.has_metaindex()) {
+            BlockContents meta_contents;
+            s = ReadBlock(file, opt, footer.checksum_type(), footer.metaindex_handle(), &meta_contents);
+            if(!s.ok()) return s;
+            meta = new Block(meta_contents);
+
+            Iterator *meta_iter = meta->NewIterator(BytewiseComparator());
+            meta_iter->Seek(kIndexTypeMetaKey);
+            if (meta_iter->Valid() && meta_iter->key() == Slice(kIndexTypeMetaKey)) {
+                Slice type = meta_iter->value();
+                if (type.size() != 1 || (type[0] != kSingleLevelIndex && type[0] != kPartitionedIndex)) {
+                    s = Status::Corruption("bad index type");
+                } else {
+                    partitioned_index = (type[0] == kPartitionedIndex);
+                }
+            }
+            delete meta_iter;
+        }
+
+        // 分区index时读取的只是顶层index
+        BlockContents index_block_contents;
+        if(s.ok()) {
+            s = ReadBlock(file, opt, footer.checksum_type(), footer.index_handle(), &index_block_contents);
+        }
 
         if(s.ok()) {
             Block* index_block = new Block(index_block_contents);
             Rep *rep = new Table::Rep;
             rep->index_block = index_block;
+            rep->partitioned_index = partitioned_index;
             rep->file = file;
             rep->options = options;
+            // 多个table共享同一个block cache，每个table申请一个独立的id
+            rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+            rep->filter = nullptr;
+            rep->filter_data = nullptr;
+            rep->data_end = footer.has_metaindex() ? footer.metaindex_handle().offset()
+                                                   : footer.index_handle().offset();
+            rep->checksum_type = footer.checksum_type();
 
             *table = new Table(rep);
+            if (meta != nullptr) {
+                (*table)->ReadMeta(meta);
+            }
+        }
+
+        delete meta;
+        return s;
+    }
+
+    Table::~Table() {
+        delete rep_->filter;
+        delete[] rep_->filter_data;
+        delete rep_->index_block;
+        delete rep_;
+    }
+
+    // 从metaindex block中找到filter block
+    // meta block是可选的，读取失败不影响table的使用，只是没有filter可用
+    void Table::ReadMeta(Block *meta) {
+        if (rep_->options.filter_policy == nullptr) {
+            return;  // Do not need any metadata
+        }
+
+        Iterator *iter = meta->NewIterator(BytewiseComparator());
+        // filter block的key是"filter." + filter policy的名字
+        // 名字不同说明filter的编码方式不同，不能使用
+        std::string key = "filter.";
+        key.append(rep_->options.filter_policy->Name());
+        iter->Seek(key);
+        if (iter->Valid() && iter->key() == Slice(key)) {
+            ReadFilter(iter->value());
         }
+        delete iter;
+    }
+
+    void Table::ReadFilter(const Slice &filter_handle_value) {
+        Slice v = filter_handle_value;
+        BlockHandle filter_handle;
+        if (!filter_handle.DecodeFrom(&v).ok()) {
+            return;
+        }
+
+        ReadOptions opt;
+        if (rep_->options.paranoid_checks) {
+            opt.verify_checksums = true;
+        }
+        BlockContents block;
+        if (!ReadBlock(rep_->file, opt, rep_->checksum_type, filter_handle, &block).ok()) {
+            return;
+        }
+        if (block.heap_allocated) {
+            rep_->filter_data = block.data.data();  // Will need to delete later
+        }
+        rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+    }
+
+    // 迭代器析构时释放没有进入cache的block
+    static void DeleteBlock(void *arg, void * /*ignored*/) {
+        delete reinterpret_cast<Block *>(arg);
+    }
+
+    // block被cache淘汰（且没有迭代器引用）时释放block
+    static void DeleteCachedBlock(const Slice & /*key*/, void *value) {
+        Block *block = reinterpret_cast<Block *>(value);
+        delete block;
+    }
 
-        return Status::OK();
+    // compressed block cache中的value：压缩后的block + 1Byte的type
+    static void DeleteCompressedBlock(const Slice & /*key*/, void *value) {
+        delete reinterpret_cast<std::string *>(value);
+    }
+
+    // 开启compressed_block_cache时，压缩过的block以这个类型放入block cache，
+    // 同时保存从磁盘读出来的压缩数据，被block cache淘汰时把它交给compressed block cache
+    class DemotableBlock : public Block {
+    public:
+        // 取走contents->compressed
+        DemotableBlock(BlockContents *contents, Cache *compressed_cache)
+                : Block(*contents),
+                  compressed_cache_(compressed_cache),
+                  compressed_(new std::string) {
+            compressed_->swap(contents->compressed);
+        }
+
+        ~DemotableBlock() {
+            delete compressed_;
+        }
+
+        size_t charge() const { return size() + compressed_->size(); }
+
+        // block cache的deleter，在block cache的锁中调用，所以这里只转交压缩数据，不做压缩
+        static void Demote(const Slice &key, void *value);
+
+    private:
+        Cache *const compressed_cache_;
+        std::string *compressed_;
+    };
+
+    void DemotableBlock::Demote(const Slice &key, void *value) {
+        DemotableBlock *block = static_cast<DemotableBlock *>(reinterpret_cast<Block *>(value));
+        std::string *compressed = block->compressed_;
+        block->compressed_ = nullptr;
+        Cache *cache = block->compressed_cache_;
+        cache->Release(cache->Insert(key, compressed, compressed->size(), &DeleteCompressedBlock));
+        delete block;
+    }
+
+    // 读取block时是否要保留压缩数据，之后放入block cache时建立DemotableBlock
+    static bool KeepCompressed(const ReadOptions &options, const Options &table_options) {
+        return table_options.block_cache != nullptr && table_options.compressed_block_cache != nullptr &&
+               options.fill_cache;
+    }
+
+    // 用读取出来的contents建立block放入block cache，返回cache的handle，block保存到*block
+    static Cache::Handle *InsertCachedBlock(const Options &table_options, const Slice &key,
+                                            BlockContents *contents, Block **block) {
+        if (table_options.compressed_block_cache != nullptr && !contents->compressed.empty()) {
+            DemotableBlock *demotable = new DemotableBlock(contents, table_options.compressed_block_cache);
+            *block = demotable;
+            return table_options.block_cache->Insert(key, demotable, demotable->charge(), &DemotableBlock::Demote);
+        }
+        *block = new Block(*contents);
+        return table_options.block_cache->Insert(key, *block, (*block)->size(), &DeleteCachedBlock);
+    }
+
+    // 先查block cache，再查compressed block cache，命中时block保存到*block
+    // compressed block cache命中时解压：fill_cache为true时把block提升回block cache（被淘汰时会再降级回来），
+    // 否则返回不在cache中的block（返回nullptr，*block由调用者释放），compressed block cache中的数据保持不动
+    // 都没有命中时返回nullptr，*block为nullptr
+    static Cache::Handle *LookupCachedBlock(const ReadOptions &options, const Options &table_options,
+                                            const Slice &key, Block **block) {
+        Cache *block_cache = table_options.block_cache;
+        Cache *compressed_cache = table_options.compressed_block_cache;
+        Statistics *statistics = table_options.statistics;
+        *block = nullptr;
+        Cache::Handle *handle = block_cache->Lookup(key);
+        if (handle != nullptr) {
+            PERF_COUNTER_ADD(block_cache_hit_count, 1);
+            RecordTick(statistics, kBlockCacheHit);
+            *block = reinterpret_cast<Block *>(block_cache->Value(handle));
+            return handle;
+        }
+
+        Cache::Handle *compressed_handle = (compressed_cache != nullptr) ? compressed_cache->Lookup(key) : nullptr;
+        if (compressed_handle == nullptr) {
+            PERF_COUNTER_ADD(block_cache_miss_count, 1);
+            RecordTick(statistics, kBlockCacheMiss);
+            return nullptr;
+        }
+        // 压缩的cache中命中也算命中，解压的耗时计入block_decompress_nanos
+        PERF_COUNTER_ADD(block_cache_hit_count, 1);
+        RecordTick(statistics, kBlockCacheHit);
+        RecordTick(statistics, kCompressedBlockCacheHit);
+        // 放入cache之前已经校验过了，这里只需要解压
+        const std::string *compressed = reinterpret_cast<std::string *>(compressed_cache->Value(compressed_handle));
+        BlockContents contents;
+        Status s = UncompressBlockContents(compressed->data(), compressed->size() - 1, false, &contents,
+                                           options.fill_cache);
+        compressed_cache->Release(compressed_handle);
+        if (!s.ok()) {
+            return nullptr;
+        }
+        if (!options.fill_cache) {
+            *block = new Block(contents);
+            return nullptr;
+        }
+
+        compressed_cache->Erase(key);
+        return InsertCachedBlock(table_options, key, &contents, block);
+    }
+
+    // 迭代器析构时释放对cache中block的引用
+    static void ReleaseBlock(void *arg, void *h) {
+        Cache *cache = reinterpret_cast<Cache *>(arg);
+        Cache::Handle *handle = reinterpret_cast<Cache::Handle *>(h);
+        cache->Release(handle);
+    }
+
+    // cache的key = cache_id(8Byte) + block的offset(8Byte)
+    static Slice BlockCacheKey(uint64_t cache_id, uint64_t offset, char *buf) {
+        EncodeFixed64(buf, cache_id);
+        EncodeFixed64(buf + 8, offset);
+        return Slice(buf, 16);
+    }
+
+    // 连续顺序读取这么多个block之后开始预读
+    static const int kReadaheadThreshold = 2;
+    // 预读窗口的初始大小，之后每次预读翻倍，直到ReadOptions::max_readahead_size
+    static const size_t kInitialReadaheadSize = 16 * 1024;
+    // Options::block_alignment在data block之前插入的padding小于一个对齐单位，而对齐单位不超过kMaxBlockAlignment
+    // 间隔小于这么多字节的两个block仍然当作首尾相接，顺序扫描和合并读取不会因为padding而中断
+    static const uint64_t kMaxBlockGap = kMaxBlockAlignment;
+
+    // 迭代器向前扫描时，逐个block地pread，每个block都要等待一次IO
+    // ScanState发现连续的顺序读取之后，用一次更大的读取把后面的若干个block读到buffer中，
+    // 开启background_prefetch时还会在后台线程提前读取下一段数据
+    //
+    // 每个迭代器有自己的ScanState，只在迭代器所在的线程中使用，
+    // 只有prefetch_开头的成员会被后台线程访问，由mutex_保护
+    struct Table::ScanState {
+        ScanState(const Table *t, const ReadOptions &options);
+
+        ~ScanState();
+
+        // 记录这次访问的block，判断是否是顺序扫描，命中cache的block也要记录
+        void Observe(const BlockHandle &handle);
+
+        // 读取handle指向的block，能用预读的数据就不再读取文件
+        // keep_compressed和ReadBlock的一样
+        Status Read(const ReadOptions &options, const BlockHandle &handle, BlockContents *result,
+                    bool keep_compressed);
+
+        // 迭代器析构时释放ScanState
+        static void Delete(void *arg, void * /*ignored*/) {
+            delete reinterpret_cast<ScanState *>(arg);
+        }
+
+        const Table *const table;
+
+    private:
+        // buf_中是否有[offset, offset + n)的数据
+        bool InBuffer(uint64_t offset, size_t n) const {
+            return offset >= buf_offset_ && offset + n <= buf_offset_ + buf_len_;
+        }
+
+        // 等待进行中的后台读取完成，如果它读取的数据覆盖了[offset, offset + n)，换到buf_中
+        void TakePrefetched(uint64_t offset, size_t n);
+
+        // 在后台读取从offset开始的下一段数据
+        void SchedulePrefetch(uint64_t offset, size_t n);
+
+        static void PrefetchWork(void *arg);
+
+        // 文件要求的读取对齐，预读的范围和buffer都按它对齐，direct I/O的文件可以直接读进buffer
+        const size_t alignment_;
+        uint64_t next_offset_;  // 上一个block之后的位置，下一个block从这里开始说明是顺序读取
+        int sequential_reads_;  // 连续顺序读取的block个数
+        size_t window_;         // 下一次预读的大小
+
+        // 预读的数据是文件中的[buf_offset_, buf_offset_ + buf_len_)
+        AlignedBuffer buf_;
+        uint64_t buf_offset_;
+        size_t buf_len_;
+
+        port::Mutex mutex_;
+        port::CondVar prefetch_done_;
+        bool prefetch_pending_;     // 后台读取已经提交，还没有完成
+        bool prefetch_ready_;       // 后台读取完成了，数据还没有被取走
+        AlignedBuffer prefetch_buf_;
+        uint64_t prefetch_offset_;
+        size_t prefetch_len_;
+        Status prefetch_status_;
+    };
+
+    Table::ScanState::ScanState(const Table *t, const ReadOptions &options)
+            : table(t),
+              alignment_(t->rep_->file->GetRequiredBufferAlignment()),
+              next_offset_(~static_cast<uint64_t>(0)),
+              sequential_reads_(0),
+              window_(std::min(kInitialReadaheadSize, options.max_readahead_size)),
+              buf_offset_(0),
+              buf_len_(0),
+              prefetch_done_(&mutex_),
+              prefetch_pending_(false),
+              prefetch_ready_(false),
+              prefetch_offset_(0),
+              prefetch_len_(0) {}
+
+    Table::ScanState::~ScanState() {
+        // 后台线程还在往prefetch_buf_中写数据，等它结束
+        mutex_.Lock();
+        while (prefetch_pending_) {
+            prefetch_done_.Wait();
+        }
+        mutex_.Unlock();
+    }
+
+    void Table::ScanState::Observe(const BlockHandle &handle) {
+        if (handle.offset() >= next_offset_ && handle.offset() - next_offset_ < kMaxBlockGap) {
+            sequential_reads_++;
+        } else {
+            // 跳到了别的地方（Seek或者反向遍历），重新开始计数，预读窗口也恢复到初始大小
+            sequential_reads_ = 0;
+            window_ = std::min(kInitialReadaheadSize, window_);
+        }
+        next_offset_ = handle.offset() + handle.size() + kBlockTrailerSize;
+    }
+
+    Status Table::ScanState::Read(const ReadOptions &options, const BlockHandle &handle, BlockContents *result,
+                                  bool keep_compressed) {
+        const Rep *rep = table->rep_;
+        const uint64_t offset = handle.offset();
+        const size_t n = static_cast<size_t>(handle.size()) + kBlockTrailerSize;
+        // mmap的文件读取时没有IO，不需要预读
+        const bool sequential = sequential_reads_ > 0 && !rep->file->IsMemoryMapped();
+
+        if (!InBuffer(offset, n) && sequential) {
+            TakePrefetched(offset, n);
+        }
+
+        Status s;
+        if (!InBuffer(offset, n) && sequential && sequential_reads_ >= kReadaheadThreshold && window_ > 0) {
+            // 一次读取从这个block开始的整个窗口
+            size_t len = std::max(n, window_);
+            if (offset + len > rep->data_end) {
+                len = std::max(n, static_cast<size_t>(rep->data_end - std::min(offset, rep->data_end)));
+            }
+            uint64_t read_offset = offset;
+            AlignReadRange(alignment_, &read_offset, &len);
+            buf_.Reserve(alignment_, len);
+            Slice contents;
+            {
+                PERF_TIMER_GUARD(block_read_nanos);
+                s = rep->file->Read(read_offset, len, &contents, buf_.data());
+            }
+            PERF_COUNTER_ADD(block_read_count, 1);
+            PERF_COUNTER_ADD(block_read_bytes, contents.size());
+            buf_offset_ = read_offset;
+            buf_len_ = 0;
+            if (s.ok()) {
+                if (contents.data() != buf_.data()) {
+                    memcpy(buf_.data(), contents.data(), contents.size());
+                }
+                buf_len_ = contents.size();
+            }
+            window_ = std::min(window_ * 2, options.max_readahead_size);
+        }
+
+        if (InBuffer(offset, n)) {
+            // buf_会被之后的预读覆盖，未压缩的block也要拷贝一份
+            s = DecodeBlockContents(buf_.data() + (offset - buf_offset_), n - kBlockTrailerSize, false, options,
+                                    rep->checksum_type, result, keep_compressed);
+        } else if (s.ok()) {
+            s = ReadBlock(rep->file, options, rep->checksum_type, handle, result, keep_compressed);
+        }
+
+        if (s.ok() && sequential && options.background_prefetch) {
+            // buffer中剩下的数据可能已经放不下下一个block了，从下一个block开始在后台读取
+            // 不知道下一个block有多大，按和当前block差不多大估计
+            const uint64_t next = offset + n;
+            const uint64_t buffered_end = InBuffer(offset, n) ? buf_offset_ + buf_len_ : next;
+            if (buffered_end - next < n) {
+                SchedulePrefetch(next, std::max(window_, 2 * n));
+            }
+        }
+        return s;
+    }
+
+    void Table::ScanState::TakePrefetched(uint64_t offset, size_t n) {
+        MutexLock l(&mutex_);
+        if (!prefetch_pending_ && !prefetch_ready_) {
+            return;
+        }
+        if (offset < prefetch_offset_ || offset + n > prefetch_offset_ + prefetch_len_) {
+            // 后台读取的不是这一段数据，正在进行的读取完成之后丢弃
+            if (!prefetch_pending_) {
+                prefetch_ready_ = false;
+            }
+            return;
+        }
+        while (prefetch_pending_) {
+            prefetch_done_.Wait();
+        }
+        prefetch_ready_ = false;
+        if (!prefetch_status_.ok()) {
+            return;  // 读取失败了，由前台重新读取并报告错误
+        }
+        buf_.Swap(&prefetch_buf_);
+        buf_offset_ = prefetch_offset_;
+        buf_len_ = prefetch_len_;
+    }
+
+    void Table::ScanState::SchedulePrefetch(uint64_t offset, size_t n) {
+        const Rep *rep = table->rep_;
+        if (offset >= rep->data_end) {
+            return;  // 已经是最后一个data block了
+        }
+        n = static_cast<size_t>(std::min<uint64_t>(n, rep->data_end - offset));
+
+        MutexLock l(&mutex_);
+        if (prefetch_pending_) {
+            return;
+        }
+        if (prefetch_ready_ && offset >= prefetch_offset_ && offset < prefetch_offset_ + prefetch_len_) {
+            return;  // 已经读取好了
+        }
+        AlignReadRange(alignment_, &offset, &n);
+        prefetch_buf_.Reserve(alignment_, n);
+        prefetch_pending_ = true;
+        prefetch_ready_ = false;
+        prefetch_offset_ = offset;
+        prefetch_len_ = n;
+        // 迭代器马上就要用到这些数据，放到高优先级的线程池，不排在低优先级的后台工作后面
+        rep->options.env->Schedule(&ScanState::PrefetchWork, this, Env::kHigh);
+    }
+
+    void Table::ScanState::PrefetchWork(void *arg) {
+        ScanState *state = reinterpret_cast<ScanState *>(arg);
+        // prefetch_pending_为true时前台不会修改这些成员
+        Slice contents;
+        Status s = state->table->rep_->file->Read(state->prefetch_offset_, state->prefetch_len_,
+                                                  &contents, state->prefetch_buf_.data());
+        if (s.ok() && contents.data() != state->prefetch_buf_.data()) {
+            memcpy(state->prefetch_buf_.data(), contents.data(), contents.size());
+        }
+
+        MutexLock l(&state->mutex_);
+        state->prefetch_status_ = s;
+        state->prefetch_len_ = s.ok() ? contents.size() : 0;
+        state->prefetch_pending_ = false;
+        state->prefetch_ready_ = true;
+        state->prefetch_done_.SignalAll();
     }
 
     Iterator *Table::BlockReader(void *arg, const ReadOptions &options, const Slice &index_value) {
-        Table *table = reinterpret_cast<Table *>(arg);
+        return OpenBlock(reinterpret_cast<Table *>(arg), options, index_value, nullptr, false);
+    }
+
+    Iterator *Table::ScanBlockReader(void *arg, const ReadOptions &options, const Slice &index_value) {
+        ScanState *scan = reinterpret_cast<ScanState *>(arg);
+        return OpenBlock(scan->table, options, index_value, scan, false);
+    }
+
+    Iterator *Table::OpenBlock(const Table *table, const ReadOptions &options, const Slice &index_value,
+                               ScanState *scan, bool point_lookup) {
+        Cache *block_cache = table->rep_->options.block_cache;
+        Block *block = nullptr;
+        Cache::Handle *cache_handle = nullptr;
 
         BlockHandle handle;
         Slice input = index_value;
-        BlockContents contents;
-        handle.DecodeFrom(&input);
+        Status s = handle.DecodeFrom(&input);
 
-        Status s = ReadBlock(table->rep_->file, options, handle, &contents);
-        Block *block = new Block(contents);
+        if (s.ok()) {
+            if (scan != nullptr) {
+                scan->Observe(handle);
+            }
+
+            char cache_key_buffer[16];
+            Slice key;
+            if (block_cache != nullptr) {
+                key = BlockCacheKey(table->rep_->cache_id, handle.offset(), cache_key_buffer);
+                // 命中cache，省去一次pread、crc校验和解压缩
+                cache_handle = LookupCachedBlock(options, table->rep_->options, key, &block);
+            }
 
-        return block->NewIterator(table->rep_->options.comparator);
+            if (block == nullptr) {
+                Statistics *statistics = table->rep_->options.statistics;
+                const bool keep_compressed = KeepCompressed(options, table->rep_->options);
+                BlockContents contents;
+                {
+                    StopWatch sw(statistics, kBlockReadNanos);
+                    s = (scan != nullptr) ? scan->Read(options, handle, &contents, keep_compressed)
+                                          : ReadBlock(table->rep_->file, options, table->rep_->checksum_type, handle,
+                                                      &contents, keep_compressed);
+                }
+                RecordTick(statistics, kBlockRead);
+                RecordTick(statistics, kBlockReadBytes, handle.size() + kBlockTrailerSize);
+                if (s.ok()) {
+                    // 只有从堆上读取出来的block才需要cache，mmap的数据本来就在内存中
+                    if (block_cache != nullptr && contents.cachable && options.fill_cache) {
+                        cache_handle = InsertCachedBlock(table->rep_->options, key, &contents, &block);
+                    } else {
+                        block = new Block(contents);
+                    }
+                }
+            }
+        }
+
+        Iterator *iter;
+        if (block != nullptr) {
+            iter = block->NewIterator(table->rep_->options.comparator, point_lookup);
+            if (cache_handle == nullptr) {
+                iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+            } else {
+                iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+            }
+        } else {
+            iter = NewErrorIterator(s);
+        }
+
+        return iter;
+    }
+
+    Iterator *Table::NewIndexIterator(const ReadOptions &options) const {
+        if (!rep_->partitioned_index) {
+            return rep_->index_block->NewIterator(rep_->options.comparator);
+        }
+        // 顶层index的value是分区的handle，用BlockReader打开分区（经过block cache），
+        // 两层拼起来就是完整的index
+        return NewTwoLevelIterator(rep_->index_block->NewIterator(rep_->options.comparator),
+                                   &Table::BlockReader, const_cast<Table *>(this), options);
+    }
+
+    Iterator *Table::NewIterator(const ReadOptions &options) const {
+        // 第一层遍历index block，第二层用ScanBlockReader打开index entry指向的data block
+        // ScanState记录扫描的进度用来预读，和迭代器一起释放
+        ScanState *scan = new ScanState(this, options);
+        Iterator *iter = NewTwoLevelIterator(NewIndexIterator(options), &Table::ScanBlockReader, scan, options);
+        iter->RegisterCleanup(&ScanState::Delete, scan, nullptr);
+        return iter;
     }
 
     Status Table::InternalGet(const ReadOptions &options, const Slice &key,
-                              void (*handle_result)(const Slice &, const Slice &)) {
+                              void (*handle_result)(const Slice &, const Slice &)) const {
         Status s;
+        PERF_TIMER_GUARD(get_nanos);
+        PERF_COUNTER_ADD(get_count, 1);
+        StopWatch sw(rep_->options.statistics, kGetNanos);
 
         // 给index block建立迭代器
-        Iterator *iterator = rep_->index_block->NewIterator(rep_->options.comparator);
+        PerfStepTimer index_seek_timer(&perf_context.index_seek_nanos);
+        Iterator *iterator = NewIndexIterator(options);
 
         // 定位到key
         iterator->Seek(key);
+        index_seek_timer.Stop();
 
         if(iterator->Valid()){
             // 去除datablock的handle
             Slice handle_value = iterator->value();
-            // handle中有datablock的offset和size
-            // 用blockreader根据datablock handle建立datablock的迭代器
-            Iterator *block_iter = BlockReader(this, options, handle_value);
-            // 定位到key
-            block_iter->Seek(key);
-            if(block_iter->Valid()){
-                // 用handle_result函数处理kv对
-                (*handle_result)(block_iter->key(), block_iter->value());
-            }
-            s = block_iter->status();
-            delete block_iter;
+            FilterBlockReader *filter = rep_->filter;
+            BlockHandle handle;
+            // 先查filter，filter说key不存在就不用读取data block了
+            if (filter != nullptr) {
+                PERF_COUNTER_ADD(filter_check_count, 1);
+            }
+            if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
+                !filter->KeyMayMatch(handle.offset(), key)) {
+                // Not found
+                PERF_COUNTER_ADD(filter_useful_count, 1);
+                RecordTick(rep_->options.statistics, kFilterUseful);
+            } else {
+                // handle中有datablock的offset和size
+                // 用blockreader根据datablock handle建立datablock的迭代器
+                // 点查询的迭代器，data block有hash index时不用二分查找
+                Iterator *block_iter = OpenBlock(this, options, iterator->value(), nullptr, true);
+                // 定位到key
+                block_iter->Seek(key);
+                if(block_iter->Valid()){
+                    // 用handle_result函数处理kv对
+                    (*handle_result)(block_iter->key(), block_iter->value());
+                }
+                s = block_iter->status();
+                delete block_iter;
+            }
         }
 
         if(s.ok()){
@@ -88,4 +669,274 @@ namespace leveldb{
         delete iterator;
         return s;
     }
-}
\ No newline at end of file
+
+    // 合并读取时一次读取的最大长度，避免为了合并而分配一个巨大的buffer
+    static const size_t kMaxCoalescedReadSize = 256 * 1024;
+
+    namespace {
+        // MultiGet中的一个data block，以及要在这个block中查找的key
+        struct MultiGetBlock {
+            BlockHandle handle;
+            std::vector<size_t> key_indexes;  // key在keys中的下标，按key的顺序排列
+
+            Block *block = nullptr;
+            Cache::Handle *cache_handle = nullptr;  // block不在cache中时为nullptr
+            Status status;
+        };
+    }
+
+    // 用读取出来的contents建立block，需要的话放入cache
+    static void InstallMultiGetBlock(const ReadOptions &options, const Options &table_options, uint64_t cache_id,
+                                     BlockContents *contents, MultiGetBlock *b) {
+        if (table_options.block_cache != nullptr && contents->cachable && options.fill_cache) {
+            char cache_key_buffer[16];
+            Slice key = BlockCacheKey(cache_id, b->handle.offset(), cache_key_buffer);
+            b->cache_handle = InsertCachedBlock(table_options, key, contents, &b->block);
+        } else {
+            b->block = new Block(*contents);
+        }
+    }
+
+    // blocks[0, n)在文件中是首尾相接的（中间最多隔着不到kMaxBlockGap的padding或者小block），
+    // 用一次读取得到的contents中逐个解析出block
+    // buf是读取时传入的new[]分配的scratch（mmap或者用AlignedBuffer读取时为nullptr），由这个函数负责释放
+    // data_is_stable和DecodeBlockContents的一样
+    static void DecodeCoalescedBlocks(const ReadOptions &options, ChecksumType checksum_type,
+                                      const Options &table_options, uint64_t cache_id,
+                                      MultiGetBlock *blocks, size_t n,
+                                      Status s, const Slice &contents, char *buf, bool data_is_stable) {
+        const uint64_t start = blocks[0].handle.offset();
+        const uint64_t end = blocks[n - 1].handle.offset() + blocks[n - 1].handle.size() + kBlockTrailerSize;
+        if (s.ok() && contents.size() != end - start) {
+            s = Status::Corruption("truncated block read");
+        }
+        if (!s.ok()) {
+            for (size_t i = 0; i < n; i++) {
+                blocks[i].status = s;
+            }
+            delete[] buf;
+            return;
+        }
+
+        const bool keep_compressed = KeepCompressed(options, table_options);
+        // 只有一个block且数据在buf中，把buf直接交给block，未压缩时可以省去一次拷贝
+        if (n == 1 && buf != nullptr && contents.data() == buf) {
+            BlockContents block_contents;
+            blocks[0].status = DecodeHeapBlockContents(buf, static_cast<size_t>(blocks[0].handle.size()),
+                                                       options, checksum_type, &block_contents, keep_compressed);
+            if (blocks[0].status.ok()) {
+                InstallMultiGetBlock(options, table_options, cache_id, &block_contents, &blocks[0]);
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            MultiGetBlock &b = blocks[i];
+            BlockContents block_contents;
+            b.status = DecodeBlockContents(contents.data() + (b.handle.offset() - start),
+                                           static_cast<size_t>(b.handle.size()),
+                                           data_is_stable, options, checksum_type, &block_contents,
+                                           keep_compressed);
+            if (b.status.ok()) {
+                InstallMultiGetBlock(options, table_options, cache_id, &block_contents, &b);
+            }
+        }
+        delete[] buf;
+    }
+
+    void Table::MultiGet(const ReadOptions &options, const std::vector<Slice> &keys,
+                         std::vector<std::string> *values,
+                         std::vector<Status> *statuses) const {
+        const Comparator *comparator = rep_->options.comparator;
+        const size_t num_keys = keys.size();
+        values->assign(num_keys, std::string());
+        statuses->assign(num_keys, Status::NotFound(Slice()));
+
+        // 把key排序，这样只需要从前往后遍历一次index block
+        std::vector<size_t> order(num_keys);
+        for (size_t i = 0; i < num_keys; i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return comparator->Compare(keys[a], keys[b]) < 0;
+        });
+
+        // 遍历index block，把落在同一个data block中的key分到一组
+        std::vector<MultiGetBlock> blocks;
+        Iterator *index_iter = NewIndexIterator(options);
+        for (size_t i = 0; i < num_keys; i++) {
+            const size_t k = order[i];
+
+            // 当前index entry的key ≥ 上一个key，如果它也 ≥ 这个key，
+            // 那么这个key和上一个key在同一个data block里，不需要再Seek
+            if (i == 0 || comparator->Compare(index_iter->key(), keys[k]) < 0) {
+                index_iter->Seek(keys[k]);
+            }
+            // 后面的key都比最后一个data block中的key大
+            if (!index_iter->Valid()) {
+                break;
+            }
+
+            Slice handle_value = index_iter->value();
+            BlockHandle handle;
+            Status s = handle.DecodeFrom(&handle_value);
+            if (!s.ok()) {
+                (*statuses)[k] = s;
+                continue;
+            }
+
+            // filter说key不存在就不用读取data block了
+            if (rep_->filter != nullptr && !rep_->filter->KeyMayMatch(handle.offset(), keys[k])) {
+                continue;
+            }
+
+            if (blocks.empty() || blocks.back().handle.offset() != handle.offset()) {
+                blocks.emplace_back();
+                blocks.back().handle = handle;
+            }
+            blocks.back().key_indexes.push_back(k);
+        }
+
+        Status index_status = index_iter->status();
+        delete index_iter;
+        if (!index_status.ok()) {
+            statuses->assign(num_keys, index_status);
+            return;
+        }
+
+        // 先查cache
+        Cache *block_cache = rep_->options.block_cache;
+        if (block_cache != nullptr) {
+            char cache_key_buffer[16];
+            for (MultiGetBlock &b : blocks) {
+                Slice key = BlockCacheKey(rep_->cache_id, b.handle.offset(), cache_key_buffer);
+                b.cache_handle = LookupCachedBlock(options, rep_->options, key, &b.block);
+            }
+        }
+
+        // 没有命中cache的block中，文件里首尾相接（或者间隔不到kMaxBlockGap）的合并成一次读取
+        // blocks是按offset排好序的，ranges中的每一项是blocks中的[begin, end)
+        std::vector<std::pair<size_t, size_t>> ranges;
+        Statistics *statistics = rep_->options.statistics;
+        size_t i = 0;
+        while (i < blocks.size()) {
+            if (blocks[i].block != nullptr) {
+                i++;
+                continue;
+            }
+
+            size_t j = i + 1;
+            uint64_t start = blocks[i].handle.offset();
+            uint64_t end = start + blocks[i].handle.size() + kBlockTrailerSize;
+            while (j < blocks.size() && blocks[j].block == nullptr && blocks[j].handle.offset() >= end &&
+                   blocks[j].handle.offset() - end < kMaxBlockGap &&
+                   blocks[j].handle.offset() + blocks[j].handle.size() + kBlockTrailerSize - start <=
+                   kMaxCoalescedReadSize) {
+                end = blocks[j].handle.offset() + blocks[j].handle.size() + kBlockTrailerSize;
+                j++;
+            }
+            ranges.emplace_back(i, j);
+            for (size_t k = i; k < j; k++) {
+                RecordTick(statistics, kBlockRead);
+                RecordTick(statistics, kBlockReadBytes, blocks[k].handle.size() + kBlockTrailerSize);
+            }
+            i = j;
+        }
+
+        if (rep_->file->IsMemoryMapped()) {
+            // mmap的文件读取只是返回映射区域中的指针，逐个读取就好
+            for (const auto &range : ranges) {
+                MultiGetBlock *first = &blocks[range.first];
+                MultiGetBlock *last = &blocks[range.second - 1];
+                const uint64_t start = first->handle.offset();
+                const uint64_t end = last->handle.offset() + last->handle.size() + kBlockTrailerSize;
+                Slice contents;
+                Status s;
+                {
+                    PERF_TIMER_GUARD(block_read_nanos);
+                    s = rep_->file->Read(start, static_cast<size_t>(end - start), &contents, nullptr);
+                }
+                PERF_COUNTER_ADD(block_read_count, 1);
+                PERF_COUNTER_ADD(block_read_bytes, contents.size());
+                DecodeCoalescedBlocks(options, rep_->checksum_type, rep_->options, rep_->cache_id, first,
+                                      range.second - range.first, s, contents, nullptr, true);
+            }
+        } else if (!ranges.empty()) {
+            // 所有读取一起交给MultiRead，底层支持异步IO（比如io_uring）时这些读取会同时进行
+            // 文件要求对齐时，读取范围扩大到对齐的边界，直接读到对齐的buffer中
+            const size_t alignment = rep_->file->GetRequiredBufferAlignment();
+            std::vector<AlignedBuffer> aligned_bufs(alignment > 1 ? ranges.size() : 0);
+            std::vector<ReadRequest> reqs(ranges.size());
+            for (size_t r = 0; r < ranges.size(); r++) {
+                const MultiGetBlock &first = blocks[ranges[r].first];
+                const MultiGetBlock &last = blocks[ranges[r].second - 1];
+                reqs[r].offset = first.handle.offset();
+                reqs[r].n = static_cast<size_t>(last.handle.offset() + last.handle.size() + kBlockTrailerSize -
+                                                reqs[r].offset);
+                if (alignment > 1) {
+                    AlignReadRange(alignment, &reqs[r].offset, &reqs[r].n);
+                    aligned_bufs[r].Reserve(alignment, reqs[r].n);
+                    reqs[r].scratch = aligned_bufs[r].data();
+                } else {
+                    reqs[r].scratch = new char[reqs[r].n];
+                }
+            }
+            {
+                PERF_TIMER_GUARD(block_read_nanos);
+                rep_->file->MultiRead(reqs.data(), reqs.size());
+            }
+            PERF_COUNTER_ADD(block_read_count, reqs.size());
+            for (const ReadRequest &req : reqs) {
+                PERF_COUNTER_ADD(block_read_bytes, req.result.size());
+            }
+            for (size_t r = 0; r < ranges.size(); r++) {
+                MultiGetBlock *first = &blocks[ranges[r].first];
+                if (alignment > 1) {
+                    // 去掉对齐时多读的部分，长度不够时由DecodeCoalescedBlocks报告truncated
+                    const size_t skip = static_cast<size_t>(first->handle.offset() - reqs[r].offset);
+                    const Slice &result = reqs[r].result;
+                    const Slice contents = (result.size() > skip) ? Slice(result.data() + skip, result.size() - skip)
+                                                                  : Slice();
+                    const MultiGetBlock &last = blocks[ranges[r].second - 1];
+                    const size_t want = static_cast<size_t>(last.handle.offset() + last.handle.size() +
+                                                            kBlockTrailerSize - first->handle.offset());
+                    DecodeCoalescedBlocks(options, rep_->checksum_type, rep_->options, rep_->cache_id, first,
+                                          ranges[r].second - ranges[r].first, reqs[r].status,
+                                          Slice(contents.data(), std::min(contents.size(), want)), nullptr, false);
+                } else {
+                    DecodeCoalescedBlocks(options, rep_->checksum_type, rep_->options, rep_->cache_id, first,
+                                          ranges[r].second - ranges[r].first, reqs[r].status, reqs[r].result,
+                                          reqs[r].scratch, reqs[r].result.data() != reqs[r].scratch);
+                }
+            }
+        }
+
+        // 在每个block中查找属于它的key，key是有序的，迭代器可以利用上一次Seek的位置
+        for (MultiGetBlock &b : blocks) {
+            if (b.block == nullptr) {
+                for (size_t k : b.key_indexes) {
+                    (*statuses)[k] = b.status;
+                }
+                continue;
+            }
+
+            Iterator *block_iter = b.block->NewIterator(comparator, true);
+            for (size_t k : b.key_indexes) {
+                block_iter->Seek(keys[k]);
+                if (block_iter->Valid() && comparator->Compare(block_iter->key(), keys[k]) == 0) {
+                    (*values)[k].assign(block_iter->value().data(), block_iter->value().size());
+                    (*statuses)[k] = Status::OK();
+                } else if (!block_iter->status().ok()) {
+                    (*statuses)[k] = block_iter->status();
+                }
+            }
+            delete block_iter;
+
+            if (b.cache_handle != nullptr) {
+                block_cache->Release(b.cache_handle);
+            } else {
+                delete b.block;
+            }
+        }
+    }
+}
@@ -1,6 +1,9 @@
 #ifndef SSTABLE_TABLE_H
 #define SSTABLE_TABLE_H
 
+#include <string>
+#include <vector>
+
 #include "status.h"
 #include "iterator.h"
 #include "options.h"
@@ -13,21 +16,67 @@ namespace leveldb {
 
     class RandomAccessFile;
 
+    // Table打开之后只读，多个线程可以不加锁地同时调用它的const方法：
+    // index block和filter在Open时读入，之后不再修改；
+    // 每次查询和每个迭代器使用各自的迭代器状态；
+    // 从文件读取的data block由读取它的查询或迭代器独占，用完即释放，
+    // 放入block cache的block靠cache handle的引用计数管理，被淘汰且没有引用时才释放
     class Table {
     public:
+        // 成功时*table指向新打开的table，用完之后由调用者delete
+        // file在table的生命周期内必须有效，table不负责关闭和释放它
         static Status Open(const Options &options, RandomAccessFile *file,
                            uint64_t size, Table **table);
 
         Table(const Table &) = delete;
 
+        Table &operator=(const Table &) = delete;
+
+        // 调用之前必须释放这个table的所有迭代器
+        ~Table();
+
+        // 返回一个遍历table中所有kv对的迭代器
+        // 返回的迭代器一开始是无效的，使用前必须调用某个Seek方法
+        Iterator *NewIterator(const ReadOptions &) const;
+
         Status InternalGet(const ReadOptions &, const Slice &key,
-                           void (*handle_result)(const Slice &k, const Slice &v));
+                           void (*handle_result)(const Slice &k, const Slice &v)) const;
+
+        // 批量查询keys中的每一个key
+        // 查询结束后(*values)[i]和(*statuses)[i]是keys[i]的查询结果，
+        // key不存在时(*statuses)[i]为NotFound
+        //
+        // 和逐个调用InternalGet相比，只遍历一次index block，
+        // 同一个data block中的key只读取一次block，
+        // 文件中相邻的data block合并成一次更大的读取
+        void MultiGet(const ReadOptions &, const std::vector<Slice> &keys,
+                      std::vector<std::string> *values,
+                      std::vector<Status> *statuses) const;
 
     private:
         struct Rep;
+        // 一个迭代器顺序扫描时的预读状态
+        struct ScanState;
+
+        void ReadMeta(Block *meta);
+
+        void ReadFilter(const Slice &filter_handle_value);
+
+        // 遍历index的迭代器，value是data block的handle
+        // 分区index时是顶层index和分区组成的两层迭代器
+        Iterator *NewIndexIterator(const ReadOptions &options) const;
+
+        static Iterator *BlockReader(void *arg, const ReadOptions &options,
+                                     const Slice &index_value);
+
+        // 迭代器使用的BlockReader，arg是迭代器的ScanState
+        static Iterator *ScanBlockReader(void *arg, const ReadOptions &options,
+                                         const Slice &index_value);
 
-        Iterator *BlockReader(void *arg, const ReadOptions &options,
-                              const Slice &index_value);
+        // 打开index_value指向的data block，scan不为nullptr时通过它预读
+        // point_lookup为true时返回点查询用的迭代器，见Block::NewIterator
+        static Iterator *OpenBlock(const Table *table, const ReadOptions &options,
+                                   const Slice &index_value, ScanState *scan, bool point_lookup);
 
         explicit Table(Rep *rep) : rep_(rep) {};
 
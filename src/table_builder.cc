@@ -1,5 +1,16 @@
 #include "table_builder.h"
 
+#include "../include/compressor.h"
+#include "../util/mutexlock.h"
+#include "../util/statistics_imp.h"
+#include "filter_block.h"
+
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
+
 namespace leveldb {
     // 这里之所以要特意用一个结构体来存储变量而不直接在类中定义变量
     // 是因为table_builder.cc是供用户使用的
@@ -14,9 +25,14 @@ namespace leveldb {
                   data_block(&opt),
                   file(f),
                   offset(0),
-                  pending_index_entry(false)// 刚刚开始时，不向index block写入数据
+                  pending_index_entry(false),// 刚刚开始时，不向index block写入数据
+                  filter_block(opt.filter_policy == nullptr ? nullptr
+                                                            : new FilterBlockBuilder(opt.filter_policy)),
+                  work_cv(&pipeline_mu),
+                  done_cv(&pipeline_mu)
                   {
-
+            // index block和metaindex block只用二分查找，不需要hash index
+            index_block_options.block_hash_index = false;
         }
 
         Options options;
@@ -33,16 +49,138 @@ namespace leveldb {
         std::string compressed_output;
         uint64_t offset;
 
+        // 没有配置filter_policy时为nullptr
+        FilterBlockBuilder *filter_block;
+
         std::string last_key;
+
+        // Options::adaptive_compression的状态
+        // 最近尝试压缩的block的压缩率（压缩后大小 / 原大小）的指数移动平均
+        double compression_ratio = 0.0;
+        // 移动平均超过kBypassCompressionRatio时跳过压缩，只做抽样
+        bool compression_bypassed = false;
+        // 上一次抽样之后跳过压缩的block数
+        int blocks_since_sample = 0;
+        CompressionStats compression_stats;
+
+        // 分区index模式下已经写满的index分区，Finish时写入文件
+        // first是分区中最后一个key，second是分区block的内容
+        std::vector<std::pair<std::string, std::string>> index_partitions;
+
+        // Options::parallel_compression_threads > 1时的并行压缩流水线
+        // inflight是按文件顺序等待写入的data block，只由调用TableBuilder的线程访问
+        // compress_queue是等待worker压缩的block，和ParallelBlock::done一起由pipeline_mu保护
+        port::Mutex pipeline_mu;
+        port::CondVar work_cv;  // compress_queue中有新的block，或者要关闭worker
+        port::CondVar done_cv;  // 有block压缩完成
+        std::deque<ParallelBlock *> inflight;
+        std::deque<ParallelBlock *> compress_queue;
+        bool shutting_down = false;
+        std::vector<std::thread> workers;
+        // 并行压缩，或者data block写入前可能有对齐的padding时，block写入文件、知道了offset之后才能把key加入filter
+        // 这时当前data block中的key先缓存在pending_filter_keys中
+        const bool defer_filter_keys = options.parallel_compression_threads > 1 || options.block_alignment > 0;
+        std::vector<std::string> pending_filter_keys;
+    };
+
+    // 交给worker压缩的一个data block
+    struct TableBuilder::ParallelBlock {
+        std::string raw;
+        // Flush时决定尝试的压缩类型，kNoCompression表示不压缩
+        CompressionType attempted_type;
+
+        // 以下由worker填写，done之后调用TableBuilder的线程才能读取
+        std::string compressed;
+        bool use_compressed = false;
+        double ratio = 1.0;
+        char trailer[kBlockTrailerSize];
+        bool done = false;
+
+        // 以下只由调用TableBuilder的线程访问
+        std::vector<std::string> filter_keys;
+        // 这个block在index中的key，下一个block的第一个key加入时（或者Finish时）才能确定
+        std::string index_key;
     };
 
+    // 自适应压缩：压缩率的移动平均超过这个值时跳过压缩
+    // 和保留压缩结果的条件（至少节省1/8）一致
+    static const double kBypassCompressionRatio = 7.0 / 8;
+    // 每个新block的压缩率在移动平均中的权重，连续8个不可压缩的block之后开始跳过压缩
+    static const double kCompressionRatioWeight = 0.25;
+    // 跳过压缩期间每隔这么多个block抽样压缩一次，看数据是否又变得可以压缩了
+    static const int kCompressionSampleInterval = 16;
+
+    // 压缩raw，压缩结果保存到compressed，压缩率保存到ratio（压缩失败时为1）
+    // 返回压缩结果是否值得使用：压缩成功，且至少节省1/8，说明压缩了之后不会增加解析时间
+    static bool CompressBlock(const Options &options, CompressionType type, const Slice &raw,
+                              std::string *compressed, double *ratio) {
+        // 没有对应的Compressor，或者编译时没有对应的压缩库，压缩就会失败
+        const Compressor *compressor = GetCompressor(type);
+        const bool ok = compressor != nullptr && compressor->Compress(options, raw, compressed);
+        *ratio = 1.0;
+        if (ok && !raw.empty()) {
+            *ratio = std::min(1.0, static_cast<double>(compressed->size()) / raw.size());
+        }
+        return ok && compressed->size() < raw.size() - (raw.size() / 8u);
+    }
+
+    // 生成block的trailer：1Byte的type + 4Byte的校验值
+    static void BuildBlockTrailer(ChecksumType checksum, const Slice &block_contents, CompressionType type,
+                                  char *trailer) {
+        // 赋值入压缩的类型
+        trailer[0] = type;
+
+        // 按checksum计算block数据 + type的校验值，写入到trailer的后4个Byte
+        // crc32c会计算掩码，注释说只计算crc值会有问题
+        // 这里有更详细的讨论: https://stackoverflow.com/questions/61639618/why-leveldb-and-rocksdb-need-a-masked-crc32
+        EncodeFixed32(trailer + 1, ComputeBlockChecksum(checksum, block_contents.data(),
+                                                        block_contents.size(), trailer[0]));
+    }
+
     TableBuilder::TableBuilder(const Options &options, WritableFile *file)
         :rep_(new Rep(options, file)){
+        // 更大的对齐单位插入的padding会让读取时认为block不再首尾相接，顺序预读和合并读取都会失效
+        if (options.block_alignment > kMaxBlockAlignment) {
+            rep_->status = Status::InvalidArgument("block_alignment exceeds 4096");
+        }
+        // 第一个data block从偏移量0开始
+        if (rep_->filter_block != nullptr) {
+            rep_->filter_block->StartBlock(0);
+        }
+        for (int i = 0; i < options.parallel_compression_threads && parallel(); i++) {
+            rep_->workers.emplace_back(&TableBuilder::CompressionWorker, this);
+        }
+    }
 
+    TableBuilder::~TableBuilder() {
+        Rep *r = rep_;
+        if (!r->workers.empty()) {
+            {
+                // 没有Finish就放弃的table，还没压缩的block也不用压缩了
+                MutexLock l(&r->pipeline_mu);
+                r->compress_queue.clear();
+                r->shutting_down = true;
+                r->work_cv.SignalAll();
+            }
+            for (std::thread &worker : r->workers) {
+                worker.join();
+            }
+            for (ParallelBlock *b : r->inflight) {
+                delete b;
+            }
+        }
+        delete rep_->filter_block;
+        delete rep_;
+    }
+
+    bool TableBuilder::parallel() const {
+        return rep_->options.parallel_compression_threads > 1;
     }
 
     void TableBuilder::Add(const Slice &key, const Slice &value) {
         Rep *r = rep_;
+        StopWatch sw(r->options.statistics, kTableAddNanos);
+        if (!ok()) return;
 
         // 如果之前持久化了一个datablock，则准备向index block插入一条指向它的kv对
         if (r->pending_index_entry) {
@@ -50,15 +188,29 @@ namespace leveldb {
             // 比如说zzzzb + zzc = zzzd
             r->options.comparator->FindShortestSeparator(&r->last_key, key);
 
-            // 把datablock的handle编码为字符串
-            std::string handle_encoding;
-            r->pending_handle.EncodeTo(&handle_encoding);
+            if (parallel()) {
+                // block可能还在压缩，不知道handle，写入文件时再加入index block
+                r->inflight.back()->index_key = r->last_key;
+            } else {
+                // 把datablock的handle编码为字符串
+                std::string handle_encoding;
+                r->pending_handle.EncodeTo(&handle_encoding);
 
-            // 写入index block
-            r->index_block.Add(r->last_key, Slice(handle_encoding));
+                // 写入index block
+                AddIndexEntry(r->last_key, Slice(handle_encoding));
+            }
             r->pending_index_entry = false;
         }
 
+        // 把key加入当前data block对应的filter
+        if (r->filter_block != nullptr) {
+            if (r->defer_filter_keys) {
+                r->pending_filter_keys.push_back(key.ToString());
+            } else {
+                r->filter_block->AddKey(key);
+            }
+        }
+
         // 更新last_key，由于不用前缀压缩，所以直接把key复制进来
         r->last_key.assign(key.data(), key.size());
         // 写入datablock
@@ -76,9 +228,22 @@ namespace leveldb {
     void TableBuilder::Flush() {
         Rep *r = rep_;
 
+        // Add()刚好写满一个block之后调用Finish()，此时data block是空的，不需要再写一个空block
+        // 否则会覆盖掉上一个block的pending_handle，导致它的index entry丢失
+        if (r->data_block.empty() || !ok()) return;
+
+        if (parallel()) {
+            SubmitBlock();
+            if (ok()) {
+                r->pending_index_entry = true;
+            }
+            return;
+        }
+
         // 持久化到磁盘，并生成BlockHandle到pending_handle
         // 先用snappy压缩，后进行crc编码，最终持久化到磁盘
-        WriteBlock(&r->data_block, &r->pending_handle);
+        CompressAndWriteBlock(r->data_block.Finish(), &r->pending_handle, true);
+        r->data_block.Reset();
 
         if(ok()){
             r->pending_index_entry = true;
@@ -86,57 +251,251 @@ namespace leveldb {
             // 甚至是FTL的cache里
             r->status = r->file->Flush();
         }
+
+        // 下一个data block从当前文件尾开始
+        if (r->filter_block != nullptr) {
+            r->filter_block->StartBlock(r->offset);
+        }
     }
 
     // 持久化一个Block
-    // 本函数的工作是对block中的数据进行压缩（如果需要的话）
-    // 压缩之后调用WriteRawBlock真正进行持久化
+    // 合并block的数据之后交给CompressAndWriteBlock
     void TableBuilder::WriteBlock(BlockBuilder *block, BlockHandle *handle) {
-        Rep *r = rep_;
         // 将Block的各个部分合并
-        Slice raw = block->Finish();
+        CompressAndWriteBlock(block->Finish(), handle);
+        // 重置block builer的缓存数据
+        block->Reset();
+    }
+
+    // 决定这个block尝试哪种压缩，kNoCompression表示不压缩
+    // Options::adaptive_compression判断数据不可压缩时只抽样压缩
+    CompressionType TableBuilder::ChooseCompression() {
+        Rep *r = rep_;
         // 获取压缩类型，默认是采用snappy压缩
         CompressionType type = r->options.compression;
-        Slice block_contents;
+        if (type != kNoCompression && r->options.adaptive_compression && r->compression_bypassed) {
+            // 最近的数据不可压缩，只抽样压缩
+            if (++r->blocks_since_sample >= kCompressionSampleInterval) {
+                r->blocks_since_sample = 0;
+                r->compression_stats.sampled++;
+            } else {
+                r->compression_stats.bypassed++;
+                RecordTick(r->options.statistics, kBlockCompressionBypassed);
+                type = kNoCompression;
+            }
+        }
+        return type;
+    }
 
-        switch (type) {
-            // 如果不压缩，则直接持久化原数据
-            case kNoCompression:
-                block_contents = raw;
-                break;
-            // 如果采用snappy压缩，则要先检查压缩率是否达标
-            case kSnappyCompression:{
-                std::string *compressed = &r->compressed_output;
-
-                // 当CMakeLists中的HAVE_SNAPPY没有被开启，Snappy_Compress就不运行实际的压缩程序
-                // 压缩就会失败，Snappy_Compress()就会返回false
-                // 如果压缩成功，且压缩率大于1/8，说明压缩了之后不会增加解析时间
-                if(port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-                   compressed->size() < raw.size() - (raw.size() / 8u)){
-                    // 把压缩后的数据持久化
-                    block_contents = *compressed;
-                } else{ // 如果未启用Snappy，或者压缩率不够，则还是只持久化原数据
-                    block_contents = raw;
-                    // 压缩类型改为不压缩，这样读取的时候就不会解压缩
-                    type = kNoCompression;
-                }
-                break;
+    // 记录一次压缩的结果，更新自适应压缩的状态
+    // raw_size是block原来的大小，stored_size是写入文件的大小（没有采用压缩结果时和raw_size相同）
+    void TableBuilder::RecordCompression(bool use_compressed, double ratio, size_t raw_size, size_t stored_size) {
+        Rep *r = rep_;
+        Statistics *statistics = r->options.statistics;
+        if (use_compressed) {
+            r->compression_stats.compressed++;
+            RecordTick(statistics, kBlockCompressed);
+        } else {
+            r->compression_stats.rejected++;
+            RecordTick(statistics, kBlockCompressionRejected);
+        }
+        RecordTick(statistics, kCompressionInputBytes, raw_size);
+        RecordTick(statistics, kCompressionOutputBytes, stored_size);
+
+        if (r->options.adaptive_compression) {
+            r->compression_ratio += kCompressionRatioWeight * (ratio - r->compression_ratio);
+            r->compression_bypassed = (r->compression_ratio > kBypassCompressionRatio);
+        }
+    }
+
+    // 本函数的工作是对合并好的block数据raw进行压缩（如果需要的话）
+    // 压缩之后调用WriteRawBlock真正进行持久化
+    // 自适应压缩的状态和压缩计数只针对data block，index和meta block总是按Options::compression压缩
+    void TableBuilder::CompressAndWriteBlock(const Slice &raw, BlockHandle *handle, bool data_block) {
+        Rep *r = rep_;
+        CompressionType type = data_block ? ChooseCompression() : r->options.compression;
+        // 不压缩，则直接持久化原数据
+        Slice block_contents = raw;
+
+        if (type != kNoCompression) {
+            double ratio;
+            const bool use_compressed = CompressBlock(r->options, type, raw, &r->compressed_output, &ratio);
+            if (data_block) {
+                RecordCompression(use_compressed, ratio, raw.size(),
+                                  use_compressed ? r->compressed_output.size() : raw.size());
+            }
+            if (use_compressed) {
+                // 把压缩后的数据持久化
+                block_contents = r->compressed_output;
+            } else { // 如果压缩失败，或者压缩率不够，则还是只持久化原数据
+                // 压缩类型改为不压缩，这样读取的时候就不会解压缩
+                type = kNoCompression;
             }
         }
 
         // 将处理好的数据block_contents和压缩类型type持久化到磁盘
         // 并且赋值偏移量和长度到handle
-        WriteRawBlock(block_contents, type, handle);
+        WriteRawBlock(block_contents, type, handle, data_block);
 
         // 清除保存压缩数据的变量
         r->compressed_output.clear();
-        // 重置block builer的缓存数据
-        block->Reset();
+    }
+
+    // 并行模式下的Flush：把data block交给worker压缩
+    // inflight中的block达到上限时，先等待并写入最早的block
+    void TableBuilder::SubmitBlock() {
+        Rep *r = rep_;
+        const size_t max_inflight = std::max(1, r->options.parallel_compression_max_inflight);
+        // 此时inflight中的block都已经有index key了，可以写入文件
+        WriteCompletedBlocks(max_inflight - 1);
+        if (!ok()) return;
+
+        ParallelBlock *b = new ParallelBlock;
+        b->raw = r->data_block.Finish().ToString();
+        r->data_block.Reset();
+        b->attempted_type = ChooseCompression();
+        b->filter_keys.swap(r->pending_filter_keys);
+        r->inflight.push_back(b);
+
+        MutexLock l(&r->pipeline_mu);
+        r->compress_queue.push_back(b);
+        r->work_cv.Signal();
+    }
+
+    // 按文件顺序写入inflight中已经压缩好的block，并补上它们的filter和index entry
+    // inflight中多于max_inflight个block时，等待最早的block压缩完成
+    void TableBuilder::WriteCompletedBlocks(size_t max_inflight) {
+        Rep *r = rep_;
+        while (!r->inflight.empty()) {
+            ParallelBlock *b = r->inflight.front();
+            {
+                MutexLock l(&r->pipeline_mu);
+                if (!b->done && r->inflight.size() <= max_inflight) {
+                    return;
+                }
+                while (!b->done) {
+                    r->done_cv.Wait();
+                }
+            }
+            r->inflight.pop_front();
+
+            if (ok()) {
+                if (b->attempted_type != kNoCompression) {
+                    RecordCompression(b->use_compressed, b->ratio, b->raw.size(),
+                                      b->use_compressed ? b->compressed.size() : b->raw.size());
+                }
+                AppendDataBlock(b->use_compressed ? Slice(b->compressed) : Slice(b->raw), b->trailer,
+                                &r->pending_handle, &b->filter_keys);
+
+                if (ok()) {
+                    std::string handle_encoding;
+                    r->pending_handle.EncodeTo(&handle_encoding);
+                    AddIndexEntry(b->index_key, Slice(handle_encoding));
+                    r->status = r->file->Flush();
+                }
+
+                // 和串行模式一样，为到当前文件尾为止的区间生成filter
+                if (r->filter_block != nullptr) {
+                    r->filter_block->StartBlock(r->offset);
+                }
+            }
+            delete b;
+        }
+    }
+
+    // worker线程：压缩block并计算trailer，写入文件由调用TableBuilder的线程按顺序完成
+    void TableBuilder::CompressionWorker() {
+        Rep *r = rep_;
+        r->pipeline_mu.Lock();
+        while (true) {
+            while (r->compress_queue.empty() && !r->shutting_down) {
+                r->work_cv.Wait();
+            }
+            if (r->compress_queue.empty()) {
+                break;
+            }
+            ParallelBlock *b = r->compress_queue.front();
+            r->compress_queue.pop_front();
+            r->pipeline_mu.Unlock();
+
+            CompressionType type = b->attempted_type;
+            if (type != kNoCompression) {
+                b->use_compressed = CompressBlock(r->options, type, b->raw, &b->compressed, &b->ratio);
+                if (!b->use_compressed) {
+                    type = kNoCompression;
+                }
+            }
+            BuildBlockTrailer(r->options.checksum, b->use_compressed ? Slice(b->compressed) : Slice(b->raw),
+                              type, b->trailer);
+
+            r->pipeline_mu.Lock();
+            b->done = true;
+            r->done_cv.SignalAll();
+        }
+        r->pipeline_mu.Unlock();
+    }
+
+    void TableBuilder::AddIndexEntry(const Slice &key, const Slice &handle_encoding) {
+        Rep *r = rep_;
+        r->index_block.Add(key, handle_encoding);
+
+        // 分区index模式下，当前分区写满了就切出来，key是分区中最后一个key
+        if (r->options.index_partition_size > 0 &&
+            r->index_block.CurrentSizeEstimate() >= r->options.index_partition_size) {
+            r->index_partitions.emplace_back(key.ToString(), r->index_block.Finish().ToString());
+            r->index_block.Reset();
+        }
     }
 
     // 真正持久化经过压缩处理的block数据
     // 持久化前进行crc编码，方便校验
-    void TableBuilder::WriteRawBlock(const Slice &block_contents, CompressionType type, BlockHandle *handle) {
+    void TableBuilder::WriteRawBlock(const Slice &block_contents, CompressionType type, BlockHandle *handle,
+                                     bool data_block) {
+        // kBlockTrailerSize = type + crc值
+        // type(8bit, 1Byte) + crc(uint32_t, 32bit, 4Byte) = 5Byte
+        char trailer[kBlockTrailerSize];
+        BuildBlockTrailer(rep_->options.checksum, block_contents, type, trailer);
+        if (data_block) {
+            AppendDataBlock(block_contents, trailer, handle, &rep_->pending_filter_keys);
+        } else {
+            AppendBlock(block_contents, trailer, handle);
+        }
+    }
+
+    // 追加一个data block
+    // 配置了Options::block_alignment时，block从当前offset开始写会比从下一个对齐边界开始写多跨一个对齐单位的话，
+    // 先用0填充到下一个边界，这样读取这个block时涉及的设备页最少
+    // padding之后才知道block的offset，这时再把缓存的key加入offset对应的filter
+    void TableBuilder::AppendDataBlock(const Slice &block_contents, const char *trailer, BlockHandle *handle,
+                                       std::vector<std::string> *filter_keys) {
+        Rep *r = rep_;
+        const uint64_t alignment = r->options.block_alignment;
+        if (alignment > 0) {
+            const uint64_t n = block_contents.size() + kBlockTrailerSize;
+            const uint64_t in_unit = r->offset % alignment;
+            if (in_unit != 0 && (in_unit + n + alignment - 1) / alignment > (n + alignment - 1) / alignment) {
+                // padding不属于任何block，读取时只会被合并读取顺带读到
+                const std::string padding(static_cast<size_t>(alignment - in_unit), '\0');
+                r->status = r->file->Append(padding);
+                if (!ok()) return;
+                r->offset += padding.size();
+                RecordTick(r->options.statistics, kTableBytesWritten, padding.size());
+            }
+        }
+
+        if (r->filter_block != nullptr && r->defer_filter_keys) {
+            r->filter_block->StartBlock(r->offset);
+            for (const std::string &key : *filter_keys) {
+                r->filter_block->AddKey(key);
+            }
+        }
+        filter_keys->clear();
+
+        AppendBlock(block_contents, trailer, handle);
+    }
+
+    // 把block数据和trailer追加到文件末尾
+    void TableBuilder::AppendBlock(const Slice &block_contents, const char *trailer, BlockHandle *handle) {
         Rep *r = rep_;
 
         // 更新handle，赋值block在文件中的头偏移量和长度
@@ -149,44 +508,56 @@ namespace leveldb {
         // 向文件末尾追加这个block数据
         r->status = r->file->Append(block_contents);
 
-        // 如果写入成功，就进行crc编码
         if(r->status.ok()){
-            // kBlockTrailerSize = type + crc值
-            // type(8bit, 1Byte) + crc(uint32_t, 32bit, 4Byte) = 5Byte
-            char trailer[kBlockTrailerSize];
-            // 赋值入压缩的类型
-            trailer[0] = type;
-
-            // 计算block数据的crc值
-            // 底层调用了下面的crc32c::Extend
-            // Extend(0, data, n)
-            // 计算data[0, n - 1]的crc值
-            uint32_t crc = crc32c::Value(block_contents.data(), block_contents.size());
-
-            // 计算trailer[0, 0]的crc值
-            // trailer[0, 0]就是type
-            // 使用block的crc值作为种子
-            crc = crc32c::Extend(crc, trailer, 1);
-
-            // 计算crc的掩码，写入到trailer的后4个Byte
-            // 注释说只计算crc值会有问题
-            // 这里有更详细的讨论: https://stackoverflow.com/questions/61639618/why-leveldb-and-rocksdb-need-a-masked-crc32
-            EncodeFixed32(trailer + 1, crc32c::Mask(crc));
-
             // 将type和crc校验码写入文件
             r->status = r->file->Append(Slice(trailer, kBlockTrailerSize));
 
             if (r->status.ok()) {
                 // 更新文件偏移量
                 r->offset += block_contents.size() + kBlockTrailerSize;
+                RecordTick(r->options.statistics, kTableBytesWritten, block_contents.size() + kBlockTrailerSize);
             }
         }
     }
 
     Status TableBuilder::Finish() {
         Rep *r = rep_;
+        StopWatch sw(r->options.statistics, kTableFinishNanos);
         Flush();
-        BlockHandle index_block_handle;
+
+        // 等待所有并行压缩的block写入文件，最后一个block的index key和串行模式下一样
+        if (parallel() && !r->inflight.empty()) {
+            if (r->pending_index_entry) {
+                r->options.comparator->FindShortSuccessor(&r->last_key);
+                r->inflight.back()->index_key = r->last_key;
+                r->pending_index_entry = false;
+            }
+            WriteCompletedBlocks(0);
+        }
+        BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+
+        // filter block不压缩，直接持久化
+        if (ok() && r->filter_block != nullptr) {
+            WriteRawBlock(r->filter_block->Finish(), kNoCompression, &filter_block_handle);
+        }
+
+        // metaindex block: "filter.<policy name>" -> filter block handle
+        if (ok()) {
+            BlockBuilder meta_index_block(&r->index_block_options);
+            if (r->filter_block != nullptr) {
+                std::string key = "filter.";
+                key.append(r->options.filter_policy->Name());
+                std::string handle_encoding;
+                filter_block_handle.EncodeTo(&handle_encoding);
+                meta_index_block.Add(key, handle_encoding);
+            }
+
+            // 记录index的类型，读取时据此决定是否需要按分区加载index
+            const char index_type = (r->options.index_partition_size > 0) ? kPartitionedIndex : kSingleLevelIndex;
+            meta_index_block.Add(kIndexTypeMetaKey, Slice(&index_type, 1));
+
+            WriteBlock(&meta_index_block, &metaindex_block_handle);
+        }
 
         if (ok()) {
             // 还有没达到阈值的datablock，需要额外封装成一个datablock
@@ -201,18 +572,43 @@ namespace leveldb {
                 r->pending_handle.EncodeTo(&handle_encoding);
 
                 //写入index block
-                r->index_block.Add(r->last_key, Slice(handle_encoding));
+                AddIndexEntry(r->last_key, Slice(handle_encoding));
                 r->pending_index_entry = false;
             }
-            // 所有datablock的handler都已经被写入到了index block了，持久化index block
-            // 获得index block的index block handle
-            WriteBlock(&r->index_block, &index_block_handle);
+
+            if (r->options.index_partition_size > 0) {
+                // 剩下的entry组成最后一个分区
+                if (!r->index_block.empty()) {
+                    r->index_partitions.emplace_back(r->last_key, r->index_block.Finish().ToString());
+                    r->index_block.Reset();
+                }
+
+                // 依次写入所有分区，顶层index记录每个分区的最后一个key和分区的handle
+                BlockBuilder top_level_index(&r->index_block_options);
+                for (size_t i = 0; i < r->index_partitions.size() && ok(); i++) {
+                    BlockHandle partition_handle;
+                    CompressAndWriteBlock(r->index_partitions[i].second, &partition_handle);
+                    std::string handle_encoding;
+                    partition_handle.EncodeTo(&handle_encoding);
+                    top_level_index.Add(r->index_partitions[i].first, handle_encoding);
+                }
+                r->index_partitions.clear();
+                if (ok()) {
+                    WriteBlock(&top_level_index, &index_block_handle);
+                }
+            } else {
+                // 所有datablock的handler都已经被写入到了index block了，持久化index block
+                // 获得index block的index block handle
+                WriteBlock(&r->index_block, &index_block_handle);
+            }
         }
 
         if (ok()) {
             Footer footer;
-            // 将index_block_handle写入到footer
+            // 将metaindex_block_handle和index_block_handle写入到footer
+            footer.set_metaindex_handle(metaindex_block_handle);
             footer.set_index_handle(index_block_handle);
+            footer.set_checksum_type(r->options.checksum);
 
             // 给footer加入padding和magic number
             // 把它编码为字符串
@@ -225,14 +621,20 @@ namespace leveldb {
             // 更新偏移量
             if (r->status.ok()) {
                 r->offset += footer_encoding.size();
+                RecordTick(r->options.statistics, kTableBytesWritten, footer_encoding.size());
             }
         }
 
         return r->status;
     }
 
+    const TableBuilder::CompressionStats &TableBuilder::compression_stats() const {
+        return rep_->compression_stats;
+    }
+
     // 把内存的数据都写入到磁盘
     Status TableBuilder::Sync() {
+        StopWatch sw(rep_->options.statistics, kTableSyncNanos);
         return rep_->file->Sync();
     }
 
@@ -1,6 +1,9 @@
 #ifndef SSTABLE_TABLE_BUILDER_H
 #define SSTABLE_TABLE_BUILDER_H
 
+#include <string>
+#include <vector>
+
 #include "../include/slice.h"
 #include "../include/options.h"
 #include "../include/env.h"
@@ -14,12 +17,15 @@
 namespace leveldb {
     class BlockBuilder;
     class BlockHandle;
+    class FilterBlockBuilder;
     class WritableFile;
 
     class TableBuilder {
     public:
         TableBuilder(const Options &options, WritableFile *file);
 
+        ~TableBuilder();
+
         void Add(const Slice &key, const Slice &value);
 
         void Flush();
@@ -30,14 +36,57 @@ namespace leveldb {
 
         BlockHandle ReturnBlockHandle();
 
+        // 并行压缩时不包括还没有写入文件的block
         uint64_t FileSize() const;
 
         Status Sync();
 
+        // 写入的data block的压缩决策计数
+        struct CompressionStats {
+            // 压缩后写入的block
+            uint64_t compressed = 0;
+            // 尝试了压缩，但节省不到1/8，按原数据写入的block
+            uint64_t rejected = 0;
+            // Options::adaptive_compression判断数据不可压缩，没有尝试压缩的block
+            uint64_t bypassed = 0;
+            // 跳过压缩期间抽样尝试压缩的block，同时计入compressed或rejected
+            uint64_t sampled = 0;
+        };
+
+        const CompressionStats &compression_stats() const;
+
     private:
+        struct ParallelBlock;
+
         void WriteBlock(BlockBuilder *block, BlockHandle *handle);
 
-        void WriteRawBlock(const Slice &block_contents, CompressionType type, BlockHandle *handle);
+        // data_block为true时按Options::block_alignment对齐，并把缓存的key加入filter
+        void CompressAndWriteBlock(const Slice &raw, BlockHandle *handle, bool data_block = false);
+
+        CompressionType ChooseCompression();
+
+        void RecordCompression(bool use_compressed, double ratio, size_t raw_size, size_t stored_size);
+
+        // Options::parallel_compression_threads > 1时，data block交给worker线程压缩，
+        // 再由调用TableBuilder的线程按顺序写入文件
+        bool parallel() const;
+
+        void SubmitBlock();
+
+        void WriteCompletedBlocks(size_t max_inflight);
+
+        void CompressionWorker();
+
+        // 向index block添加一个data block的entry，分区index模式下负责切分分区
+        void AddIndexEntry(const Slice &key, const Slice &handle_encoding);
+
+        void WriteRawBlock(const Slice &block_contents, CompressionType type, BlockHandle *handle,
+                           bool data_block = false);
+
+        void AppendDataBlock(const Slice &block_contents, const char *trailer, BlockHandle *handle,
+                             std::vector<std::string> *filter_keys);
+
+        void AppendBlock(const Slice &block_contents, const char *trailer, BlockHandle *handle);
 
         bool ok() const { return status().ok(); }
 
@@ -0,0 +1,25 @@
+#ifndef SSTABLE_TWO_LEVEL_ITERATOR_H
+#define SSTABLE_TWO_LEVEL_ITERATOR_H
+
+#include "../include/iterator.h"
+#include "../include/options.h"
+
+namespace leveldb {
+    struct ReadOptions;
+
+    // 返回一个两层迭代器
+    // 第一层index_iter遍历的是一串block handle，
+    // 对每个handle调用(*block_function)(arg, options, handle)得到第二层迭代器，
+    // 两层迭代器拼接起来就是所有block中的kv对
+    //
+    // 第二层迭代器是在需要的时候才打开的，顺序扫描时一次只持有一个data block
+    //
+    // 取得index_iter的所有权，不再需要时负责释放
+    Iterator *NewTwoLevelIterator(
+            Iterator *index_iter,
+            Iterator *(*block_function)(void *arg, const ReadOptions &options,
+                                        const Slice &index_value),
+            void *arg, const ReadOptions &options);
+}
+
+#endif //SSTABLE_TWO_LEVEL_ITERATOR_H
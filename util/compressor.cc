@@ -0,0 +1,133 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "../include/compressor.h"
+
+#include <atomic>
+
+#include "../port/port_stdcxx.h"
+#include "../util/no_destructor.h"
+
+namespace leveldb {
+
+Compressor::~Compressor() {}
+
+namespace {
+
+class SnappyCompressor : public Compressor {
+ public:
+  CompressionType type() const override { return kSnappyCompression; }
+
+  const char* Name() const override { return "leveldb.Snappy"; }
+
+  bool Compress(const Options& /*options*/, const Slice& input,
+                std::string* output) const override {
+    return port::Snappy_Compress(input.data(), input.size(), output);
+  }
+
+  bool GetUncompressedLength(const Slice& input,
+                             size_t* length) const override {
+    return port::Snappy_GetUncompressedLength(input.data(), input.size(),
+                                              length);
+  }
+
+  bool Uncompress(const Slice& input, char* output) const override {
+    return port::Snappy_Uncompress(input.data(), input.size(), output);
+  }
+};
+
+class ZstdCompressor : public Compressor {
+ public:
+  CompressionType type() const override { return kZstdCompression; }
+
+  const char* Name() const override { return "leveldb.Zstd"; }
+
+  bool Compress(const Options& options, const Slice& input,
+                std::string* output) const override {
+    return port::Zstd_Compress(options.zstd_compression_level, input.data(),
+                               input.size(), output);
+  }
+
+  bool GetUncompressedLength(const Slice& input,
+                             size_t* length) const override {
+    return port::Zstd_GetUncompressedLength(input.data(), input.size(),
+                                            length);
+  }
+
+  bool Uncompress(const Slice& input, char* output) const override {
+    return port::Zstd_Uncompress(input.data(), input.size(), output);
+  }
+};
+
+class LZ4Compressor : public Compressor {
+ public:
+  CompressionType type() const override { return kLZ4Compression; }
+
+  const char* Name() const override { return "leveldb.LZ4"; }
+
+  bool Compress(const Options& /*options*/, const Slice& input,
+                std::string* output) const override {
+    return port::LZ4_Compress(input.data(), input.size(), output);
+  }
+
+  bool GetUncompressedLength(const Slice& input,
+                             size_t* length) const override {
+    return port::LZ4_GetUncompressedLength(input.data(), input.size(),
+                                           length);
+  }
+
+  bool Uncompress(const Slice& input, char* output) const override {
+    return port::LZ4_Uncompress(input.data(), input.size(), output);
+  }
+};
+
+// Compressors indexed by the type byte stored in block trailers.
+class CompressorRegistry {
+ public:
+  CompressorRegistry() {
+    for (auto& slot : slots_) {
+      slot.store(nullptr, std::memory_order_relaxed);
+    }
+    Register(&snappy_);
+    Register(&zstd_);
+    Register(&lz4_);
+  }
+
+  void Register(const Compressor* compressor) {
+    slots_[static_cast<unsigned char>(compressor->type())].store(
+        compressor, std::memory_order_release);
+  }
+
+  const Compressor* Get(CompressionType type) const {
+    return slots_[static_cast<unsigned char>(type)].load(
+        std::memory_order_acquire);
+  }
+
+ private:
+  const SnappyCompressor snappy_;
+  const ZstdCompressor zstd_;
+  const LZ4Compressor lz4_;
+  std::atomic<const Compressor*> slots_[256];
+};
+
+CompressorRegistry* Registry() {
+  static NoDestructor<CompressorRegistry> registry;
+  return registry.get();
+}
+
+}  // namespace
+
+void RegisterCompressor(const Compressor* compressor) {
+  assert(compressor->type() != kNoCompression);
+  Registry()->Register(compressor);
+}
+
+const Compressor* GetCompressor(CompressionType type) {
+  if (type == kNoCompression) {
+    return nullptr;
+  }
+  return Registry()->Get(type);
+}
+
+}  // namespace leveldb
@@ -264,7 +264,8 @@ constexpr inline const uint8_t* RoundUp(const uint8_t* pointer) {
 }  // namespace
 
 // Determine if the CPU running this program can accelerate the CRC32C
-// calculation.
+// calculation, either through Google CRC32C or through the in-tree SSE4.2
+// kernels in port/crc32c_sse42.cc.
 static bool CanAccelerateCRC32C() {
   // port::AcceleretedCRC32C returns zero when unable to accelerate.
   static const char kTestCRCBuffer[] = "TestCRCBuffer";
@@ -279,7 +280,10 @@ uint32_t Extend(uint32_t crc, const char* data, size_t n) {
   if (accelerate) {
     return port::AcceleratedCRC32C(crc, data, n);
   }
+  return ExtendPortable(crc, data, n);
+}
 
+uint32_t ExtendPortable(uint32_t crc, const char* data, size_t n) {
   const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
   const uint8_t* e = p + n;
   uint32_t l = crc ^ kCRC32Xor;
@@ -16,6 +16,11 @@ namespace crc32c {
 // crc32c of a stream of data.
 uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 
+// Same as Extend(), but always uses the portable table-driven
+// (slicing-by-4) implementation.  Extend() falls back to it when the CPU
+// can't accelerate the calculation; exposed for benchmarks.
+uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n);
+
 // Return the crc32c of data[0,n-1]
 inline uint32_t Value(const char* data, size_t n) { return Extend(0, data, n); }
 
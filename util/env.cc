@@ -4,7 +4,9 @@
 
 #include "env.h"
 
+#include <cassert>
 #include <cstdarg>
+#include <vector>
 
 // This workaround can be removed when leveldb::Env::DeleteFile is removed.
 // See env.h for justification.
@@ -18,7 +20,8 @@ Env::Env() = default;
 
 Env::~Env() = default;
 
-Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
+Status Env::NewAppendableFile(const std::string& fname,
+                              WritableFile** /*result*/) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
@@ -28,10 +31,48 @@ Status Env::DeleteDir(const std::string& dirname) { return RemoveDir(dirname); }
 Status Env::RemoveFile(const std::string& fname) { return DeleteFile(fname); }
 Status Env::DeleteFile(const std::string& fname) { return RemoveFile(fname); }
 
+void Env::Schedule(void (*function)(void* arg), void* arg, Priority /*pri*/) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int /*number*/, Priority /*pri*/) {}
+
+int Env::GetBackgroundThreads(Priority /*pri*/) { return 0; }
+
+Status Env::SetBackgroundThreadCPUs(const std::vector<int>& /*cpus*/,
+                                    Priority /*pri*/) {
+  return Status::NotSupported("SetBackgroundThreadCPUs");
+}
+
+bool Env::GetThreadPoolStats(Priority /*pri*/, ThreadPoolStats* /*stats*/) {
+  return false;
+}
+
 SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
 
+void RandomAccessFile::Submit(ReadRequest* req) const {
+  req->status = Read(req->offset, req->n, &req->result, req->scratch);
+  req->done = true;
+}
+
+void RandomAccessFile::Wait(ReadRequest* const* reqs, size_t n) const {
+  // Submit() completed every request synchronously.
+  for (size_t i = 0; i < n; i++) {
+    assert(reqs[i]->done);
+  }
+}
+
+void RandomAccessFile::MultiRead(ReadRequest* reqs, size_t n) const {
+  std::vector<ReadRequest*> pending(n);
+  for (size_t i = 0; i < n; i++) {
+    pending[i] = &reqs[i];
+    Submit(&reqs[i]);
+  }
+  Wait(pending.data(), n);
+}
+
 WritableFile::~WritableFile() = default;
 
 Logger::~Logger() = default;
@@ -13,20 +13,23 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <limits>
-#include <queue>
 #include <set>
 #include <string>
 #include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "../include/env.h"
 #include "../include/slice.h"
@@ -34,9 +37,21 @@
 #include "../port/port.h"
 #include "../port/thread_annotations.h"
 #include "env_posix_test_helper.h"
+#include "histogram.h"
+#include "mutexlock.h"
 #include "posix_logger.h"
 #include "../port/port_stdcxx.h"
 
+#if HAVE_PTHREAD_SETAFFINITY_NP
+#include <pthread.h>
+#include <sched.h>
+#endif  // HAVE_PTHREAD_SETAFFINITY_NP
+
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif  // HAVE_IO_URING
+
 namespace leveldb {
 
 namespace {
@@ -268,6 +283,8 @@ class PosixMmapReadableFile final : public RandomAccessFile {
     return Status::OK();
   }
 
+  bool IsMemoryMapped() const override { return true; }
+
  private:
   char* const mmap_base_;
   const size_t length_;
@@ -275,6 +292,419 @@ class PosixMmapReadableFile final : public RandomAccessFile {
   const std::string filename_;
 };
 
+// Reads |n| bytes at |offset| of |fd| into |scratch| with pread().  Shared by
+// the io_uring backed file for Read() and for requests the ring can't serve.
+Status PosixPread(int fd, const std::string& filename, uint64_t offset,
+                  size_t n, Slice* result, char* scratch) {
+  ssize_t read_size = ::pread(fd, scratch, n, static_cast<off_t>(offset));
+  *result = Slice(scratch, (read_size < 0) ? 0 : read_size);
+  if (read_size < 0) {
+    return PosixError(filename, errno);
+  }
+  return Status::OK();
+}
+
+#if HAVE_IO_URING
+
+// Number of submission queue entries of each io_uring instance.  Also bounds
+// the number of reads that may be in flight on one thread; IOUring::Queue()
+// reaps completions when all slots are taken.
+constexpr const unsigned kIOUringQueueDepth = 64;
+
+// A minimal io_uring instance driven directly through the io_uring_setup()
+// and io_uring_enter() system calls, so that no liburing is needed.
+//
+// Reads are queued into the submission ring with Queue() and handed to the
+// kernel in one system call by Flush().  Completions are reaped lazily by
+// WaitFor(), which marks each finished ReadRequest done.
+//
+// Instances are not thread-safe.  PosixIOUringRandomAccessFile keeps one
+// per thread, which is why a request must be waited for by the thread that
+// submitted it.
+class IOUring {
+ public:
+  IOUring()
+      : ring_fd_(-1),
+        sq_ring_(MAP_FAILED),
+        sq_ring_size_(0),
+        cq_ring_(MAP_FAILED),
+        cq_ring_size_(0),
+        sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)),
+        sqes_size_(0),
+        queued_(0),
+        failed_(false) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, kIOUringQueueDepth, &params));
+    if (fd < 0) {
+      return;  // ok() stays false; callers fall back to pread().
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+      cq_ring_size_ = sq_ring_size_;
+    }
+    sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      ::close(fd);
+      return;
+    }
+    if (single_mmap) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (cq_ring_ == MAP_FAILED) {
+        ::munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = MAP_FAILED;
+        ::close(fd);
+        return;
+      }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(
+        ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+      UnmapRings();
+      ::close(fd);
+      return;
+    }
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    slots_.resize(std::min<unsigned>(kIOUringQueueDepth, params.sq_entries));
+    for (size_t i = slots_.size(); i > 0; i--) {
+      free_slots_.push_back(static_cast<uint32_t>(i - 1));
+    }
+    ring_fd_ = fd;
+  }
+
+  ~IOUring() {
+    if (ring_fd_ >= 0) {
+      // All requests must have been waited for by their submitter.
+      assert(free_slots_.size() == slots_.size());
+      ::munmap(sqes_, sqes_size_);
+      UnmapRings();
+      ::close(ring_fd_);
+    }
+  }
+
+  IOUring(const IOUring&) = delete;
+  IOUring& operator=(const IOUring&) = delete;
+
+  // Returns false if the kernel does not support io_uring (or the ring
+  // could not be set up), in which case no other method may be called.
+  // Also turns false once waiting for completions has failed; callers
+  // then use pread() like they do without io_uring.
+  bool ok() const { return ring_fd_ >= 0 && !failed_; }
+
+  // Adds a read of |req| from |fd| to the submission ring.  The read is not
+  // started before the next Flush() or WaitFor().  |filename| is used for
+  // error messages and must outlive the request.
+  void Queue(int fd, const std::string* filename, ReadRequest* req) {
+    req->done = false;
+    while (free_slots_.empty() && !failed_) {
+      // Every slot is in flight; make room by waiting for a completion.
+      Flush();
+      if (Enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+        FailInFlight();
+      }
+      Reap();
+    }
+    if (failed_) {
+      req->status = PosixPread(fd, *filename, req->offset, req->n,
+                               &req->result, req->scratch);
+      req->done = true;
+      return;
+    }
+    uint32_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    slots_[slot] = Slot{req, fd, filename};
+
+    // The number of slots never exceeds the number of SQEs, so the
+    // submission ring can't be full here.
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->off = req->offset;
+    sqe->addr = reinterpret_cast<uint64_t>(req->scratch);
+    sqe->len = static_cast<uint32_t>(req->n);
+    sqe->user_data = slot;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    queued_++;
+  }
+
+  // Hands every queued read to the kernel.
+  void Flush() {
+    while (queued_ > 0) {
+      int submitted = Enter(queued_, 0, 0);
+      if (submitted < 0) {
+        FailQueued();
+        return;
+      }
+      queued_ -= static_cast<unsigned>(submitted);
+    }
+  }
+
+  // Blocks until |req| is done, completing any other reads on the way.
+  void WaitFor(ReadRequest* req) {
+    Flush();
+    Reap();
+    while (!req->done) {
+      if (Enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+        // Waiting itself failed with a non-transient error, so completions
+        // may never be delivered.  Complete everything in flight now
+        // instead of polling forever.
+        FailInFlight();
+        return;
+      }
+      Reap();
+    }
+  }
+
+ private:
+  struct Slot {
+    ReadRequest* req;
+    int fd;
+    const std::string* filename;
+  };
+
+  void UnmapRings() {
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      ::munmap(sq_ring_, sq_ring_size_);
+    }
+    sq_ring_ = cq_ring_ = MAP_FAILED;
+  }
+
+  // Wraps io_uring_enter().  Returns the number of submitted entries, or
+  // -1 on a non-transient error.
+  int Enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    while (true) {
+      int r = static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_,
+                                         to_submit, min_complete, flags,
+                                         nullptr, 0));
+      if (r >= 0) {
+        return r;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EBUSY) {
+        // The kernel is short on resources or the completion ring is
+        // full.  Drain completions and try again.
+        Reap();
+        std::this_thread::yield();
+        continue;
+      }
+      return -1;
+    }
+  }
+
+  // Processes every completion that is currently in the completion ring.
+  void Reap() {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+      Complete(static_cast<uint32_t>(cqe.user_data), cqe.res);
+      head++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+  void Complete(uint32_t slot, int res) {
+    Slot s = slots_[slot];
+    ReadRequest* req = s.req;
+    if (res == -EINVAL || res == -EOPNOTSUPP) {
+      // IORING_OP_READ is only available since Linux 5.6.
+      req->status = PosixPread(s.fd, *s.filename, req->offset, req->n,
+                               &req->result, req->scratch);
+    } else if (res < 0) {
+      req->result = Slice(req->scratch, 0);
+      req->status = PosixError(*s.filename, -res);
+    } else {
+      req->result = Slice(req->scratch, static_cast<size_t>(res));
+      req->status = Status::OK();
+    }
+    req->done = true;
+    free_slots_.push_back(slot);
+  }
+
+  // Called when io_uring_enter() fails while submitting.  Entries the
+  // kernel has not consumed yet are taken back off the submission ring and
+  // read synchronously; entries it did consume complete as usual.
+  void FailQueued() {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    unsigned tail = *sq_tail_;
+    for (unsigned i = head; i != tail; i++) {
+      uint32_t slot = static_cast<uint32_t>(sqes_[i & sq_mask_].user_data);
+      Complete(slot, -EINVAL);
+    }
+    __atomic_store_n(sq_tail_, head, __ATOMIC_RELEASE);
+    queued_ = 0;
+  }
+
+  // Called when io_uring_enter() fails while waiting.  Takes whatever has
+  // already completed, then reads every request still in flight
+  // synchronously and stops using the ring.
+  void FailInFlight() {
+    Reap();
+    std::vector<bool> in_flight(slots_.size(), true);
+    for (uint32_t slot : free_slots_) {
+      in_flight[slot] = false;
+    }
+    for (uint32_t slot = 0; slot < slots_.size(); slot++) {
+      if (in_flight[slot]) {
+        Complete(slot, -EINVAL);
+      }
+    }
+    queued_ = 0;
+    failed_ = true;
+  }
+
+  int ring_fd_;  // -1 if the ring could not be set up.
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe* cqes_;
+
+  unsigned queued_;  // Entries added to the ring but not yet submitted.
+  bool failed_;      // Waiting for completions failed; see FailInFlight().
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> free_slots_;
+};
+
+// Returns the calling thread's ring, which is created on first use.
+IOUring* ThreadIOUring() {
+  static thread_local IOUring ring;
+  return &ring;
+}
+
+#endif  // HAVE_IO_URING
+
+// Implements random read access in a file with io_uring for Submit() and
+// MultiRead(), and pread() for Read().
+//
+// Instances of this class are thread-safe, as required by the RandomAccessFile
+// API.  Every thread submits through its own ring, so no locking is needed.
+class PosixIOUringRandomAccessFile final : public RandomAccessFile {
+ public:
+  // The new instance takes ownership of |fd|.
+  PosixIOUringRandomAccessFile(std::string filename, int fd)
+      : fd_(fd), filename_(std::move(filename)) {}
+
+  ~PosixIOUringRandomAccessFile() override { ::close(fd_); }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    return PosixPread(fd_, filename_, offset, n, result, scratch);
+  }
+
+#if HAVE_IO_URING
+  void Submit(ReadRequest* req) const override {
+    IOUring* ring = ThreadIOUring();
+    if (!ring->ok()) {
+      RandomAccessFile::Submit(req);
+      return;
+    }
+    ring->Queue(fd_, &filename_, req);
+    ring->Flush();
+  }
+
+  void Wait(ReadRequest* const* reqs, size_t n) const override {
+    IOUring* ring = ThreadIOUring();
+    for (size_t i = 0; i < n; i++) {
+      if (!reqs[i]->done) {
+        ring->WaitFor(reqs[i]);
+      }
+    }
+  }
+
+  void MultiRead(ReadRequest* reqs, size_t n) const override {
+    IOUring* ring = ThreadIOUring();
+    if (!ring->ok()) {
+      RandomAccessFile::MultiRead(reqs, n);
+      return;
+    }
+    // Queue everything first so that the whole batch goes to the kernel in
+    // a single io_uring_enter() (or one per kIOUringQueueDepth reads).
+    for (size_t i = 0; i < n; i++) {
+      ring->Queue(fd_, &filename_, &reqs[i]);
+    }
+    for (size_t i = 0; i < n; i++) {
+      ring->WaitFor(&reqs[i]);
+    }
+  }
+#endif  // HAVE_IO_URING
+
+ private:
+  const int fd_;
+  const std::string filename_;
+};
+
+// Ensures that all the caches associated with the given file descriptor's
+// data are flushed all the way to durable media, and can withstand power
+// failures.
+//
+// The path argument is only used to populate the description string in the
+// returned Status if an error occurs.
+Status SyncFd(int fd, const std::string& fd_path) {
+#if HAVE_FULLFSYNC
+  // On macOS and iOS, fsync() doesn't guarantee durability past power
+  // failures. fcntl(F_FULLFSYNC) is required for that purpose. Some
+  // filesystems don't support fcntl(F_FULLFSYNC), and require a fallback to
+  // fsync().
+  if (::fcntl(fd, F_FULLFSYNC) == 0) {
+    return Status::OK();
+  }
+#endif  // HAVE_FULLFSYNC
+
+#if HAVE_FDATASYNC
+  bool sync_success = ::fdatasync(fd) == 0;
+#else
+  bool sync_success = ::fsync(fd) == 0;
+#endif  // HAVE_FDATASYNC
+
+  if (sync_success) {
+    return Status::OK();
+  }
+  return PosixError(fd_path, errno);
+}
+
 class PosixWritableFile final : public WritableFile {
  public:
   PosixWritableFile(std::string filename, int fd)
@@ -389,35 +819,6 @@ class PosixWritableFile final : public WritableFile {
     return status;
   }
 
-  // Ensures that all the caches associated with the given file descriptor's
-  // data are flushed all the way to durable media, and can withstand power
-  // failures.
-  //
-  // The path argument is only used to populate the description string in the
-  // returned Status if an error occurs.
-  static Status SyncFd(int fd, const std::string& fd_path) {
-#if HAVE_FULLFSYNC
-    // On macOS and iOS, fsync() doesn't guarantee durability past power
-    // failures. fcntl(F_FULLFSYNC) is required for that purpose. Some
-    // filesystems don't support fcntl(F_FULLFSYNC), and require a fallback to
-    // fsync().
-    if (::fcntl(fd, F_FULLFSYNC) == 0) {
-      return Status::OK();
-    }
-#endif  // HAVE_FULLFSYNC
-
-#if HAVE_FDATASYNC
-    bool sync_success = ::fdatasync(fd) == 0;
-#else
-    bool sync_success = ::fsync(fd) == 0;
-#endif  // HAVE_FDATASYNC
-
-    if (sync_success) {
-      return Status::OK();
-    }
-    return PosixError(fd_path, errno);
-  }
-
   // Returns the directory name in a path pointing to a file.
   //
   // Returns "." if the path does not contain any directory separator.
@@ -465,6 +866,265 @@ class PosixWritableFile final : public WritableFile {
   const std::string dirname_;  // The directory of filename_.
 };
 
+// Direct I/O requires the file offset, the transfer size and the user
+// buffer to be multiples of the logical block size of the device.  4096
+// covers the devices in common use (512-byte and 4K sector disks).
+constexpr const size_t kDirectIOAlignment = 4096;
+
+#if defined(O_DIRECT)
+constexpr const int kOpenDirectFlags = O_DIRECT;
+#else
+constexpr const int kOpenDirectFlags = 0;
+#endif  // defined(O_DIRECT)
+
+constexpr bool IsDirectIOAligned(uint64_t value) {
+  return (value & (kDirectIOAlignment - 1)) == 0;
+}
+
+constexpr uint64_t RoundUpToDirectIOAlignment(uint64_t value) {
+  return (value + kDirectIOAlignment - 1) & ~uint64_t{kDirectIOAlignment - 1};
+}
+
+// Returns |size| bytes aligned for direct I/O, or nullptr on failure. The
+// result must be released with std::free().
+char* AllocateDirectIOBuffer(size_t size) {
+  void* buf = nullptr;
+  if (::posix_memalign(&buf, kDirectIOAlignment, size) != 0) {
+    return nullptr;
+  }
+  return reinterpret_cast<char*>(buf);
+}
+
+// Opens |filename| bypassing the page cache. Filesystems that do not support
+// O_DIRECT (e.g. tmpfs) fail the open with EINVAL; the file is then opened
+// normally. The returned file descriptor is only ever used for aligned I/O,
+// so either way the caller does not need to know which case happened.
+int OpenDirect(const std::string& filename, int flags, mode_t mode) {
+  int fd = ::open(filename.c_str(), flags | kOpenDirectFlags | kOpenBaseFlags,
+                  mode);
+  if (fd < 0 && errno == EINVAL && kOpenDirectFlags != 0) {
+    fd = ::open(filename.c_str(), flags | kOpenBaseFlags, mode);
+  }
+#if defined(F_NOCACHE)
+  // macOS has no O_DIRECT; F_NOCACHE turns off caching for the descriptor.
+  if (fd >= 0) {
+    ::fcntl(fd, F_NOCACHE, 1);
+  }
+#endif  // defined(F_NOCACHE)
+  return fd;
+}
+
+// Implements random read access in a file opened with O_DIRECT.
+//
+// Reads of arbitrary ranges are widened to aligned ranges, read into an
+// aligned bounce buffer and copied into |scratch|. Reads that are already
+// aligned to GetRequiredBufferAlignment(), as the table reader issues them,
+// go straight into |scratch|.
+//
+// Instances of this class are thread-safe, as required by the RandomAccessFile
+// API. Instances are immutable and Read() only calls thread-safe library
+// functions.
+class PosixDirectRandomAccessFile final : public RandomAccessFile {
+ public:
+  // The new instance takes ownership of |fd|.
+  PosixDirectRandomAccessFile(std::string filename, int fd)
+      : fd_(fd), filename_(std::move(filename)) {}
+
+  ~PosixDirectRandomAccessFile() override { ::close(fd_); }
+
+  size_t GetRequiredBufferAlignment() const override {
+    return kDirectIOAlignment;
+  }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    size_t read_size = 0;
+    if (IsDirectIOAligned(offset) && IsDirectIOAligned(n) &&
+        IsDirectIOAligned(reinterpret_cast<uintptr_t>(scratch))) {
+      Status status = ReadAligned(offset, n, scratch, &read_size);
+      *result = Slice(scratch, read_size);
+      return status;
+    }
+
+    const uint64_t aligned_offset = offset & ~uint64_t{kDirectIOAlignment - 1};
+    const size_t skip = static_cast<size_t>(offset - aligned_offset);
+    const size_t aligned_size =
+        static_cast<size_t>(RoundUpToDirectIOAlignment(skip + n));
+    char* buf = AllocateDirectIOBuffer(aligned_size);
+    if (buf == nullptr) {
+      *result = Slice(scratch, 0);
+      return PosixError(filename_, ENOMEM);
+    }
+
+    Status status = ReadAligned(aligned_offset, aligned_size, buf, &read_size);
+    const size_t available =
+        (read_size > skip) ? std::min(read_size - skip, n) : 0;
+    std::memcpy(scratch, buf + skip, available);
+    std::free(buf);
+    *result = Slice(scratch, available);
+    return status;
+  }
+
+ private:
+  // Reads up to |n| bytes at |offset| into |buf|, all of them aligned. Stops
+  // early only at the end of the file.
+  Status ReadAligned(uint64_t offset, size_t n, char* buf,
+                     size_t* read_size) const {
+    *read_size = 0;
+    while (*read_size < n) {
+      ::ssize_t result = ::pread(fd_, buf + *read_size, n - *read_size,
+                                 static_cast<off_t>(offset + *read_size));
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      *read_size += result;
+      // A short, unaligned read means the end of the file was reached; the
+      // next offset would not be aligned anyway.
+      if (result == 0 || !IsDirectIOAligned(result)) {
+        break;
+      }
+    }
+    return Status::OK();
+  }
+
+  const int fd_;
+  const std::string filename_;
+};
+
+// Implements sequential writing to a file opened with O_DIRECT.
+//
+// Data is collected in an aligned buffer and written in whole aligned blocks.
+// Flush() writes every complete block and keeps the partial block at the end
+// in memory. Sync() and Close() also write the partial block, padded with
+// zeros, and then truncate the file to the number of bytes appended. The
+// partial block stays in the buffer, so later appends rewrite it in place.
+class PosixDirectWritableFile final : public WritableFile {
+ public:
+  // The new instance takes ownership of |fd|. |buf| must come from
+  // AllocateDirectIOBuffer(kWritableFileBufferSize); the instance takes
+  // ownership of it too.
+  PosixDirectWritableFile(std::string filename, int fd, char* buf)
+      : buf_(buf),
+        pos_(0),
+        file_offset_(0),
+        fd_(fd),
+        filename_(std::move(filename)) {}
+
+  ~PosixDirectWritableFile() override {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    std::free(buf_);
+  }
+
+  Status Append(const Slice& data) override {
+    const char* write_data = data.data();
+    size_t write_size = data.size();
+    while (write_size > 0) {
+      size_t copy_size = std::min(write_size, kWritableFileBufferSize - pos_);
+      std::memcpy(buf_ + pos_, write_data, copy_size);
+      write_data += copy_size;
+      write_size -= copy_size;
+      pos_ += copy_size;
+      if (pos_ == kWritableFileBufferSize) {
+        Status status = WriteAlignedPrefix();
+        if (!status.ok()) {
+          return status;
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Close() override {
+    Status status = WritePartialBlock();
+    const int close_result = ::close(fd_);
+    if (close_result < 0 && status.ok()) {
+      status = PosixError(filename_, errno);
+    }
+    fd_ = -1;
+    return status;
+  }
+
+  Status Flush() override { return WriteAlignedPrefix(); }
+
+  Status Sync() override {
+    Status status = WritePartialBlock();
+    if (!status.ok()) {
+      return status;
+    }
+    // O_DIRECT bypasses the page cache but not the device's write cache, and
+    // the file size set by ftruncate() is metadata.
+    return SyncFd(fd_, filename_);
+  }
+
+ private:
+  // Writes the complete blocks at the front of buf_ and moves the partial
+  // block that follows them to the front of buf_.
+  Status WriteAlignedPrefix() {
+    const size_t aligned_size = pos_ & ~(kDirectIOAlignment - 1);
+    if (aligned_size == 0) {
+      return Status::OK();
+    }
+    Status status = WriteAt(buf_, aligned_size, file_offset_);
+    if (!status.ok()) {
+      return status;
+    }
+    file_offset_ += aligned_size;
+    pos_ -= aligned_size;
+    std::memmove(buf_, buf_ + aligned_size, pos_);
+    return Status::OK();
+  }
+
+  // Writes all buffered data, padding the last block with zeros, and cuts the
+  // padding off the file.
+  Status WritePartialBlock() {
+    Status status = WriteAlignedPrefix();
+    if (!status.ok() || pos_ == 0) {
+      return status;
+    }
+    const size_t padded_size =
+        static_cast<size_t>(RoundUpToDirectIOAlignment(pos_));
+    std::memset(buf_ + pos_, 0, padded_size - pos_);
+    status = WriteAt(buf_, padded_size, file_offset_);
+    if (status.ok() &&
+        ::ftruncate(fd_, static_cast<off_t>(file_offset_ + pos_)) != 0) {
+      status = PosixError(filename_, errno);
+    }
+    return status;
+  }
+
+  Status WriteAt(const char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+      ::ssize_t write_result =
+          ::pwrite(fd_, data, size, static_cast<off_t>(offset));
+      if (write_result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      data += write_result;
+      size -= write_result;
+      offset += write_result;
+    }
+    return Status::OK();
+  }
+
+  // buf_[0, pos_ - 1] contains data that belongs at file_offset_, which is
+  // always aligned. buf_ holds kWritableFileBufferSize bytes.
+  char* const buf_;
+  size_t pos_;
+  uint64_t file_offset_;
+  int fd_;
+
+  const std::string filename_;
+};
+
 int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct ::flock file_lock_info;
@@ -516,6 +1176,275 @@ class PosixLockTable {
   std::set<std::string> locked_files_ GUARDED_BY(mu_);
 };
 
+// Largest number of threads of one PosixThreadPool.  Worker slots are
+// allocated up front so that stealing never races with a resize.
+constexpr int kMaxBackgroundThreads = 256;
+
+uint64_t SteadyNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The background threads of one Env::Priority.
+//
+// Every worker owns a deque.  Schedule() called from one of the pool's own
+// threads pushes onto that thread's deque; other callers spread work over
+// the workers in turn.  A worker runs items from the front of its own deque
+// and, when that is empty, steals from the back of the others, so work
+// queued behind a long item is picked up by any idle worker.
+//
+// Instances are thread-safe.
+class PosixThreadPool {
+ public:
+  PosixThreadPool();
+
+  PosixThreadPool(const PosixThreadPool&) = delete;
+  PosixThreadPool& operator=(const PosixThreadPool&) = delete;
+
+  void Schedule(void (*function)(void* arg), void* arg);
+
+  void SetThreads(int number);
+
+  int GetThreads() const {
+    return num_threads_.load(std::memory_order_relaxed);
+  }
+
+  Status SetCPUs(const std::vector<int>& cpus);
+
+  void GetStats(ThreadPoolStats* stats) const;
+
+ private:
+  struct WorkItem {
+    void (*function)(void*);
+    void* arg;
+    uint64_t schedule_nanos;
+  };
+
+  struct Worker {
+    port::Mutex mutex;
+    std::deque<WorkItem> queue GUARDED_BY(mutex);
+    // True while a thread serves this slot.  Guarded by the pool's mutex_.
+    bool running = false;
+  };
+
+  // Start threads for the slots below num_threads_ that have none.
+  void StartThreads() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void WorkerMain(int index);
+
+  // Remove an item from the deque of "index", or steal one from another
+  // worker.  Returns false if every deque is empty.
+  bool TakeWork(int index, WorkItem* item);
+
+  // Pin the calling thread, which serves slot "index", to its CPU.
+  void ApplyCPUs(int index);
+
+  // The pool the calling thread works for, and its slot.
+  static thread_local PosixThreadPool* current_pool_;
+  static thread_local int current_index_;
+
+  port::Mutex mutex_;
+  port::CondVar work_cv_ GUARDED_BY(mutex_);
+  bool started_ GUARDED_BY(mutex_);
+  std::vector<int> cpus_ GUARDED_BY(mutex_);
+
+  std::atomic<int> num_threads_;
+  // One past the highest slot that ever had a thread; deques at or above
+  // it are always empty.
+  std::atomic<int> slots_used_;
+  // Threads waiting on work_cv_.
+  std::atomic<int> idle_;
+  std::atomic<uint32_t> next_slot_;
+  std::atomic<uint64_t> cpus_generation_;
+
+  std::atomic<uint64_t> queued_;
+  std::atomic<uint64_t> running_;
+  std::atomic<uint64_t> scheduled_;
+  std::atomic<uint64_t> completed_;
+  AtomicHistogram queue_wait_nanos_;
+
+  Worker workers_[kMaxBackgroundThreads];
+};
+
+thread_local PosixThreadPool* PosixThreadPool::current_pool_ = nullptr;
+thread_local int PosixThreadPool::current_index_ = -1;
+
+PosixThreadPool::PosixThreadPool()
+    : work_cv_(&mutex_),
+      started_(false),
+      num_threads_(1),
+      slots_used_(0),
+      idle_(0),
+      next_slot_(0),
+      cpus_generation_(0),
+      queued_(0),
+      running_(0),
+      scheduled_(0),
+      completed_(0) {}
+
+void PosixThreadPool::Schedule(void (*function)(void* arg), void* arg) {
+  const int num_threads = num_threads_.load(std::memory_order_relaxed);
+  int slot;
+  if (current_pool_ == this && current_index_ < num_threads) {
+    slot = current_index_;
+  } else {
+    slot = next_slot_.fetch_add(1, std::memory_order_relaxed) % num_threads;
+  }
+
+  {
+    MutexLock l(&mutex_);
+    if (!started_) {
+      started_ = true;
+      StartThreads();
+    }
+  }
+
+  scheduled_.fetch_add(1, std::memory_order_relaxed);
+  Worker& worker = workers_[slot];
+  worker.mutex.Lock();
+  worker.queue.push_back(WorkItem{function, arg, SteadyNanos()});
+  queued_.fetch_add(1);
+  worker.mutex.Unlock();
+
+  // A worker increments idle_ before it checks queued_ for the last time,
+  // so either it sees this item or we see it waiting.
+  if (idle_.load() > 0) {
+    MutexLock l(&mutex_);
+    work_cv_.Signal();
+  }
+}
+
+void PosixThreadPool::SetThreads(int number) {
+  number = std::max(1, std::min(number, kMaxBackgroundThreads));
+  MutexLock l(&mutex_);
+  num_threads_.store(number, std::memory_order_relaxed);
+  if (started_) {
+    StartThreads();
+  }
+  // Wake idle threads so that surplus ones exit.
+  work_cv_.SignalAll();
+}
+
+Status PosixThreadPool::SetCPUs(const std::vector<int>& cpus) {
+#if HAVE_PTHREAD_SETAFFINITY_NP
+  for (int cpu : cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      return Status::InvalidArgument("invalid CPU number");
+    }
+  }
+  MutexLock l(&mutex_);
+  cpus_ = cpus;
+  cpus_generation_.fetch_add(1, std::memory_order_release);
+  return Status::OK();
+#else
+  return Status::NotSupported("SetBackgroundThreadCPUs");
+#endif  // HAVE_PTHREAD_SETAFFINITY_NP
+}
+
+void PosixThreadPool::GetStats(ThreadPoolStats* stats) const {
+  stats->threads = num_threads_.load(std::memory_order_relaxed);
+  stats->queue_length = queued_.load(std::memory_order_relaxed);
+  stats->running = running_.load(std::memory_order_relaxed);
+  stats->scheduled = scheduled_.load(std::memory_order_relaxed);
+  stats->completed = completed_.load(std::memory_order_relaxed);
+  HistogramSnapshot snapshot;
+  queue_wait_nanos_.MergeInto(&snapshot);
+  snapshot.Summarize(&stats->queue_wait_nanos);
+}
+
+void PosixThreadPool::StartThreads() {
+  const int num_threads = num_threads_.load(std::memory_order_relaxed);
+  for (int i = 0; i < num_threads; i++) {
+    if (!workers_[i].running) {
+      workers_[i].running = true;
+      if (slots_used_.load(std::memory_order_relaxed) <= i) {
+        slots_used_.store(i + 1, std::memory_order_release);
+      }
+      std::thread worker_thread(&PosixThreadPool::WorkerMain, this, i);
+      worker_thread.detach();
+    }
+  }
+}
+
+bool PosixThreadPool::TakeWork(int index, WorkItem* item) {
+  const int slots = slots_used_.load(std::memory_order_acquire);
+  for (int i = 0; i < slots; i++) {
+    Worker& worker = workers_[(index + i) % slots];
+    MutexLock l(&worker.mutex);
+    if (!worker.queue.empty()) {
+      if (i == 0) {
+        *item = worker.queue.front();
+        worker.queue.pop_front();
+      } else {
+        *item = worker.queue.back();
+        worker.queue.pop_back();
+      }
+      queued_.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void PosixThreadPool::ApplyCPUs(int index) {
+#if HAVE_PTHREAD_SETAFFINITY_NP
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  {
+    MutexLock l(&mutex_);
+    if (!cpus_.empty()) {
+      CPU_SET(cpus_[index % cpus_.size()], &set);
+    }
+  }
+  // With no CPUs configured, return to the CPUs of the process.
+  if (CPU_COUNT(&set) == 0 &&
+      ::sched_getaffinity(::getpid(), sizeof(set), &set) != 0) {
+    return;
+  }
+  ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#endif  // HAVE_PTHREAD_SETAFFINITY_NP
+}
+
+void PosixThreadPool::WorkerMain(int index) {
+  current_pool_ = this;
+  current_index_ = index;
+  uint64_t cpus_generation = 0;
+
+  while (true) {
+    const uint64_t generation =
+        cpus_generation_.load(std::memory_order_acquire);
+    if (generation != cpus_generation) {
+      cpus_generation = generation;
+      ApplyCPUs(index);
+    }
+
+    WorkItem item;
+    if (TakeWork(index, &item)) {
+      queue_wait_nanos_.Add(SteadyNanos() - item.schedule_nanos);
+      running_.fetch_add(1, std::memory_order_relaxed);
+      item.function(item.arg);
+      running_.fetch_sub(1, std::memory_order_relaxed);
+      completed_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+
+    MutexLock l(&mutex_);
+    if (index >= num_threads_.load(std::memory_order_relaxed)) {
+      // Surplus thread.  Anything still pushed onto this slot's deque is
+      // stolen by the remaining threads.
+      workers_[index].running = false;
+      return;
+    }
+    idle_.fetch_add(1);
+    while (queued_.load() == 0 &&
+           index < num_threads_.load(std::memory_order_relaxed)) {
+      work_cv_.Wait();
+    }
+    idle_.fetch_sub(1);
+  }
+}
+
 class PosixEnv : public Env {
  public:
   PosixEnv();
@@ -690,7 +1619,32 @@ class PosixEnv : public Env {
   }
 
   void Schedule(void (*background_work_function)(void* background_work_arg),
-                void* background_work_arg) override;
+                void* background_work_arg) override {
+    Schedule(background_work_function, background_work_arg, kLow);
+  }
+
+  void Schedule(void (*background_work_function)(void* background_work_arg),
+                void* background_work_arg, Priority pri) override {
+    ThreadPool(pri)->Schedule(background_work_function, background_work_arg);
+  }
+
+  void SetBackgroundThreads(int number, Priority pri) override {
+    ThreadPool(pri)->SetThreads(number);
+  }
+
+  int GetBackgroundThreads(Priority pri) override {
+    return ThreadPool(pri)->GetThreads();
+  }
+
+  Status SetBackgroundThreadCPUs(const std::vector<int>& cpus,
+                                 Priority pri) override {
+    return ThreadPool(pri)->SetCPUs(cpus);
+  }
+
+  bool GetThreadPoolStats(Priority pri, ThreadPoolStats* stats) override {
+    ThreadPool(pri)->GetStats(stats);
+    return true;
+  }
 
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
@@ -746,33 +1700,11 @@ class PosixEnv : public Env {
   }
 
  private:
-  void BackgroundThreadMain();
-
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
+  PosixThreadPool* ThreadPool(Priority pri) {
+    return &thread_pools_[pri == kHigh ? kHigh : kLow];
   }
 
-  // Stores the work item data in a Schedule() call.
-  //
-  // Instances are constructed on the thread calling Schedule() and used on the
-  // background thread.
-  //
-  // This structure is thread-safe because it is immutable.
-  struct BackgroundWorkItem {
-    explicit BackgroundWorkItem(void (*function)(void* arg), void* arg)
-        : function(function), arg(arg) {}
-
-    void (*const function)(void*);
-    void* const arg;
-  };
-
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
-
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
-
+  PosixThreadPool thread_pools_[2];  // Indexed by Priority.  Thread-safe.
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
   Limiter fd_limiter_;    // Thread-safe.
@@ -807,51 +1739,9 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
-      mmap_limiter_(MaxMmaps()),
+    : mmap_limiter_(MaxMmaps()),
       fd_limiter_(MaxOpenFiles()) {}
 
-void PosixEnv::Schedule(
-    void (*background_work_function)(void* background_work_arg),
-    void* background_work_arg) {
-  background_work_mutex_.Lock();
-
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
-    background_thread.detach();
-  }
-
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
-  }
-
-  background_work_queue_.emplace(background_work_function, background_work_arg);
-  background_work_mutex_.Unlock();
-}
-
-void PosixEnv::BackgroundThreadMain() {
-  while (true) {
-    background_work_mutex_.Lock();
-
-    // Wait until there is work to be done.
-    while (background_work_queue_.empty()) {
-      background_work_cv_.Wait();
-    }
-
-    assert(!background_work_queue_.empty());
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
-
-    background_work_mutex_.Unlock();
-    background_work_function(background_work_arg);
-  }
-}
-
 namespace {
 
 // Wraps an Env instance whose destructor is never created.
@@ -924,4 +1814,68 @@ Env* Env::Default() {
   return env_container.env();
 }
 
+namespace {
+
+// Forwards everything to the base Env except NewRandomAccessFile(), which
+// returns files that read through io_uring.
+class PosixIOUringEnv : public EnvWrapper {
+ public:
+  explicit PosixIOUringEnv(Env* base_env) : EnvWrapper(base_env) {}
+
+  Status NewRandomAccessFile(const std::string& filename,
+                             RandomAccessFile** result) override {
+    *result = nullptr;
+    int fd = ::open(filename.c_str(), O_RDONLY | kOpenBaseFlags);
+    if (fd < 0) {
+      return PosixError(filename, errno);
+    }
+    *result = new PosixIOUringRandomAccessFile(filename, fd);
+    return Status::OK();
+  }
+};
+
+}  // namespace
+
+Env* NewIOUringEnv(Env* base_env) { return new PosixIOUringEnv(base_env); }
+
+namespace {
+
+// Forwards everything to the base Env except NewRandomAccessFile() and
+// NewWritableFile(), which return files that bypass the page cache.
+class PosixDirectIOEnv : public EnvWrapper {
+ public:
+  explicit PosixDirectIOEnv(Env* base_env) : EnvWrapper(base_env) {}
+
+  Status NewRandomAccessFile(const std::string& filename,
+                             RandomAccessFile** result) override {
+    *result = nullptr;
+    int fd = OpenDirect(filename, O_RDONLY, 0);
+    if (fd < 0) {
+      return PosixError(filename, errno);
+    }
+    *result = new PosixDirectRandomAccessFile(filename, fd);
+    return Status::OK();
+  }
+
+  Status NewWritableFile(const std::string& filename,
+                         WritableFile** result) override {
+    *result = nullptr;
+    char* buf = AllocateDirectIOBuffer(kWritableFileBufferSize);
+    if (buf == nullptr) {
+      return PosixError(filename, ENOMEM);
+    }
+    int fd = OpenDirect(filename, O_TRUNC | O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+      std::free(buf);
+      return PosixError(filename, errno);
+    }
+    *result = new PosixDirectWritableFile(filename, fd, buf);
+    return Status::OK();
+  }
+};
+
+}  // namespace
+
+Env* NewDirectIOEnv(Env* base_env) { return new PosixDirectIOEnv(base_env); }
+
 }  // namespace leveldb
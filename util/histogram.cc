@@ -0,0 +1,145 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "histogram.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include "no_destructor.h"
+
+namespace leveldb {
+
+namespace {
+
+class BucketLimits {
+ public:
+  BucketLimits() {
+    static const int kMantissas[] = {10, 12, 14, 16, 18, 20, 25, 30,
+                                     35, 40, 45, 50, 60, 70, 80, 90};
+    int b = 0;
+    for (int v = 1; v <= 9; v++) {
+      limits_[b++] = v;
+    }
+    uint64_t scale = 1;
+    while (b < kHistogramNumBuckets - 1) {
+      for (int mantissa : kMantissas) {
+        limits_[b++] = mantissa * scale;
+      }
+      scale *= 10;
+    }
+    limits_[b++] = std::numeric_limits<uint64_t>::max();
+    assert(b == kHistogramNumBuckets);
+  }
+
+  uint64_t limit(int b) const { return limits_[b]; }
+
+  int BucketFor(uint64_t value) const {
+    return static_cast<int>(
+        std::upper_bound(limits_, limits_ + kHistogramNumBuckets - 1, value) -
+        limits_);
+  }
+
+ private:
+  uint64_t limits_[kHistogramNumBuckets];
+};
+
+const BucketLimits& Limits() {
+  static NoDestructor<BucketLimits> limits;
+  return *limits.get();
+}
+
+// Value below which "p" percent of the samples fall, scaled linearly within
+// the bucket that holds it.
+double Percentile(const HistogramSnapshot& snapshot, double p) {
+  const BucketLimits& limits = Limits();
+  const double threshold = snapshot.count * (p / 100.0);
+  uint64_t sum = 0;
+  for (int b = 0; b < kHistogramNumBuckets; b++) {
+    sum += snapshot.buckets[b];
+    if (snapshot.buckets[b] > 0 && sum >= threshold) {
+      const double left = (b == 0) ? 0 : limits.limit(b - 1);
+      const double right = (b == kHistogramNumBuckets - 1)
+                               ? static_cast<double>(snapshot.max)
+                               : static_cast<double>(limits.limit(b));
+      const double pos =
+          (threshold - (sum - snapshot.buckets[b])) / snapshot.buckets[b];
+      double r = left + (right - left) * pos;
+      r = std::max(r, static_cast<double>(snapshot.min));
+      r = std::min(r, static_cast<double>(snapshot.max));
+      return r;
+    }
+  }
+  return snapshot.max;
+}
+
+}  // namespace
+
+HistogramSnapshot::HistogramSnapshot()
+    : count(0), sum(0), min(std::numeric_limits<uint64_t>::max()), max(0) {
+  std::fill(buckets, buckets + kHistogramNumBuckets, 0);
+}
+
+void HistogramSnapshot::Summarize(HistogramData* data) const {
+  *data = HistogramData();
+  if (count == 0) {
+    return;
+  }
+  data->count = count;
+  data->sum = sum;
+  data->min = min;
+  data->max = max;
+  data->average = static_cast<double>(sum) / count;
+  data->median = Percentile(*this, 50);
+  data->percentile95 = Percentile(*this, 95);
+  data->percentile99 = Percentile(*this, 99);
+  data->percentile999 = Percentile(*this, 99.9);
+}
+
+AtomicHistogram::AtomicHistogram() {
+  Limits();  // Build the bucket table before it is needed concurrently.
+  Clear();
+}
+
+void AtomicHistogram::Add(uint64_t value) {
+  buckets_[Limits().BucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t current = min_.load(std::memory_order_relaxed);
+  while (value < current &&
+         !min_.compare_exchange_weak(current, value,
+                                     std::memory_order_relaxed)) {
+  }
+  current = max_.load(std::memory_order_relaxed);
+  while (value > current &&
+         !max_.compare_exchange_weak(current, value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+void AtomicHistogram::MergeInto(HistogramSnapshot* snapshot) const {
+  snapshot->count += count_.load(std::memory_order_relaxed);
+  snapshot->sum += sum_.load(std::memory_order_relaxed);
+  snapshot->min =
+      std::min(snapshot->min, min_.load(std::memory_order_relaxed));
+  snapshot->max =
+      std::max(snapshot->max, max_.load(std::memory_order_relaxed));
+  for (int b = 0; b < kHistogramNumBuckets; b++) {
+    snapshot->buckets[b] += buckets_[b].load(std::memory_order_relaxed);
+  }
+}
+
+void AtomicHistogram::Clear() {
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace leveldb
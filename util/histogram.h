@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_HISTOGRAM_H_
+#define STORAGE_LEVELDB_UTIL_HISTOGRAM_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "../include/statistics.h"
+
+namespace leveldb {
+
+// Bucket b holds the values in [limit(b - 1), limit(b)): 1 to 9, then 16
+// buckets per power of ten (10, 12, 14, 16, 18, 20, 25, ..., 90, 100, ...)
+// up to 10^13, then one bucket for the rest.
+constexpr int kHistogramNumBuckets = 9 + 16 * 13 + 1;
+
+// Plain sum of one or more AtomicHistograms.
+struct HistogramSnapshot {
+  HistogramSnapshot();
+
+  // Fill in *data, including the interpolated percentiles.
+  void Summarize(HistogramData* data) const;
+
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[kHistogramNumBuckets];
+};
+
+// A histogram that any number of threads may add to and read from without
+// locking.  A reader running concurrently with writers may see a sample in
+// some fields (e.g. count) but not yet in others.
+class AtomicHistogram {
+ public:
+  AtomicHistogram();
+
+  AtomicHistogram(const AtomicHistogram&) = delete;
+  AtomicHistogram& operator=(const AtomicHistogram&) = delete;
+
+  void Add(uint64_t value);
+
+  // Add the samples of this histogram to *snapshot.
+  void MergeInto(HistogramSnapshot* snapshot) const;
+
+  void Clear();
+
+ private:
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> min_;
+  std::atomic<uint64_t> max_;
+  std::atomic<uint64_t> buckets_[kHistogramNumBuckets];
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_HISTOGRAM_H_
@@ -0,0 +1,372 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "../include/io_stats_env.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+
+#include "../port/port.h"
+#include "../port/port_stdcxx.h"
+#include "../port/thread_annotations.h"
+#include "histogram.h"
+#include "mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+uint64_t NowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The counters of one file name.  Updated without locking by every open
+// file with that name.
+class FileCounters {
+ public:
+  FileCounters() { Clear(); }
+
+  FileCounters(const FileCounters&) = delete;
+  FileCounters& operator=(const FileCounters&) = delete;
+
+  void RecordRead(size_t requested, size_t returned) {
+    read_count_.fetch_add(1, std::memory_order_relaxed);
+    read_bytes_.fetch_add(returned, std::memory_order_relaxed);
+    read_size_.Add(requested);
+  }
+
+  void RecordReadTime(uint64_t nanos) { read_nanos_.Add(nanos); }
+
+  void RecordWrite(size_t bytes, uint64_t nanos) {
+    write_count_.fetch_add(1, std::memory_order_relaxed);
+    write_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    write_nanos_.Add(nanos);
+  }
+
+  void RecordFlush(uint64_t nanos) { write_nanos_.Add(nanos); }
+
+  void RecordSync(uint64_t nanos) {
+    sync_count_.fetch_add(1, std::memory_order_relaxed);
+    sync_nanos_.Add(nanos);
+  }
+
+  // Add the counters to *stats and the histograms to the snapshots.
+  void MergeInto(IOStats* stats, HistogramSnapshot* read_nanos,
+                 HistogramSnapshot* read_size, HistogramSnapshot* write_nanos,
+                 HistogramSnapshot* sync_nanos) const {
+    stats->read_count += read_count_.load(std::memory_order_relaxed);
+    stats->read_bytes += read_bytes_.load(std::memory_order_relaxed);
+    stats->write_count += write_count_.load(std::memory_order_relaxed);
+    stats->write_bytes += write_bytes_.load(std::memory_order_relaxed);
+    stats->sync_count += sync_count_.load(std::memory_order_relaxed);
+    read_nanos_.MergeInto(read_nanos);
+    read_size_.MergeInto(read_size);
+    write_nanos_.MergeInto(write_nanos);
+    sync_nanos_.MergeInto(sync_nanos);
+  }
+
+  void Clear() {
+    read_count_.store(0, std::memory_order_relaxed);
+    read_bytes_.store(0, std::memory_order_relaxed);
+    write_count_.store(0, std::memory_order_relaxed);
+    write_bytes_.store(0, std::memory_order_relaxed);
+    sync_count_.store(0, std::memory_order_relaxed);
+    read_nanos_.Clear();
+    read_size_.Clear();
+    write_nanos_.Clear();
+    sync_nanos_.Clear();
+  }
+
+ private:
+  std::atomic<uint64_t> read_count_;
+  std::atomic<uint64_t> read_bytes_;
+  std::atomic<uint64_t> write_count_;
+  std::atomic<uint64_t> write_bytes_;
+  std::atomic<uint64_t> sync_count_;
+  AtomicHistogram read_nanos_;
+  AtomicHistogram read_size_;
+  AtomicHistogram write_nanos_;
+  AtomicHistogram sync_nanos_;
+};
+
+// Sums the counters of one or more files into an IOStats.
+class IOStatsBuilder {
+ public:
+  void Add(const FileCounters& counters) {
+    counters.MergeInto(&stats_, &read_nanos_, &read_size_, &write_nanos_,
+                       &sync_nanos_);
+  }
+
+  void Finish(IOStats* stats) {
+    read_nanos_.Summarize(&stats_.read_nanos);
+    read_size_.Summarize(&stats_.read_size);
+    write_nanos_.Summarize(&stats_.write_nanos);
+    sync_nanos_.Summarize(&stats_.sync_nanos);
+    *stats = stats_;
+  }
+
+ private:
+  IOStats stats_;
+  HistogramSnapshot read_nanos_;
+  HistogramSnapshot read_size_;
+  HistogramSnapshot write_nanos_;
+  HistogramSnapshot sync_nanos_;
+};
+
+class IOStatsSequentialFile final : public SequentialFile {
+ public:
+  IOStatsSequentialFile(SequentialFile* target, FileCounters* counters)
+      : target_(target), counters_(counters) {}
+
+  ~IOStatsSequentialFile() override { delete target_; }
+
+  Status Read(size_t n, Slice* result, char* scratch) override {
+    const uint64_t start = NowNanos();
+    Status s = target_->Read(n, result, scratch);
+    counters_->RecordReadTime(NowNanos() - start);
+    counters_->RecordRead(n, s.ok() ? result->size() : 0);
+    return s;
+  }
+
+  Status Skip(uint64_t n) override { return target_->Skip(n); }
+
+ private:
+  SequentialFile* const target_;
+  FileCounters* const counters_;
+};
+
+class IOStatsRandomAccessFile final : public RandomAccessFile {
+ public:
+  IOStatsRandomAccessFile(RandomAccessFile* target, FileCounters* counters)
+      : target_(target), counters_(counters) {}
+
+  ~IOStatsRandomAccessFile() override { delete target_; }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    const uint64_t start = NowNanos();
+    Status s = target_->Read(offset, n, result, scratch);
+    counters_->RecordReadTime(NowNanos() - start);
+    counters_->RecordRead(n, s.ok() ? result->size() : 0);
+    return s;
+  }
+
+  bool IsMemoryMapped() const override { return target_->IsMemoryMapped(); }
+
+  size_t GetRequiredBufferAlignment() const override {
+    return target_->GetRequiredBufferAlignment();
+  }
+
+  void Submit(ReadRequest* req) const override { target_->Submit(req); }
+
+  void Wait(ReadRequest* const* reqs, size_t n) const override {
+    target_->Wait(reqs, n);
+    for (size_t i = 0; i < n; i++) {
+      counters_->RecordRead(reqs[i]->n,
+                            reqs[i]->status.ok() ? reqs[i]->result.size() : 0);
+    }
+  }
+
+  void MultiRead(ReadRequest* reqs, size_t n) const override {
+    const uint64_t start = NowNanos();
+    target_->MultiRead(reqs, n);
+    const uint64_t nanos = NowNanos() - start;
+    for (size_t i = 0; i < n; i++) {
+      counters_->RecordReadTime(nanos);
+      counters_->RecordRead(reqs[i].n,
+                            reqs[i].status.ok() ? reqs[i].result.size() : 0);
+    }
+  }
+
+ private:
+  RandomAccessFile* const target_;
+  FileCounters* const counters_;
+};
+
+class IOStatsWritableFile final : public WritableFile {
+ public:
+  IOStatsWritableFile(WritableFile* target, FileCounters* counters)
+      : target_(target), counters_(counters) {}
+
+  ~IOStatsWritableFile() override { delete target_; }
+
+  Status Append(const Slice& data) override {
+    const uint64_t start = NowNanos();
+    Status s = target_->Append(data);
+    counters_->RecordWrite(data.size(), NowNanos() - start);
+    return s;
+  }
+
+  Status Close() override { return target_->Close(); }
+
+  Status Flush() override {
+    const uint64_t start = NowNanos();
+    Status s = target_->Flush();
+    counters_->RecordFlush(NowNanos() - start);
+    return s;
+  }
+
+  Status Sync() override {
+    const uint64_t start = NowNanos();
+    Status s = target_->Sync();
+    counters_->RecordSync(NowNanos() - start);
+    return s;
+  }
+
+ private:
+  WritableFile* const target_;
+  FileCounters* const counters_;
+};
+
+class IOStatsEnvImpl : public IOStatsEnv {
+ public:
+  explicit IOStatsEnvImpl(Env* base_env) : IOStatsEnv(base_env) {}
+
+  Status NewSequentialFile(const std::string& fname,
+                           SequentialFile** result) override {
+    SequentialFile* file;
+    Status s = target()->NewSequentialFile(fname, &file);
+    *result = s.ok() ? new IOStatsSequentialFile(file, CountersFor(fname))
+                     : nullptr;
+    return s;
+  }
+
+  Status NewRandomAccessFile(const std::string& fname,
+                             RandomAccessFile** result) override {
+    RandomAccessFile* file;
+    Status s = target()->NewRandomAccessFile(fname, &file);
+    *result = s.ok() ? new IOStatsRandomAccessFile(file, CountersFor(fname))
+                     : nullptr;
+    return s;
+  }
+
+  Status NewWritableFile(const std::string& fname,
+                         WritableFile** result) override {
+    WritableFile* file;
+    Status s = target()->NewWritableFile(fname, &file);
+    *result =
+        s.ok() ? new IOStatsWritableFile(file, CountersFor(fname)) : nullptr;
+    return s;
+  }
+
+  Status NewAppendableFile(const std::string& fname,
+                           WritableFile** result) override {
+    WritableFile* file;
+    Status s = target()->NewAppendableFile(fname, &file);
+    *result =
+        s.ok() ? new IOStatsWritableFile(file, CountersFor(fname)) : nullptr;
+    return s;
+  }
+
+  void GetStats(IOStats* stats) const override {
+    IOStatsBuilder builder;
+    MutexLock l(&mutex_);
+    for (const auto& entry : files_) {
+      builder.Add(*entry.second);
+    }
+    builder.Finish(stats);
+  }
+
+  bool GetFileStats(const std::string& fname, IOStats* stats) const override {
+    IOStatsBuilder builder;
+    MutexLock l(&mutex_);
+    auto it = files_.find(fname);
+    if (it == files_.end()) {
+      return false;
+    }
+    builder.Add(*it->second);
+    builder.Finish(stats);
+    return true;
+  }
+
+  void GetFileNames(std::vector<std::string>* names) const override {
+    names->clear();
+    MutexLock l(&mutex_);
+    for (const auto& entry : files_) {
+      names->push_back(entry.first);
+    }
+  }
+
+  void ResetStats() override {
+    MutexLock l(&mutex_);
+    for (const auto& entry : files_) {
+      entry.second->Clear();
+    }
+  }
+
+ private:
+  // Return the counters of "fname", creating them on first use.  They live
+  // as long as this Env, so open files keep a plain pointer to them.
+  FileCounters* CountersFor(const std::string& fname) {
+    MutexLock l(&mutex_);
+    std::unique_ptr<FileCounters>& counters = files_[fname];
+    if (counters == nullptr) {
+      counters.reset(new FileCounters);
+    }
+    return counters.get();
+  }
+
+  mutable port::Mutex mutex_;
+  std::map<std::string, std::unique_ptr<FileCounters>> files_
+      GUARDED_BY(mutex_);
+};
+
+void AppendHistogram(std::string* result, const char* name,
+                     const HistogramData& data) {
+  char buf[256];
+  std::snprintf(buf, sizeof(buf),
+                "  %s: count %llu avg %.1f P50 %.1f P99 %.1f P99.9 %.1f "
+                "max %llu\n",
+                name, static_cast<unsigned long long>(data.count),
+                data.average, data.median, data.percentile99,
+                data.percentile999, static_cast<unsigned long long>(data.max));
+  result->append(buf);
+}
+
+}  // namespace
+
+std::string IOStats::ToString() const {
+  std::string result;
+  char buf[256];
+  std::snprintf(buf, sizeof(buf),
+                "  reads %llu (%llu bytes) writes %llu (%llu bytes) "
+                "syncs %llu\n",
+                static_cast<unsigned long long>(read_count),
+                static_cast<unsigned long long>(read_bytes),
+                static_cast<unsigned long long>(write_count),
+                static_cast<unsigned long long>(write_bytes),
+                static_cast<unsigned long long>(sync_count));
+  result.append(buf);
+  AppendHistogram(&result, "read nanos", read_nanos);
+  AppendHistogram(&result, "read size", read_size);
+  AppendHistogram(&result, "write nanos", write_nanos);
+  AppendHistogram(&result, "sync nanos", sync_nanos);
+  return result;
+}
+
+IOStatsEnv::~IOStatsEnv() = default;
+
+std::string IOStatsEnv::ToString() const {
+  IOStats stats;
+  GetStats(&stats);
+  std::string result = "total:\n" + stats.ToString();
+
+  std::vector<std::string> names;
+  GetFileNames(&names);
+  for (const std::string& name : names) {
+    if (GetFileStats(name, &stats)) {
+      result.append(name + ":\n" + stats.ToString());
+    }
+  }
+  return result;
+}
+
+IOStatsEnv* NewIOStatsEnv(Env* base_env) { return new IOStatsEnvImpl(base_env); }
+
+}  // namespace leveldb
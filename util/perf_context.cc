@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "../include/perf_context.h"
+
+#include <cstdio>
+
+#include "perf_context_imp.h"
+
+namespace leveldb {
+
+thread_local PerfLevel perf_level = kDisable;
+thread_local PerfContext perf_context;
+
+void SetPerfLevel(PerfLevel level) { perf_level = level; }
+
+PerfLevel GetPerfLevel() { return perf_level; }
+
+PerfContext* GetPerfContext() { return &perf_context; }
+
+void PerfContext::Reset() { *this = PerfContext(); }
+
+std::string PerfContext::ToString(bool exclude_zero_counters) const {
+  const struct {
+    const char* name;
+    uint64_t value;
+  } fields[] = {
+      {"get_count", get_count},
+      {"get_nanos", get_nanos},
+      {"index_seek_nanos", index_seek_nanos},
+      {"filter_check_count", filter_check_count},
+      {"filter_useful_count", filter_useful_count},
+      {"block_cache_hit_count", block_cache_hit_count},
+      {"block_cache_miss_count", block_cache_miss_count},
+      {"block_read_count", block_read_count},
+      {"block_read_bytes", block_read_bytes},
+      {"block_read_nanos", block_read_nanos},
+      {"block_checksum_nanos", block_checksum_nanos},
+      {"block_decompress_count", block_decompress_count},
+      {"block_decompressed_bytes", block_decompressed_bytes},
+      {"block_decompress_nanos", block_decompress_nanos},
+      {"block_seek_nanos", block_seek_nanos},
+      {"key_comparison_count", key_comparison_count},
+  };
+
+  std::string result;
+  for (const auto& field : fields) {
+    if (exclude_zero_counters && field.value == 0) {
+      continue;
+    }
+    if (!result.empty()) {
+      result.append(", ");
+    }
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%s = %llu", field.name,
+                  static_cast<unsigned long long>(field.value));
+    result.append(buf);
+  }
+  return result;
+}
+
+}  // namespace leveldb
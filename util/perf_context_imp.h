@@ -0,0 +1,65 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Helpers for updating the calling thread's PerfContext.  With the perf
+// level at kDisable each of them costs one thread-local load and a branch.
+
+#ifndef STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+#define STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+
+#include <chrono>
+#include <cstdint>
+
+#include "../include/perf_context.h"
+
+namespace leveldb {
+
+extern thread_local PerfLevel perf_level;
+extern thread_local PerfContext perf_context;
+
+// Adds the time from construction to destruction (or Stop()) to *metric if
+// the perf level was kEnableTime at construction.
+class PerfStepTimer {
+ public:
+  explicit PerfStepTimer(uint64_t* metric)
+      : metric_(perf_level >= kEnableTime ? metric : nullptr) {
+    if (metric_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  PerfStepTimer(const PerfStepTimer&) = delete;
+  PerfStepTimer& operator=(const PerfStepTimer&) = delete;
+
+  ~PerfStepTimer() { Stop(); }
+
+  void Stop() {
+    if (metric_ != nullptr) {
+      *metric_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start_)
+                      .count();
+      metric_ = nullptr;
+    }
+  }
+
+ private:
+  uint64_t* metric_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace leveldb
+
+// Add "value" to perf_context.metric if counters are enabled.
+#define PERF_COUNTER_ADD(metric, value)                   \
+  do {                                                    \
+    if (leveldb::perf_level >= leveldb::kEnableCount) {   \
+      leveldb::perf_context.metric += (value);            \
+    }                                                     \
+  } while (0)
+
+// Time the rest of the enclosing scope into perf_context.metric.
+#define PERF_TIMER_GUARD(metric) \
+  leveldb::PerfStepTimer perf_step_timer_##metric(&leveldb::perf_context.metric)
+
+#endif  // STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
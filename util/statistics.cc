@@ -0,0 +1,221 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "../include/statistics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <thread>
+
+#include "../port/port.h"
+#include "../port/port_stdcxx.h"
+#include "histogram.h"
+
+#if HAVE_SCHED_GETCPU
+#include <sched.h>
+#endif  // HAVE_SCHED_GETCPU
+
+namespace leveldb {
+
+namespace {
+
+const char* const kTickerNames[] = {
+    "leveldb.block.cache.hit",
+    "leveldb.block.cache.miss",
+    "leveldb.block.cache.compressed.hit",
+    "leveldb.block.read",
+    "leveldb.block.read.bytes",
+    "leveldb.filter.useful",
+    "leveldb.table.bytes.written",
+    "leveldb.block.compressed",
+    "leveldb.block.compression.rejected",
+    "leveldb.block.compression.bypassed",
+    "leveldb.compression.input.bytes",
+    "leveldb.compression.output.bytes",
+};
+static_assert(sizeof(kTickerNames) / sizeof(kTickerNames[0]) == kTickerMax,
+              "kTickerNames does not match Ticker");
+
+const char* const kHistogramNames[] = {
+    "leveldb.get.nanos",
+    "leveldb.block.read.nanos",
+    "leveldb.table.add.nanos",
+    "leveldb.table.finish.nanos",
+    "leveldb.table.sync.nanos",
+};
+static_assert(sizeof(kHistogramNames) / sizeof(kHistogramNames[0]) ==
+                  kHistogramMax,
+              "kHistogramNames does not match Histogram");
+
+struct StatisticsShard {
+  // Keeps the counters of neighbouring shards on different cache lines.
+  char padding[64];
+  std::atomic<uint64_t> tickers[kTickerMax];
+  AtomicHistogram histograms[kHistogramMax];
+};
+
+// Number of shards: the number of CPUs rounded up to a power of two.
+size_t NumShards() {
+  size_t n = 1;
+  while (n < std::thread::hardware_concurrency() && n < 256) {
+    n *= 2;
+  }
+  return n;
+}
+
+class StatisticsImpl : public Statistics {
+ public:
+  StatisticsImpl()
+      : num_shards_(NumShards()), shards_(new StatisticsShard[num_shards_]) {
+    Reset();
+  }
+
+  ~StatisticsImpl() override { delete[] shards_; }
+
+  void RecordTick(Ticker ticker, uint64_t count) override {
+    CurrentShard()->tickers[ticker].fetch_add(count,
+                                              std::memory_order_relaxed);
+  }
+
+  void RecordInHistogram(Histogram histogram, uint64_t value) override {
+    CurrentShard()->histograms[histogram].Add(value);
+  }
+
+  uint64_t GetTickerCount(Ticker ticker) const override {
+    uint64_t count = 0;
+    for (size_t i = 0; i < num_shards_; i++) {
+      count += shards_[i].tickers[ticker].load(std::memory_order_relaxed);
+    }
+    return count;
+  }
+
+  void GetHistogramData(Histogram histogram,
+                        HistogramData* data) const override {
+    HistogramSnapshot snapshot;
+    for (size_t i = 0; i < num_shards_; i++) {
+      shards_[i].histograms[histogram].MergeInto(&snapshot);
+    }
+    snapshot.Summarize(data);
+  }
+
+  void Reset() override {
+    for (size_t i = 0; i < num_shards_; i++) {
+      StatisticsShard& shard = shards_[i];
+      for (auto& ticker : shard.tickers) {
+        ticker.store(0, std::memory_order_relaxed);
+      }
+      for (AtomicHistogram& h : shard.histograms) {
+        h.Clear();
+      }
+    }
+  }
+
+ private:
+  // The shard of the CPU the calling thread runs on.  Threads that migrate
+  // between CPUs stay correct since all updates are atomic.
+  StatisticsShard* CurrentShard() {
+#if HAVE_SCHED_GETCPU
+    const int cpu = ::sched_getcpu();
+    if (cpu >= 0) {
+      return &shards_[static_cast<size_t>(cpu) & (num_shards_ - 1)];
+    }
+#endif  // HAVE_SCHED_GETCPU
+    // Without the CPU number, spread threads by the address of a
+    // thread-local variable.
+    static thread_local char thread_marker;
+    const uintptr_t id = reinterpret_cast<uintptr_t>(&thread_marker);
+    return &shards_[(id >> 6) & (num_shards_ - 1)];
+  }
+
+  const size_t num_shards_;  // A power of two.
+  StatisticsShard* const shards_;
+};
+
+// Prometheus metric names allow [a-zA-Z0-9_:] only.
+std::string PrometheusName(const char* name) {
+  std::string result(name);
+  std::replace(result.begin(), result.end(), '.', '_');
+  return result;
+}
+
+}  // namespace
+
+const char* TickerName(Ticker ticker) {
+  assert(ticker < kTickerMax);
+  return kTickerNames[ticker];
+}
+
+const char* HistogramName(Histogram histogram) {
+  assert(histogram < kHistogramMax);
+  return kHistogramNames[histogram];
+}
+
+Statistics::~Statistics() = default;
+
+std::string Statistics::ToString() const {
+  std::string result;
+  char buf[512];
+  for (uint32_t t = 0; t < kTickerMax; t++) {
+    std::snprintf(buf, sizeof(buf), "%s COUNT : %llu\n", kTickerNames[t],
+                  static_cast<unsigned long long>(
+                      GetTickerCount(static_cast<Ticker>(t))));
+    result.append(buf);
+  }
+  for (uint32_t h = 0; h < kHistogramMax; h++) {
+    HistogramData data;
+    GetHistogramData(static_cast<Histogram>(h), &data);
+    std::snprintf(
+        buf, sizeof(buf),
+        "%s P50 : %.1f P95 : %.1f P99 : %.1f P99.9 : %.1f MAX : %llu "
+        "COUNT : %llu SUM : %llu\n",
+        kHistogramNames[h], data.median, data.percentile95, data.percentile99,
+        data.percentile999, static_cast<unsigned long long>(data.max),
+        static_cast<unsigned long long>(data.count),
+        static_cast<unsigned long long>(data.sum));
+    result.append(buf);
+  }
+  return result;
+}
+
+std::string Statistics::ToPrometheus() const {
+  std::string result;
+  char buf[512];
+  for (uint32_t t = 0; t < kTickerMax; t++) {
+    const std::string name = PrometheusName(kTickerNames[t]) + "_total";
+    std::snprintf(buf, sizeof(buf), "# TYPE %s counter\n%s %llu\n",
+                  name.c_str(), name.c_str(),
+                  static_cast<unsigned long long>(
+                      GetTickerCount(static_cast<Ticker>(t))));
+    result.append(buf);
+  }
+  for (uint32_t h = 0; h < kHistogramMax; h++) {
+    const std::string name = PrometheusName(kHistogramNames[h]);
+    HistogramData data;
+    GetHistogramData(static_cast<Histogram>(h), &data);
+    std::snprintf(buf, sizeof(buf),
+                  "# TYPE %s summary\n"
+                  "%s{quantile=\"0.5\"} %.1f\n"
+                  "%s{quantile=\"0.95\"} %.1f\n"
+                  "%s{quantile=\"0.99\"} %.1f\n"
+                  "%s{quantile=\"0.999\"} %.1f\n"
+                  "%s_sum %llu\n"
+                  "%s_count %llu\n"
+                  "# TYPE %s_max gauge\n"
+                  "%s_max %llu\n",
+                  name.c_str(), name.c_str(), data.median, name.c_str(),
+                  data.percentile95, name.c_str(), data.percentile99,
+                  name.c_str(), data.percentile999, name.c_str(),
+                  static_cast<unsigned long long>(data.sum), name.c_str(),
+                  static_cast<unsigned long long>(data.count), name.c_str(),
+                  name.c_str(), static_cast<unsigned long long>(data.max));
+    result.append(buf);
+  }
+  return result;
+}
+
+Statistics* NewStatistics() { return new StatisticsImpl(); }
+
+}  // namespace leveldb
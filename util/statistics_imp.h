@@ -0,0 +1,55 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Helpers for recording into an optional Statistics object.  Both do
+// nothing (and StopWatch does not read the clock) when it is null.
+
+#ifndef STORAGE_LEVELDB_UTIL_STATISTICS_IMP_H_
+#define STORAGE_LEVELDB_UTIL_STATISTICS_IMP_H_
+
+#include <chrono>
+#include <cstdint>
+
+#include "../include/statistics.h"
+
+namespace leveldb {
+
+inline void RecordTick(Statistics* statistics, Ticker ticker,
+                       uint64_t count = 1) {
+  if (statistics != nullptr) {
+    statistics->RecordTick(ticker, count);
+  }
+}
+
+// Records the time from construction to destruction in a histogram.
+class StopWatch {
+ public:
+  StopWatch(Statistics* statistics, Histogram histogram)
+      : statistics_(statistics), histogram_(histogram) {
+    if (statistics_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  StopWatch(const StopWatch&) = delete;
+  StopWatch& operator=(const StopWatch&) = delete;
+
+  ~StopWatch() {
+    if (statistics_ != nullptr) {
+      statistics_->RecordInHistogram(
+          histogram_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start_)
+                          .count());
+    }
+  }
+
+ private:
+  Statistics* const statistics_;
+  const Histogram histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_STATISTICS_IMP_H_
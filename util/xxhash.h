@@ -0,0 +1,22 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// XXH3 64-bit hash (default secret, seed 0), used as an alternative block
+// checksum.  The output is bit-compatible with XXH3_64bits() from the
+// reference xxHash library.
+
+#ifndef STORAGE_LEVELDB_UTIL_XXHASH_H_
+#define STORAGE_LEVELDB_UTIL_XXHASH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace leveldb {
+
+// Return the XXH3 64-bit hash of data[0,n-1].
+uint64_t XXH3Hash64(const char* data, size_t n);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_XXHASH_H_